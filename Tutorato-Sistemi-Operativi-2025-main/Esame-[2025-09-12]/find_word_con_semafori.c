@@ -8,6 +8,7 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <ctype.h>
+#include "lib-misc.h" /* word_count_file() */
 #include <semaphore.h>
 
 #define MAX_PATH 256
@@ -140,26 +141,21 @@ bool read_dir(DIR *dir, const char *directory, Record *r) {
     return false;
 }
 
+/* Conta le occorrenze di `word` nel file con `word_count_file` di lib-misc
+   (vedi find_word_condition.c).
+   Compilazione:
+        EX=../../operating-systems.2024-2025/lab/examples
+        gcc -O2 -pthread -I$EX find_word_con_semafori.c $EX/lib-misc.c -o find_word
+*/
 int check_parola(const char *filename, const char *word) {
-    FILE *file = fopen(filename, "r");
+    long long count = word_count_file(filename, word);
 
-    if(!file) {
+    if(count < 0) {
         perror("Errore apertura file \n");
         return -1;
     }
 
-    char buffer[100];
-    int count = 0;
-    int len = strlen(word);
-
-    while(fscanf(file, "%255s", buffer) == 1) {
-        if(strcasecmp(buffer, word) == 0) {
-            count ++;
-        }
-    }
-
-    fclose(file);
-    return count;
+    return (int)count;
 }
 
 /* --------------------------------------------------------------------------------- */
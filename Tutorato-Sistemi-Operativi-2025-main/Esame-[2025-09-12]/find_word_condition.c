@@ -8,6 +8,10 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <sys/mman.h>
+#include "lib-misc.h" /* word_count_file(), word_set_t */
+#include "lib-dir.h" /* dir_scan_open(), dir_scan_next() */
+#include "lib-word-index.h" /* word_index_update(), word_index_lookup() */
 
 #define MAX_PATH 256
 #define MAX_SIZE 10
@@ -15,6 +19,7 @@
 typedef struct {
     char path[MAX_PATH];
     int occ;
+    int word;   /* indice della parola nella lista (solo con --words) */
 }Record;
 
 typedef struct {
@@ -101,20 +106,25 @@ bool buffer_out(Shared_buffer *buff, Record *r) {
 
 /* ------------------------------------------------------------------------- */
 
-bool read_dir(DIR *dir, const char *directory, Record *r) {
-    struct dirent *entry;
+/* Le voci arrivano dallo scanner di lib-dir, a lotti con getdents64, già
+   senza "." e ".." e con il tipo preso da d_type: solo i link simbolici
+   (stat li segue) vengono controllati con fstatat relativa alla directory
+   già aperta; il percorso completo viene composto solo per i file accettati */
+bool read_dir(dir_scan_t *scan, const char *directory, Record *r) {
+    dir_entry_t entry;
     struct stat st;
 
     char path[MAX_PATH];
 
-    while((entry = readdir(dir)) != NULL) {
-        if(!strcmp(entry -> d_name, ".") || !strcmp(entry -> d_name, "..")) {
-            continue;
+    while(dir_scan_next(scan, &entry) == 1) {
+        bool regular = (entry.type == DIR_ENTRY_FILE);
+
+        if(entry.type == DIR_ENTRY_SYMLINK) {
+            regular = fstatat(scan -> fd, entry.name, &st, 0) == 0 && S_ISREG(st.st_mode);
         }
 
-        snprintf(path, sizeof(path), "%s/%s", directory, entry -> d_name);
-        
-        if(stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+        if(regular) {
+            snprintf(path, sizeof(path), "%s/%s", directory, entry.name);
             strncpy(r -> path, path, MAX_PATH);
             r->path[MAX_PATH - 1] = '\0';   
             return true;
@@ -124,7 +134,65 @@ bool read_dir(DIR *dir, const char *directory, Record *r) {
     return false;
 }
 
+/* Mappa il file in sola lettura: 0 con *data e *size (NULL e 0 per un file
+   vuoto, che non si può mappare) oppure -1 */
+int mappa_file(const char *filename, char **data, size_t *size) {
+    int fd = open(filename, O_RDONLY);
+
+    if(fd < 0) {
+        perror("Errore apertura file \n");
+        return -1;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) < 0) {
+        perror("Errore fstat \n");
+        close(fd);
+        return -1;
+    }
+
+    *data = NULL;
+    *size = st.st_size;
+    if(st.st_size > 0) {
+        *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(*data == MAP_FAILED) {
+            perror("Errore mmap \n");
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+/* Conta le occorrenze di `word` nel file come parola intera, senza
+   distinguere maiuscole e minuscole (stesso risultato di fscanf("%s") +
+   strcasecmp): `word_count_file` di lib-misc mappa il file in memoria e lo
+   scandisce con `word_count`, che scarta 16/32 posizioni alla volta
+   confrontando in modo vettoriale il primo e l'ultimo carattere della parola
+   e gli spazi ai suoi bordi; solo i candidati rimasti vengono confrontati
+   per intero.
+
+   Compilazione:
+        EX=../../operating-systems.2024-2025/lab/examples
+        gcc -O2 -pthread -I$EX find_word_condition.c $EX/lib-misc.c \
+            $EX/lib-dir.c $EX/lib-work-stealing.c $EX/lib-word-index.c -o find_word
+*/
 int check_parola(const char *filename, const char *word) {
+    long long count = word_count_file(filename, word);
+
+    if(count < 0) {
+        perror("Errore apertura file \n");
+        return -1;
+    }
+
+    return (int)count;
+}
+
+/* La versione originale, una parola alla volta con fscanf (per confronto
+   con --fscanf): il buffer deve poter contenere i 255 caratteri letti */
+int check_parola_fscanf(const char *filename, const char *word) {
     FILE *file = fopen(filename, "r");
 
     if(!file) {
@@ -132,9 +200,8 @@ int check_parola(const char *filename, const char *word) {
         return -1;
     }
 
-    char buffer[100];
+    char buffer[256];
     int count = 0;
-    int len = strlen(word);
 
     while(fscanf(file, "%255s", buffer) == 1) {
         if(strcasecmp(buffer, word) == 0) {
@@ -146,6 +213,158 @@ int check_parola(const char *filename, const char *word) {
     return count;
 }
 
+/* Funzione di conteggio usata dal verifier (check_parola_fscanf con --fscanf) */
+int (*conta_parola)(const char *filename, const char *word) = check_parola;
+
+/* Modalità --words: tutte le parole della lista sono compilate in un unico
+   automa (word_set_t di lib-misc) e ogni file viene letto una sola volta,
+   qualunque sia il numero di parole */
+char **parole = NULL;
+int num_parole = 0;
+word_set_t insieme_parole;
+
+void carica_parole(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t n;
+
+    if(!file) {
+        perror(filename);
+        exit(1);
+    }
+
+    /* una parola per riga, le righe vuote vengono ignorate */
+    while((n = getline(&line, &len, file)) != -1) {
+        while(n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+            line[--n] = '\0';
+        }
+        if(n == 0) {
+            continue;
+        }
+        if((parole = realloc(parole, (num_parole + 1) * sizeof(char *))) == NULL ||
+           (parole[num_parole] = strdup(line)) == NULL) {
+            perror("Errore allocazione parole");
+            exit(1);
+        }
+        num_parole++;
+    }
+    free(line);
+    fclose(file);
+
+    if(num_parole == 0) {
+        fprintf(stderr, "Nessuna parola in %s\n", filename);
+        exit(1);
+    }
+    if(word_set_init(&insieme_parole, (const char *const *)parole, num_parole) < 0) {
+        fprintf(stderr, "Parole non valide in %s (vuote o con spazi?)\n", filename);
+        exit(1);
+    }
+}
+
+/* Conta in counts[w] le occorrenze di ogni parola della lista nel file */
+int check_parole(const char *filename, unsigned long long *counts) {
+    char *data;
+    size_t size;
+
+    memset(counts, 0, num_parole * sizeof(unsigned long long));
+    if(mappa_file(filename, &data, &size) < 0) {
+        return -1;
+    }
+    if(size == 0) {
+        return 0;
+    }
+
+    int ret = word_set_count(&insieme_parole, data, size, counts);
+
+    munmap(data, size);
+    return ret;
+}
+
+/* Modalità --index <file>: invece di leggere i file a ogni esecuzione si
+   mantiene un indice invertito su disco (lib-word-index) che associa a ogni
+   parola i file in cui compare con il numero di occorrenze. La prima volta
+   l'indice viene costruito leggendo i file in parallelo; le volte successive
+   si controllano solo i metadati (dimensione, data di modifica, inode) e si
+   rileggono i soli file nuovi o modificati, poi la risposta viene dalla mappa
+   dell'indice senza aprire gli altri file. Il file dell'indice non deve
+   stare in una delle directory cercate (verrebbe comunque saltato).
+
+   Es. (4000 file da 16 KB, 63 MB, un solo core, indice di 36 MB):
+        ./find_word ciao dir               0.30 s a freddo, 0.11 s a caldo
+        ./find_word --index idx ciao dir   0.59 s (prima costruzione)
+        ./find_word --index idx ciao dir   0.04 s a freddo, 0.016 s a caldo
+        touch dir/f0100.txt; ./find_word --index idx ciao dir
+                                           0.16 s (un file riletto, indice
+                                           riscritto)
+   ("a freddo" dopo `sync; echo 3 | sudo tee /proc/sys/vm/drop_caches`)
+*/
+const char *percorso_indice = NULL;
+
+/* Aggiorna l'indice sulle directory e lo mappa in memoria */
+void apri_indice(word_index_t *indice, char **dirs, int N) {
+    word_index_stats_t stats;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(word_index_update(percorso_indice, (const char *const *)dirs, N,
+                         (threads > 0 ? threads : 1), &stats) < 0 ||
+       word_index_open(indice, percorso_indice) < 0) {
+        perror(percorso_indice);
+        exit(1);
+    }
+    fprintf(stderr, "Indice %s: %u file (%u letti, %u invariati, %u rimossi), "
+            "%llu parole%s\n", percorso_indice, stats.files, stats.scanned,
+            stats.reused, stats.removed, stats.terms,
+            (stats.written ? "" : ", non riscritto"));
+}
+
+/* Manda al consumer un record per ogni file in cui compare la parola (o
+   ciascuna parola della lista), leggendo solo i postings dell'indice. Con
+   --words l'ordine è lo stesso della ricerca senza indice, cioè file per
+   file e, per ogni file, le parole nell'ordine della lista: i postings di
+   ogni parola sono già ordinati per file, quindi basta fonderli scorrendoli
+   in parallelo e prendendo ogni volta il file più piccolo */
+void cerca_con_indice(word_index_t *indice, const char *word, Shared_buffer *proposte_out) {
+    int n_parole = (num_parole > 0 ? num_parole : 1);
+    const word_index_posting_t *postings[n_parole];
+    unsigned int n[n_parole], p[n_parole];
+    Record r;
+
+    for(int w = 0; w < n_parole; ++w) {
+        n[w] = word_index_lookup(indice, (num_parole > 0 ? parole[w] : word), &postings[w]);
+        p[w] = 0;
+    }
+
+    while(true) {
+        /* il file più piccolo tra quelli non ancora consumati */
+        bool trovato = false;
+        uint32_t file = 0;
+        for(int w = 0; w < n_parole; ++w) {
+            if(p[w] < n[w] && (!trovato || postings[w][p[w]].file < file)) {
+                file = postings[w][p[w]].file;
+                trovato = true;
+            }
+        }
+        if(!trovato) {
+            break;
+        }
+
+        const char *path = word_index_path(indice, file);
+        for(int w = 0; w < n_parole; ++w) {
+            if(p[w] < n[w] && postings[w][p[w]].file == file) {
+                if(path) {
+                    strncpy(r.path, path, MAX_PATH);
+                    r.path[MAX_PATH - 1] = '\0';
+                    r.occ = (int)postings[w][p[w]].count;
+                    r.word = w;
+                    buffer_in(proposte_out, r);
+                }
+                p[w]++;
+            }
+        }
+    }
+}
+
 /* --------------------------------------------------------------------------------- */
 
 /*-------------- PRODUCER --------------*/
@@ -159,17 +378,17 @@ void *producer(void *arg) {
     Record r;
     r.occ = 0;
     
-    DIR *dir = opendir(args -> directory);
-    if(!dir) {
+    dir_scan_t scan;
+    if(dir_scan_open(&scan, AT_FDCWD, args -> directory) < 0) {
         perror("Errore apertura directory...\n");
         pthread_exit(NULL);
     }
 
-    while(read_dir(dir, args -> directory, &r)) {
+    while(read_dir(&scan, args -> directory, &r)) {
         buffer_in(args -> proposte, r);
     }
 
-    closedir(dir);
+    dir_scan_close(&scan);
     pthread_exit(NULL);
 }
 
@@ -185,9 +404,34 @@ void *verifier(void *arg) {
     ver_args *args = (ver_args *)arg;
     Record r;
 
+    if(num_parole > 0) {
+        /* un record per ogni parola presente nel file */
+        unsigned long long *counts = malloc(num_parole * sizeof(unsigned long long));
+        if(!counts) {
+            perror("Errore allocazione contatori");
+            pthread_exit(NULL);
+        }
+
+        while(buffer_out(args -> proposte, &r)) {
+            if(check_parole(r.path, counts) < 0) {
+                continue;
+            }
+            for(int w = 0; w < num_parole; ++w) {
+                if(counts[w] > 0) {
+                    r.occ = (int)counts[w];
+                    r.word = w;
+                    buffer_in(args -> proposte_out, r);
+                }
+            }
+        }
+
+        free(counts);
+        pthread_exit(NULL);
+    }
+
     while(buffer_out(args -> proposte, &r)) {
 
-        int occorrenze = check_parola(r.path, args -> word);
+        int occorrenze = conta_parola(r.path, args -> word);
 
         if(occorrenze > 0) {
             r.occ = occorrenze;
@@ -199,13 +443,67 @@ void *verifier(void *arg) {
 }
 
 /*-------------- CONSUMER --------------*/
-// ...
+/* Stampa i risultati mentre arrivano: se li leggesse solo il main dopo la
+   fine del verifier, con più di MAX_SIZE file trovati il verifier
+   resterebbe bloccato su proposte_out piena */
+typedef struct {
+    Shared_buffer *proposte_out;
+    const char *word;
+}cons_args;
+
+void *consumer(void *arg) {
+    cons_args *args = (cons_args *)arg;
+    Record r;
+    int total_files = 0;
+
+    if(num_parole > 0) {
+        printf("--- Risultati per %d parole ---\n", num_parole);
+    } else {
+        printf("--- Risultati per la parola '%s' ---\n", args -> word);
+    }
+
+    while(buffer_out(args -> proposte_out, &r)) {
+        if(num_parole > 0) {
+            printf("File: %s | Parola: %s | Occorrenze: %d\n", r.path, parole[r.word], r.occ);
+        } else {
+            printf("File: %s | Occorrenze: %d\n", r.path, r.occ);
+        }
+        total_files++;
+    }
+
+    if(total_files == 0) {
+        printf("Nessuna occorrenza trovata.\n");
+    }
+
+    pthread_exit(NULL);
+}
 
 
 int main(int argc, char *argv[]) {
 
+    while(argc > 1) {
+        if(strcmp(argv[1], "--fscanf") == 0) {
+            conta_parola = check_parola_fscanf;
+        } else if(argc > 2 && strcmp(argv[1], "--index") == 0) {
+            percorso_indice = argv[2];
+            argv++;
+            argc--;
+        } else if(argc > 2 && strcmp(argv[1], "--words") == 0) {
+            /* la lista prende il posto della parola: <lista> <dir1> ... */
+            carica_parole(argv[2]);
+            argv++;
+            argc--;
+            break;
+        } else {
+            break;
+        }
+        argv++;
+        argc--;
+    }
+
     if(argc < 3) {
-        printf("Uso: <word> <dir1> <dir2> ... <dir-n> ", argv[0]);
+        printf("Uso: [--index <file>] [--fscanf] <word> <dir1> <dir2> ... <dir-n>\n"
+               "     [--index <file>] --words <lista> <dir1> <dir2> ... <dir-n>\n");
         return 1;
     }
 
@@ -218,52 +516,67 @@ int main(int argc, char *argv[]) {
 
     pthread_t thread_producers[N];
     pthread_t thread_verifier;
+    pthread_t thread_consumer;
 
-    prod_args prod_r[N];
+    cons_args cons_r = {
+        .proposte_out = &proposte_out,
+        .word = word_to_search
+    };
 
-    for(int i = 0; i < N; ++i) {
-        prod_r[i].proposte = &proposte;
-        prod_r[i].directory = argv[i + 2];
+    if(percorso_indice) {
+        /* i record arrivano dall'indice invece che da producer e verifier */
+        word_index_t indice;
+
+        apri_indice(&indice, argv + 2, N);
+        pthread_create(&thread_consumer, NULL, consumer, &cons_r);
+        cerca_con_indice(&indice, word_to_search, &proposte_out);
+        buffer_close(&proposte_out);
+        pthread_join(thread_consumer, NULL);
+        word_index_close(&indice);
+    } else {
+        prod_args prod_r[N];
+
+        for(int i = 0; i < N; ++i) {
+            prod_r[i].proposte = &proposte;
+            prod_r[i].directory = argv[i + 2];
         
-        if (pthread_create(&thread_producers[i], NULL, producer, &prod_r[i]) != 0) {
-            perror("Errore creazione thread");
-            return 1;
+            if (pthread_create(&thread_producers[i], NULL, producer, &prod_r[i]) != 0) {
+                perror("Errore creazione thread");
+                return 1;
+            }
         }
-    }
 
-    ver_args ver_r = {
-        .proposte = &proposte, 
-        .proposte_out = &proposte_out, 
-        .word = word_to_search
-    };
+        ver_args ver_r = {
+            .proposte = &proposte, 
+            .proposte_out = &proposte_out, 
+            .word = word_to_search
+        };
 
-    pthread_create(&thread_verifier, NULL, verifier, &ver_r);
+        pthread_create(&thread_verifier, NULL, verifier, &ver_r);
 
-    for(int i = 0; i < N; ++i) {
-        pthread_join(thread_producers[i], NULL);
-    }
+        pthread_create(&thread_consumer, NULL, consumer, &cons_r);
 
-    buffer_close(&proposte);
+        for(int i = 0; i < N; ++i) {
+            pthread_join(thread_producers[i], NULL);
+        }
 
-    pthread_join(thread_verifier, NULL);
+        buffer_close(&proposte);
 
-    buffer_close(&proposte_out);
+        pthread_join(thread_verifier, NULL);
 
-    // printf("Numero di occorenze: %d\n", r.occ);
-    Record r;
-    printf("--- Risultati per la parola '%s' ---\n", word_to_search);
-    int total_files = 0;
+        buffer_close(&proposte_out);
 
-    while(buffer_out(&proposte_out, &r)) {
-        printf("File: %s | Occorrenze: %d\n", r.path, r.occ);
-        total_files++;
-    }
-
-    if(total_files == 0) {
-        printf("Nessuna occorrenza trovata.\n");
+        pthread_join(thread_consumer, NULL);
     }
 
     buffer_destroy(&proposte);
     buffer_destroy(&proposte_out);
+    if(num_parole > 0) {
+        word_set_destroy(&insieme_parole);
+        for(int w = 0; w < num_parole; ++w) {
+            free(parole[w]);
+        }
+        free(parole);
+    }
     return 0;
 }
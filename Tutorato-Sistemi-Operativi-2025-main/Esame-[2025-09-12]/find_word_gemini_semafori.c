@@ -1,4 +1,4 @@
-#define _POSIX_C_SOURCE 200112L
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -10,6 +10,7 @@
 #include <stdbool.h>
 #include <unistd.h>
 #include <ctype.h>
+#include "lib-misc.h" /* word_count_file() */
 
 #define MAX_PATH 1024
 #define MAX_SIZE 10
@@ -133,27 +134,17 @@ bool buffer_out(Shared_buffer *buff, Record *r) {
 
 /* --- Funzioni Ausiliarie --- */
 
+/* Conta le occorrenze di `word` nel file con `word_count_file` di lib-misc
+   (vedi find_word_condition.c).
+   Compilazione:
+        EX=../../operating-systems.2024-2025/lab/examples
+        gcc -O2 -pthread -I$EX find_word_gemini_semafori.c $EX/lib-misc.c -o find_word
+*/
 int check_parola(const char *filename, const char *word) {
-    FILE *file = fopen(filename, "r");
-    if (!file) return -1;
-
-    char buffer[256];
-    int count = 0;
-
-    /* Lettura semplice parola per parola. 
-       Nota: strcasecmp è POSIX. */
-    while (fscanf(file, "%255s", buffer) == 1) {
-        /* Rimuovo eventuale punteggiatura finale grossolanamente se necessario,
-           ma per semplicità usiamo strcasecmp diretto come da standard lab */
-        if (strcasecmp(buffer, word) == 0) {
-            count++;
-        }
-        /* Nota: per una ricerca più robusta "substring" si userebbe strcasestr,
-           ma fscanf legge token separati da spazi. */
-    }
+    long long count = word_count_file(filename, word);
+    if (count < 0) return -1;
 
-    fclose(file);
-    return count;
+    return (int)count;
 }
 
 /* --- Thread Functions --- */
@@ -3,11 +3,25 @@
  * ------------
  * Conta righe e parole in un file usando mmap.
  *
+ * La scansione usa `wc_count` di `lib-misc` (esempi del corso): invece di
+ * un `isspace` con salti condizionali per ogni byte, confronta 16/32 byte
+ * alla volta con istruzioni SSE2/AVX2 (più veloce compilando con -O2, e con
+ * -mavx2 se la CPU lo supporta).
+ *
+ * Con `--threads N` la mappatura è divisa in N porzioni contigue contate in
+ * parallelo; i risultati si sommano, con un'accortezza sulle parole a
+ * cavallo di due porzioni: ogni thread parte con lo stato "dentro una
+ * parola" dato dal byte che precede la propria porzione, così una parola
+ * spezzata è contata solo da chi ne vede l'inizio (risultati identici alla
+ * versione seriale).
+ *
  * Uso:
- *      ./count-mmap <file>
+ *      ./count-mmap [--threads N] <file>
  *
  * Compilazione (GCC):
- *      gcc -Wall -Wextra count-mmap.c -o count-mmap
+ *      EX=../../../operating-systems.2024-2025/lab/examples
+ *      gcc -Wall -Wextra -O2 -pthread -I$EX count-mmap.c $EX/lib-misc.c \
+ *          -o count-mmap
  *---------------------------------------------------------------------------*/
 
 #include <fcntl.h>      /* open(), O_RDONLY, ecc.                         */
@@ -16,7 +30,19 @@
 #include <sys/mman.h>   /* mmap(), munmap(), PROT_READ, MAP_PRIVATE       */
 #include <sys/stat.h>   /* struct stat, fstat()                           */
 #include <unistd.h>     /* close()                                        */
-#include <ctype.h>      /* isspace() per riconoscere spazi bianchi        */
+#include <string.h>     /* strcmp()                                       */
+#include <ctype.h>      /* isspace() sul byte prima di ogni porzione      */
+#include <pthread.h>    /* pthread_create(), pthread_join()               */
+#include <time.h>       /* clock_gettime() per misurare la scansione      */
+#include "lib-misc.h"   /* wc_count() per contare righe e parole          */
+
+/* ========== Porzione assegnata a un thread ============================= */
+typedef struct {
+    pthread_t   tid;
+    const char *data;       /* inizio della mappatura                     */
+    off_t       begin, end; /* porzione [begin, end) da contare           */
+    wc_counts_t counts;     /* risultato parziale                         */
+} chunk_arg_t;
 
 /*-------------------------------------------------------------
  * Gestione errori di sistema (errno)                         */
@@ -34,6 +60,21 @@ static void exit_with_msg(const char *msg)
     exit(EXIT_FAILURE);
 }
 
+/* ========== Conteggio di una porzione ================================== */
+static void *count_chunk(void *arg)
+{
+    chunk_arg_t *chunk = (chunk_arg_t *)arg;
+
+    /* Stato iniziale preso dal byte precedente: se è dentro una parola,
+       l'eventuale parola all'inizio della porzione non è nuova            */
+    chunk->counts.in_word = (chunk->begin > 0 &&
+                             !isspace((unsigned char)chunk->data[chunk->begin - 1]));
+    wc_count(&chunk->counts, chunk->data + chunk->begin,
+             chunk->end - chunk->begin);
+
+    return NULL;
+}
+
 int main(int argc, char *argv[])
 {
     /*---------------------------------------------------------
@@ -41,13 +82,20 @@ int main(int argc, char *argv[])
     int fd;                 /* File descriptor del file sorgente         */
     struct stat sb;         /* Info sul file (dimensione, tipo, …)       */
     char *data;             /* Puntatore ai byte mappati                 */
-    size_t lines = 0;       /* Contatore righe                           */
-    size_t words = 0;       /* Contatore parole                          */
-    int in_word = 0;        /* Stato automa: 0 = fuori, 1 = dentro word  */
+    wc_counts_t counts = {0}; /* Contatori di righe, parole e byte       */
+    int num_threads = 1;    /* Porzioni contate in parallelo             */
+    int err;
+    struct timespec t0, t1;
 
     /* -- 1. Controllo argomenti ----------------------------------------- */
+    if (argc == 4 && strcmp(argv[1], "--threads") == 0) {
+        if ((num_threads = atoi(argv[2])) < 1)
+            exit_with_msg("Invalid number of threads");
+        argv += 2;              /* da qui in poi come senza opzione  */
+        argc -= 2;
+    }
     if (argc != 2)
-        exit_with_msg("Usage: count-mmap <file>");
+        exit_with_msg("Usage: count-mmap [--threads N] <file>");
 
     /* -- 2. Apertura file in sola lettura ------------------------------- */
     if ((fd = open(argv[1], O_RDONLY)) < 0)
@@ -77,32 +125,40 @@ int main(int argc, char *argv[])
         exit_with_error("close");
 
     /* -- 5. Scansione del buffer per contare righe e parole ------------- */
-    for (off_t i = 0; i < sb.st_size; ++i) { // off_t è un tipo di dato per gestire offset nei file
-        char c = data[i];
-
-        /* Conteggio righe ------------------------------------------------ */
-        if (c == '\n')
-            ++lines;
-
-        /* Conteggio parole ---------------------------------------------- */
-        if (isspace((unsigned char)c)) {
-            /* Fine parola se eravamo “dentro”                              */
-            if (in_word) {
-                in_word = 0;
-            }
-        } else {
-            /* Primo carattere non‐spazio ⇒ nuova parola                   */
-            if (!in_word) {
-                in_word = 1;
-                ++words;
-            }
+    /*  Stesso automa "dentro/fuori parola" di prima, ma a blocchi di byte:
+     *  una parola inizia dove un non-spazio segue uno spazio              */
+    chunk_arg_t chunks[num_threads];
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < num_threads; i++) {
+        chunks[i].data = data;
+        chunks[i].begin = sb.st_size * i / num_threads;
+        chunks[i].end = sb.st_size * (i + 1) / num_threads;
+        memset(&chunks[i].counts, 0, sizeof(wc_counts_t));
+        if (num_threads == 1)
+            count_chunk(&chunks[i]);        /* seriale: nessun thread  */
+        else if ((err = pthread_create(&chunks[i].tid, NULL, count_chunk,
+                                       &chunks[i])) != 0) {
+            errno = err;
+            exit_with_error("pthread_create");
+        }
+    }
+    /* Somma dei risultati parziali, in ordine -------------------------- */
+    for (int i = 0; i < num_threads; i++) {
+        if (num_threads > 1 && (err = pthread_join(chunks[i].tid, NULL)) != 0) {
+            errno = err;
+            exit_with_error("pthread_join");
         }
+        counts.lines += chunks[i].counts.lines;
+        counts.words += chunks[i].counts.words;
+        counts.bytes += chunks[i].counts.bytes;
     }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
 
     /* Gestione speciale: se il file non termina con \n, la riga finale
        non è stata contata; la parola finale invece è già inclusa.         */
     if (sb.st_size > 0 && data[sb.st_size - 1] != '\n')
-        ++lines;
+        ++counts.lines;
 
     /* -- 6. Usiamo munmap per liberare la memoria ----------------------- */
     if (munmap(data, sb.st_size) < 0)
@@ -110,8 +166,11 @@ int main(int argc, char *argv[])
 
     /* -- 7. Stampa risultati ------------------------------------------- */
     printf("File: %s\n", argv[1]);
-    printf("Linee : %zu\n", lines);
-    printf("Parole: %zu\n", words);
+    printf("Linee : %llu\n", counts.lines);
+    printf("Parole: %llu\n", counts.words);
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("Thread: %d, scansione in %.3f s (%.2f GB/s)\n", num_threads,
+           elapsed, counts.bytes / elapsed / 1e9);
 
     exit(EXIT_SUCCESS); // Termina il programma con successo
 }
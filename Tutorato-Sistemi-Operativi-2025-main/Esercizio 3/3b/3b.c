@@ -3,11 +3,17 @@
  * -------------
  * Concatena due file in un terzo usando mmap.
  *
+ * Con `--io_uring` i due file sono invece copiati nella destinazione con
+ * `lib-uring` (esempi del corso): più blocchi letti e scritti in volo con
+ * un'unica chiamata di sistema per gruppo, senza mappature; se io_uring non è
+ * disponibile si ripiega su mmap.
+ *
  * Uso:
- *      ./concat-mmap <file1> <file2> <dest>
+ *      ./concat-mmap [--io_uring] <file1> <file2> <dest>
  *
  * Compilazione (GCC):
- *      gcc -Wall -Wextra concat-mmap.c -o concat-mmap
+ *      EX=../../../operating-systems.2024-2025/lab/examples
+ *      gcc -Wall -Wextra -I$EX concat-mmap.c $EX/lib-uring.c -o concat-mmap
  *---------------------------------------------------------------------------*/
 
 #include <fcntl.h>      /* open(), O_RDONLY, O_RDWR, O_CREAT …            */
@@ -16,7 +22,9 @@
 #include <sys/mman.h>   /* mmap(), munmap(), PROT_READ/WRITE, MAP_*        */
 #include <sys/stat.h>   /* struct stat, fstat()                            */
 #include <unistd.h>     /* close(), ftruncate()                            */
-#include <string.h>     /* memcpy()                                        */
+#include <string.h>     /* memcpy(), strcmp()                              */
+#include <errno.h>      /* errno, ENOSYS                                   */
+#include "lib-uring.h"  /* uring_copy_range()                              */
 
 /*-------------------------------------------------------------
  * Gestione errori di sistema (errno)                         */
@@ -37,8 +45,13 @@ static void exit_with_msg(const char *msg)
 int main(int argc, char *argv[])
 {
     /* =========== 1. Controllo argomenti ==================== */
+    int use_uring = (argc == 5 && strcmp(argv[1], "--io_uring") == 0);
+    if (use_uring) {
+        argv++;                 /* da qui in poi come senza opzione  */
+        argc--;
+    }
     if (argc != 4)
-        exit_with_msg("Usage: concat-mmap <file1> <file2> <dest>");
+        exit_with_msg("Usage: concat-mmap [--io_uring] <file1> <file2> <dest>");
 
     /* =========== 2. Apertura file ========================== */
     int fd1  = open(argv[1], O_RDONLY);
@@ -72,6 +85,25 @@ int main(int argc, char *argv[])
     if (ftruncate(fdd, total_len) < 0)
         exit_with_error("ftruncate dest");
 
+    /* =========== 3b. Copia con io_uring (opzionale) ======== */
+    if (use_uring) {
+        /* file1 in [0, len1), file2 in [len1, total_len)        */
+        if (uring_copy_range(fd1, 0, fdd, 0, len1, URING_DEFAULT_DEPTH,
+                             URING_DEFAULT_BLOCK_SIZE, NULL) == 0 &&
+            uring_copy_range(fd2, 0, fdd, len1, len2, URING_DEFAULT_DEPTH,
+                             URING_DEFAULT_BLOCK_SIZE, NULL) == 0) {
+            close(fd1);
+            close(fd2);
+            close(fdd);
+            printf("Concatenazione (io_uring) completata: %s + %s → %s\n",
+                   argv[1], argv[2], argv[3]);
+            return EXIT_SUCCESS;
+        }
+        if (errno != ENOSYS)
+            exit_with_error("io_uring");
+        /* altrimenti si prosegue con mmap                       */
+    }
+
     /* =========== 4. Mappature ============================== */
     char *p1 = mmap(NULL, len1, PROT_READ,
                     MAP_PRIVATE, fd1, 0);
@@ -3,11 +3,31 @@
  * -------------
  * Cerca un carattere in un file usando mmap e stampa tutti gli offset.
  *
+ * La scansione confronta 32 (AVX2) o 16 (SSE2) byte alla volta: il confronto
+ * vettoriale produce una maschera di bit con un 1 per ogni occorrenza e gli
+ * offset si ricavano scorrendo i bit a 1 (`__builtin_ctz`), senza un salto
+ * condizionale per byte; senza SIMD si usa `memchr`. Gli offset non passano
+ * da `printf` ma vengono accumulati in un buffer (OUT_BUFFER_SIZE) scritto
+ * con una `write` ogni volta che si riempie: la memoria resta costante anche
+ * se il carattere compare quasi ovunque.
+ *
+ * Opzioni:
+ *      --count       solo il numero di occorrenze (nessun offset)
+ *      --binary      offset come interi a 64 bit (ordine dei byte della
+ *                    macchina) invece che come testo; il totale va su stderr
+ *      --threads N   il file è diviso in pezzi da PIECE_SIZE byte scanditi
+ *                    N alla volta in parallelo, ognuno nel proprio buffer;
+ *                    i buffer vengono scritti in ordine, quindi gli offset
+ *                    escono comunque crescenti; un pezzo che riempie il
+ *                    buffer si ferma e riprende dopo la scrittura, quindi
+ *                    servono al più N buffer
+ *
  * Uso:
- *      ./search-mmap <file> <carattere>
+ *      ./search-mmap [--count] [--binary] [--threads N] <file> <carattere>
  *
  * Compilazione:
- *      gcc -Wall -Wextra search-mmap.c -o search-mmap
+ *      gcc -Wall -Wextra -O2 -pthread search-mmap.c -o search-mmap
+ *      (aggiungere -mavx2 se la CPU lo supporta)
  *---------------------------------------------------------------------------*/
 
 #include <fcntl.h>      /* open(), O_RDONLY …                              */
@@ -15,12 +35,25 @@
 #include <stdlib.h>     /* exit(), EXIT_FAILURE / SUCCESS                  */
 #include <sys/mman.h>   /* mmap(), munmap(), PROT_READ, MAP_PRIVATE        */
 #include <sys/stat.h>   /* struct stat, fstat()                            */
-#include <unistd.h>     /* close()                                         */
+#include <unistd.h>     /* close(), write()                                */
 #include <ctype.h>      /* isprint() per validazione char                 */
-#include <stdint.h>     /* intmax_t per stampa offset                     */
+#include <stdint.h>     /* intmax_t, uint64_t per gli offset              */
+#include <string.h>     /* memchr(), memcpy(), strcmp()                   */
+#include <errno.h>      /* errno per gli errori delle pthread             */
+#include <pthread.h>    /* pthread_create(), pthread_join()               */
+
+#if defined(__AVX2__)
+#include <immintrin.h>  /* intrinseci AVX2 (compilando con -mavx2)        */
+#elif defined(__SSE2__)
+#include <emmintrin.h>  /* intrinseci SSE2 (sempre presenti su x86-64)    */
+#endif
+
+#define OUT_BUFFER_SIZE (1 << 20)         /* byte di output per write() */
+#define OUT_BUFFER_SLACK 4096             /* output massimo di un blocco */
+#define PIECE_SIZE      (64L * 1024 * 1024) /* pezzo di un thread       */
 
 /* -----------------------------------------------------------
-Helper per errori di sistema (errno)                       
+Helper per errori di sistema (errno)
 */
 static void exit_with_error(const char *msg)
 {
@@ -36,23 +69,179 @@ static void exit_with_msg(const char *msg)
     exit(EXIT_FAILURE);
 }
 
+/* ========== Buffer di output (crescente) =============================== */
+typedef struct {
+    char   *data;
+    size_t  used, size;
+} out_buffer_t;
+
+/* ========== Parametri comuni a tutte le scansioni ====================== */
+typedef struct {
+    const char *data;       /* file mappato                               */
+    char        target;     /* carattere cercato                          */
+    int         count_only; /* --count                                    */
+    int         binary;     /* --binary                                   */
+} search_t;
+
+/* ========== Un pezzo del file e il suo risultato ======================= */
+typedef struct {
+    pthread_t       tid;
+    const search_t *search;
+    off_t           begin, end; /* intervallo [begin, end) da scandire   */
+    int             running;    /* thread da attendere                   */
+    size_t          count;      /* occorrenze trovate                    */
+    out_buffer_t    out;        /* offset già formattati                 */
+} piece_arg_t;
+
+static void out_reserve(out_buffer_t *out, size_t bytes)
+{
+    if (out->used + bytes <= out->size)
+        return;
+    out->size = (out->size == 0 ? OUT_BUFFER_SIZE + OUT_BUFFER_SLACK
+                                : out->size * 2);
+    if (out->size < out->used + bytes)
+        out->size = out->used + bytes;
+    if ((out->data = realloc(out->data, out->size)) == NULL)
+        exit_with_error("realloc");
+}
+
+/* Scrive (e svuota) il buffer sullo standard output ------- */
+static void out_flush(out_buffer_t *out)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < out->used) {
+        if ((n = write(STDOUT_FILENO, out->data + done, out->used - done)) < 0) {
+            if (errno == EINTR)
+                continue;
+            exit_with_error("write");
+        }
+        done += n;
+    }
+    out->used = 0;
+}
+
+/* Aggiunge un offset al buffer, come testo o in binario --- */
+static void out_offset(out_buffer_t *out, const search_t *search, uint64_t offset)
+{
+    if (search->binary) {
+        out_reserve(out, sizeof(uint64_t));
+        memcpy(out->data + out->used, &offset, sizeof(uint64_t));
+        out->used += sizeof(uint64_t);
+        return;
+    }
+
+    /* "Trovato 'c' all'offset N\n" senza printf: le cifre di N
+       vengono generate al contrario in un piccolo array         */
+    static const char prefix[] = "Trovato 'x' all'offset ";
+    char digits[20];
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + offset % 10;
+        offset /= 10;
+    } while (offset > 0);
+
+    out_reserve(out, sizeof(prefix) - 1 + n + 1);
+    memcpy(out->data + out->used, prefix, sizeof(prefix) - 1);
+    out->data[out->used + 9] = search->target;
+    out->used += sizeof(prefix) - 1;
+    while (n > 0)
+        out->data[out->used++] = digits[--n];
+    out->data[out->used++] = '\n';
+}
+
+/* ========== Scansione di [begin, end) ================================== */
+/*  Si ferma quando il buffer di output è pieno lasciando in `begin`
+    il punto da cui riprendere (`end` se il pezzo è finito)          */
+static void *search_piece(void *arg)
+{
+    piece_arg_t *piece = (piece_arg_t *)arg;
+    const search_t *search = piece->search;
+    const char *data = search->data;
+    off_t i = piece->begin;
+    unsigned int mask;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#if defined(__AVX2__)
+    const int width = 32;
+    const __m256i needle = _mm256_set1_epi8(search->target);
+#else
+    const int width = 16;
+    const __m128i needle = _mm_set1_epi8(search->target);
+#endif
+    for (; i + width <= piece->end; i += width) {
+#if defined(__AVX2__)
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+#else
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+#endif
+        if (mask == 0)
+            continue;               /* il caso comune: nessun salto per byte */
+        if (piece->out.used >= OUT_BUFFER_SIZE) {
+            piece->begin = i;       /* buffer pieno: si riprende da qui     */
+            return NULL;
+        }
+        piece->count += __builtin_popcount(mask);
+        if (search->count_only)
+            continue;
+        /* Un offset per ogni bit a 1, dal meno significativo ------- */
+        for (; mask != 0; mask &= mask - 1)
+            out_offset(&piece->out, search, i + __builtin_ctz(mask));
+    }
+#endif
+
+    /* Coda (o tutto, senza SIMD) con memchr -------------------- */
+    const char *p = data + i, *end = data + piece->end;
+    while (p < end && (p = memchr(p, search->target, end - p)) != NULL) {
+        if (piece->out.used >= OUT_BUFFER_SIZE)
+            break;
+        piece->count++;
+        if (!search->count_only)
+            out_offset(&piece->out, search, p - data);
+        p++;
+    }
+    piece->begin = (p == NULL ? piece->end : p - data);
+    (void)mask;
+
+    return NULL;
+}
+
 int main(int argc, char *argv[])
 {
+    search_t search = {0};
+    int num_threads = 1, err, arg = 1;
+
     /* ===== 1. Validazione argomenti ======================= */
-    if (argc != 3)
-        exit_with_msg("Usage: search-mmap <file> <char>");
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--count") == 0)
+            search.count_only = 1;
+        else if (strcmp(argv[arg], "--binary") == 0)
+            search.binary = 1;
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+            if ((num_threads = atoi(argv[++arg])) < 1)
+                exit_with_msg("Invalid number of threads");
+        } else
+            exit_with_msg("Unknown option");
+    }
+    if (argc - arg != 2)
+        exit_with_msg("Usage: search-mmap [--count] [--binary] [--threads N] <file> <char>");
 
-    if (argv[2][1] != '\0')
+    if (argv[arg + 1][0] == '\0' || argv[arg + 1][1] != '\0')
         exit_with_msg("Second argument must be a single character");
 
-    char target = argv[2][0];
+    char target = argv[arg + 1][0];
     if (!isprint((unsigned char)target))
         exit_with_msg("Character must be printable");
+    search.target = target;
 
     /* ===== 2. Apertura file e stat ======================== */
-    int fd = open(argv[1], O_RDONLY);
+    int fd = open(argv[arg], O_RDONLY);
     if (fd < 0)
-        exit_with_error(argv[1]);
+        exit_with_error(argv[arg]);
 
     struct stat sb;
     if (fstat(fd, &sb) < 0)
@@ -68,28 +257,76 @@ int main(int argc, char *argv[])
     char *data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     if (data == MAP_FAILED)
         exit_with_error("mmap");
+    search.data = data;
 
     /* Il file descriptor non serve più una volta mappato     */
     if (close(fd) < 0)
         exit_with_error("close");
 
     /* ===== 4. Scansione e stampa offset =================== */
+    /*  A ogni giro `num_threads` pezzi consecutivi vengono
+        scanditi in parallelo; poi i loro buffer sono scritti
+        nell'ordine dei pezzi: l'output resta ordinato. Un
+        pezzo si ferma quando il suo buffer è pieno, quindi si
+        scrive fino al primo pezzo non finito (compreso) e si
+        rilanciano i pezzi non finiti che hanno ancora spazio:
+        la memoria usata è al più un buffer per thread         */
+    piece_arg_t pieces[num_threads];
     size_t count = 0;
-    for (off_t i = 0; i < sb.st_size; ++i) {
-        if (data[i] == target) { 
-            /* 
-             * Ovviamente per trovare caratteri che siano sia maiuscoli
-             * che minuscoli dobbiamo utilizzare nell'if la seguente
-             * tolower(data[i]) == tolower(target);
-             * oppure strcasecmp() se vogliamo ignorare il case
-             * strcasecmp(data[i], target) == 0
-             */
-            printf("Trovato '%c' all'offset %jd\n", target, (intmax_t)i);
-            ++count;
+    memset(pieces, 0, sizeof(pieces));
+
+    for (off_t round = 0; round < sb.st_size;
+         round += (off_t)num_threads * PIECE_SIZE) {
+        int used = 0, flushed = 0;
+        for (int t = 0; t < num_threads; t++) {
+            off_t begin = round + (off_t)t * PIECE_SIZE;
+            if (begin >= sb.st_size)
+                break;
+            pieces[t].search = &search;
+            pieces[t].begin = begin;
+            pieces[t].end = (sb.st_size - begin < PIECE_SIZE ? sb.st_size
+                                                             : begin + PIECE_SIZE);
+            pieces[t].count = 0;
+            used++;
+        }
+        while (flushed < used) {
+            for (int t = flushed; t < used; t++) {
+                if (pieces[t].begin == pieces[t].end ||
+                    pieces[t].out.used >= OUT_BUFFER_SIZE)
+                    continue;               /* finito o in attesa di scrittura */
+                if (num_threads == 1)
+                    search_piece(&pieces[t]);   /* seriale: nessun thread */
+                else if ((err = pthread_create(&pieces[t].tid, NULL, search_piece,
+                                               &pieces[t])) != 0) {
+                    errno = err;
+                    exit_with_error("pthread_create");
+                } else
+                    pieces[t].running = 1;
+            }
+            for (int t = flushed; t < used; t++) {
+                if (pieces[t].running && (err = pthread_join(pieces[t].tid, NULL)) != 0) {
+                    errno = err;
+                    exit_with_error("pthread_join");
+                }
+                pieces[t].running = 0;
+            }
+            /* In ordine: i pezzi finiti e poi quanto ha prodotto il
+               primo non finito (il suo seguito viene dopo)          */
+            for (; flushed < used; flushed++) {
+                out_flush(&pieces[flushed].out);
+                if (pieces[flushed].begin < pieces[flushed].end)
+                    break;
+                count += pieces[flushed].count;
+            }
         }
     }
+    for (int t = 0; t < num_threads; t++)
+        free(pieces[t].out.data);
 
-    printf("Occorrenze totali di '%c': %zu\n", target, count);
+    if (search.binary)
+        fprintf(stderr, "Occorrenze totali di '%c': %zu\n", target, count);
+    else
+        printf("Occorrenze totali di '%c': %zu\n", target, count);
 
     /* ===== 5. Cleanup ===================================== */
     if (munmap(data, sb.st_size) < 0)
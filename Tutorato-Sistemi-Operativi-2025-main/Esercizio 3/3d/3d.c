@@ -1,15 +1,33 @@
 /*---------------------------------------------------------------------------
  * mmap-reverse-parallel.c
  * -----------------------
- * Inverte un file in-place con mmap + pthreads. Ogni thread elabora una
- * porzione distinta della prima metà del file.
+ * Inverte un file in-place con mmap + pthreads. La prima metà del file è
+ * distribuita tra i thread dal pool con work stealing di `lib-work-stealing`
+ * (esempi del corso): invece di una porzione fissa per thread, i pezzi
+ * vengono spezzati su richiesta e rubati da chi resta senza lavoro, quindi un
+ * thread rallentato (es. da page fault) non ritarda più tutti gli altri.
+ *
+ * Il lavoro è diviso in blocchi da REVERSE_BLOCK byte allineati alla pagina
+ * all'inizio del file, ognuno accoppiato al blocco speculare alla fine: un
+ * thread tocca così solo due zone compatte (invece di saltare tra pagine
+ * lontane un byte alla volta) e le inverte con `reverse_swap` di `lib-misc`,
+ * 16/32 byte alla volta nei registri SSE2/AVX2.
+ *
+ * NB: i blocchi speculari alla fine sono allineati alla pagina solo se la
+ * dimensione del file è un multiplo di REVERSE_BLOCK: il byte `i` va scambiato
+ * con il byte `N-1-i`, quindi i confini `k*REVERSE_BLOCK` davanti diventano
+ * `N - k*REVERSE_BLOCK` dietro e non si possono allineare entrambi (servirebbe
+ * un buffer e un blocco dietro dipenderebbe da due pezzi diversi); due pezzi
+ * vicini condividono così al più la pagina del loro confine posteriore.
  *
  * Uso:
  *      ./mmap-reverse-parallel <file> <num_thread>
- *                (num_thread opzionale, default = numero logico CPU)
+ *                (num_thread opzionale, default = 4)
  *
  * Compilazione:
- *      gcc -Wall -Wextra -pthread mmap-reverse-parallel.c -o mmap-reverse-parallel
+ *      EX=../../../operating-systems.2024-2025/lab/examples
+ *      gcc -Wall -Wextra -O2 -pthread -I$EX mmap-reverse-parallel.c \
+ *          $EX/lib-work-stealing.c $EX/lib-misc.c -o mmap-reverse-parallel
  *---------------------------------------------------------------------------*/
 
 #include <fcntl.h>          /* open(), O_RDWR …                            */
@@ -20,6 +38,9 @@
 #include <unistd.h>         /* close(), sysconf()                          */
 #include <stdint.h>         /* intmax_t                                    */
 #include <pthread.h>        /* pthread_*                                   */
+#include "lib-work-stealing.h" /* ws_pool_t, ws_parallel_for()            */
+
+#define REVERSE_BLOCK (64 * 1024)  /* byte per coppia di blocchi (pagine)  */
 
 /* ========== Helper errori ============================================== */
 static void exit_with_error(const char *msg)
@@ -33,27 +54,27 @@ static void exit_with_msg(const char *msg)
     exit(EXIT_FAILURE);
 }
 
-/* ========== Struttura argomenti thread ================================= */
+/* ========== Dati condivisi da tutti i pezzi ============================ */
 typedef struct {
     char   *data;       /* puntatore mmap condiviso                        */
-    off_t   start;      /* indice iniziale (incluso)                       */
-    off_t   end;        /* indice finale   (escluso)                       */
     off_t   file_size;  /* dimensione totale file                          */
-} thread_arg_t;
+} reverse_arg_t;
 
-/* ========== Routine di inversione per ogni thread ====================== */
-static void *reverse_chunk(void *arg_void)
+/* ========== Inversione dei blocchi [start, end) della prima metà ======= */
+static void reverse_chunk(long start, long end, void *arg_void)
 {
-    thread_arg_t *arg = (thread_arg_t *)arg_void;
+    reverse_arg_t *arg = (reverse_arg_t *)arg_void;
     char *p   = arg->data;
     off_t N   = arg->file_size;
-
-    for (off_t i = arg->start; i < arg->end; ++i) {
-        char tmp            = p[i];
-        p[i]                = p[N - i - 1];
-        p[N - i - 1]        = tmp;
+    off_t half = N / 2;
+
+    for (long b = start; b < end; ++b) {
+        off_t from = (off_t)b * REVERSE_BLOCK;         /* allineato     */
+        off_t to   = (from + REVERSE_BLOCK < half) ? from + REVERSE_BLOCK
+                                                   : half;
+        /* p[from..to) <-> p[N-to..N-from) letto dalla fine           */
+        reverse_swap(p + from, p + N - to, to - from);
     }
-    return NULL;
 }
 
 /* =================== main ============================================= */
@@ -98,47 +119,19 @@ int main(int argc, char *argv[])
 
     close(fd); /* fd non più necessario dopo mmap                         */
 
-    /* --- 4. Preparazione thread --------------------------------------- */
+    /* --- 4. Pool di thread con work stealing ------------------------- */
     off_t half      = size / 2;                /* lavoriamo solo metà     */
-    off_t chunk_len = half / num_thr;          /* divisione equa          */
-    off_t remainder = half % num_thr;          /* byte residui            */
-
-    /* Allocazione dinamica degli array per gli ID dei thread e gli argomenti */
-    pthread_t *tid = calloc(num_thr, sizeof *tid);  /* Array per memorizzare gli ID dei thread */
-    thread_arg_t *targ = calloc(num_thr, sizeof *targ); /* Array per memorizzare gli argomenti dei thread */
-    
-    /* Verifica che l'allocazione sia andata a buon fine */
-    if (!tid || !targ)
-        exit_with_msg("calloc");  /* Termina il programma se calloc fallisce */
-    /*Allocates a zero-initialised block big enough for num_thr elements, each the size of one pthread_t object.
-    Using sizeof *tid (instead of sizeof(pthread_t)) is an idiom that automatically picks up the correct type even if the variable’s type changes later.*/
-    
-    off_t cursor = 0;
-    for (int t = 0; t < num_thr; ++t) {
-        off_t extra = (t < remainder) ? 1 : 0; /* distribuiamo residui    */
-        /*
-        Se l’indice del thread t è più piccolo di remainder, quel thread riceve 1 byte in più (extra = 1). 
-        I primi remainder thread risultano quindi leggermente più “grandi”.
-        */
-        targ[t].data      = data;
-        targ[t].start     = cursor;
-        targ[t].end       = cursor + chunk_len + extra;
-        targ[t].file_size = size;
-
-        if (pthread_create(&tid[t], NULL, reverse_chunk, &targ[t]) != 0)
-            exit_with_error("pthread_create");
-
-        cursor = targ[t].end;
-    }
+    reverse_arg_t rarg = { .data = data, .file_size = size };
+    ws_pool_t pool;
+
+    ws_pool_init(&pool, (unsigned)num_thr);    /* main = lavoratore 0     */
 
-    /* --- 5. Join dei thread ------------------------------------------ */
-    for (long t = 0; t < num_thr; ++t)
-        if (pthread_join(tid[t], NULL) != 0)
-            exit_with_error("pthread_join");
+    /* --- 5. Inversione: ritorna quando tutti i pezzi sono stati fatti - */
+    long blocks = (half + REVERSE_BLOCK - 1) / REVERSE_BLOCK;
+    ws_parallel_for(&pool, 0, blocks, 1, reverse_chunk, &rarg);
 
     /* --- 6. Cleanup --------------------------------------------------- */
-    free(tid);
-    free(targ);
+    ws_pool_destroy(&pool);
 
     if (munmap(data, size) < 0)
         exit_with_error("munmap");
@@ -9,8 +9,15 @@
  * Produce una riga del tipo:
  *      N=100000000  T=8  sum_time=0.142 s  speedup=5.9
  *
+ * La somma parallela non divide più il vettore in T fette statiche (una per
+ * thread): usa il pool con work stealing di `lib-work-stealing` degli esempi
+ * del corso, così se un core è lento (o disturbato da altri processi) i
+ * pezzi che gli restano vengono "rubati" dai thread già liberi.
+ *
  * Compilazione:
- *      gcc -O2 -std=gnu11 -pthread vecsum.c -o vecsum
+ *      EX=../../../operating-systems.2024-2025/lab/examples
+ *      gcc -O2 -std=gnu11 -pthread -I$EX 4a.c $EX/lib-work-stealing.c \
+ *          $EX/lib-misc.c -o vecsum
  */
 #define _GNU_SOURCE
 /*
@@ -18,37 +25,30 @@
 È una feature che sblocca funzioni e costrutti che non fanno parte dello standard POSIX o ISO C, 
 ma che sono comunque molto utili e comunemente usati su sistemi Linux.
 */
+#include "lib-work-stealing.h"  /* ws_pool_t, ws_parallel_for()    */
+#include "lib-misc.h"           /* seconds_now()                  */
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <time.h>
 
 typedef struct {
-    size_t  start;          /* indice iniziale (incluso)   */
-    size_t  end;            /* indice finale   (escluso)    */
     const double *A;
     const double *B;
     double *C;
-} slice_t;
+} vectors_t;                /* gli indici arrivano da ws_parallel_for */
 
 /* ---------- utilità tempo ---------- */
-static double seconds_now(void)
-{
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return ts.tv_sec + ts.tv_nsec * 1e-9; //serve a convertire il valore del tempo da struct timespec in un singolo double che rappresenta il numero totale di secondi trascorsi.
-}
-//La costante CLOCK_MONOTONIC è una funzionalità POSIX, 
-// ma in alcune implementazioni (specie più vecchie o non standard), 
-//l'uso di clock_gettime() richiede #define _GNU_SOURCE prima di qualunque #include.
-/* ---------- thread worker ---------- */
-static void *worker(void *arg)
+/* seconds_now() (orologio monotono) viene da lib-misc degli esempi */
+
+/* ---------- pezzo di lavoro ---------- */
+/* Somma gli elementi [begin, end): viene chiamata dal pool su pezzi via via
+ * più piccoli, da qualunque thread li abbia presi (o rubati). */
+static void sum_range(long begin, long end, void *arg)
 {
-    slice_t *s = (slice_t *)arg;
-    for (size_t i = s->start; i < s->end; ++i)
-        s->C[i] = s->A[i] + s->B[i];
-    return NULL;
+    vectors_t *v = (vectors_t *)arg;
+    for (long i = begin; i < end; ++i)
+        v->C[i] = v->A[i] + v->B[i];
 }
 
 /* ---------- main ---------- */
@@ -98,27 +98,21 @@ int main(int argc, char *argv[])
         for (size_t i = 0; i < N; ++i)
             C[i] = A[i] + B[i];
     } else {
-        pthread_t *tid  = malloc(T * sizeof *tid);
-        slice_t   *job  = malloc(T * sizeof *job);
-        size_t base = N / (size_t)T;
-        size_t rest = N % (size_t)T;
+        ws_pool_t pool;
+        vectors_t vec = { .A = A, .B = B, .C = C };
+
+        /* il main è il "lavoratore 0": il pool crea gli altri T-1 thread */
+        ws_pool_init(&pool, (unsigned)T);
 
         double tp0 = seconds_now();
 
-        size_t offset = 0;
-        for (int i = 0; i < T; ++i) {
-            size_t step = base + (i < (int)rest);   /* distribuisce il resto */
-            job[i] = (slice_t){ .start = offset,
-                                .end   = offset + step,
-                                .A = A, .B = B, .C = C };
-            offset += step;
-            pthread_create(&tid[i], NULL, worker, &job[i]);
-        }
-        for (int i = 0; i < T; ++i)
-            pthread_join(tid[i], NULL);
+        /* grain = 0: dimensione minima dei pezzi scelta dalla libreria */
+        ws_parallel_for(&pool, 0, (long)N, 0, sum_range, &vec);
 
         double t_par = seconds_now() - tp0;
 
+        ws_pool_destroy(&pool);
+
         /* ---- verifica veloce di correttezza ---- */
         for (size_t i = 0; i < N; ++i)
             if (C[i] != Cseq[i]) {
@@ -130,9 +124,6 @@ int main(int argc, char *argv[])
         double speedup = (T == 1) ? 1.0 : t_seq / t_par;
         printf("N=%zu  T=%d t_seq=%.3f s t_par=%.3f s speedup=%.2f\n",
                N, T, t_seq, t_par, speedup);
-
-        free(tid);
-        free(job);
     }
 
     // (facoltativo) stampa tempi di allocazione/sequenziale
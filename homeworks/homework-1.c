@@ -8,27 +8,61 @@
      $ homework-1 file1.txt path/file2.txt "nome con spazi.pdf" directory-destinazione
 */
 
+/*
+    Estensione: i dati non passano piu' da un buffer utente ma sono copiati con
+    il motore di 'lib-copy' degli esempi del corso (copy_file_range ->
+    sendfile -> splice -> read/write con buffer grande), scelto
+    automaticamente per ogni coppia sorgente/destinazione o forzato con:
+     $ homework-1 --method <auto|copy_file_range|sendfile|splice|io_uring|read-write> file... directory
+
+    La copia e' "sparsa": si copiano solo le estensioni di dati delle sorgenti
+    (i buchi restano tali, senza scrivere gigabyte di zeri); con --punch-zeros
+    diventano buchi anche i blocchi nulli delle sorgenti dense:
+     $ homework-1 [--method <metodo>] [--punch-zeros] file... directory
+
+    Compilazione:
+     $ EX=../operating-systems.2024-2025/lab/examples
+     $ gcc -I$EX homework-1.c $EX/lib-copy.c $EX/lib-uring.c -o homework-1
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
+#include "lib-copy.h"
 
 #define BUFSIZE 4096
 #define MODE 0660
 
 int main(int argc, char *argv[]) {
-    int sd, dd, size, i;
+    int sd, dd, size, i, first = 1;
     char buffer[BUFSIZE];
     char *p1, *p2;
+    int method = COPY_METHOD_AUTO, punch_zeros = 0;
+    copy_stats_t stats;
+
+    // opzioni: metodo di copia e rilevamento dei blocchi nulli
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--method") == 0 && first + 1 < argc) {
+            if ((method = copy_method_from_name(argv[++first])) == -1) {
+                fprintf(stderr, "metodo di copia '%s' non valido!\n", argv[first]);
+                exit(1);
+            }
+        } else if (strcmp(argv[first], "--punch-zeros") == 0)
+            punch_zeros = 1;
+        else
+            break;
+        first++;
+    }
 
     // controlla di avere almeno 2 parametri effettivi
-    if (argc < 3) {
-        printf("utilizzo: %s [<sorgente>...] <directory destinazione>\n", argv[0]);
+    if (argc - first < 2) {
+        printf("utilizzo: %s [--method <metodo>] [--punch-zeros] [<sorgente>...] <directory destinazione>\n", argv[0]);
         exit(1);
     }
 
-    for (i = 1; i < argc-1; i++) {
+    for (i = first; i < argc-1; i++) {
         // apre il file sorgente di turno in sola lettura
         printf("%s\t--> ", argv[i]);
         if ((sd = open(argv[i], O_RDONLY)) == -1) {
@@ -60,18 +94,10 @@ int main(int argc, char *argv[]) {
         }
 
         // copia i dati dalla sorgente alla destinazione
-        do {
-            // legge fino ad un massimo di BUFSIZE byte dalla sorgente
-            if ((size = read(sd, buffer, BUFSIZE)) == -1) {
-                perror(argv[1]);
-                exit(1);
-            }
-            // scrive i byte letti
-            if (write(dd, buffer, size) == -1) {
-                perror(argv[2]);
-                exit(1);
-            }
-        } while (size == BUFSIZE);
+        if (copy_fd_sparse(sd, dd, method, punch_zeros, &stats) == -1) {
+            perror(argv[i]);
+            exit(1);
+        }
 
         // chiude i file attualmente aperti
         close(sd);
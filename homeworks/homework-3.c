@@ -30,15 +30,63 @@
         ffd7e3b3836978b43da5378055843c67
 */
 
+/*
+    Estensione: ordinamento esterno per file piu' grandi della RAM
+
+     $ homework-3 [--memory-limit <MiB>] [--threads <T>] <N> <pathname del file>
+
+    Con una delle due opzioni il file non viene mappato ma ordinato in due fasi:
+    1. il file e' diviso in sequenze ("run") che stanno nel limite di memoria
+       (diviso tra i T thread); ogni thread legge una sequenza con una sola
+       grande 'pread', ordina un vettore compatto di coppie (prefisso di 8 byte
+       della chiave in big-endian, puntatore al record) senza spostare i record
+       (il 'memcmp' sul resto del record serve solo a parita' di prefisso) e la
+       scrive in ordine in un unico file temporaneo (gia' cancellato con
+       'unlink'), nella stessa posizione che aveva nel file;
+    2. le sequenze sono fuse a gruppi di al piu' k (heap sui record in testa)
+       leggendo e scrivendo a blocchi grandi e sequenziali, dove k e' scelto in
+       modo che ognuno dei k+1 buffer abbia almeno MERGE_MIN_BUFFER byte (e
+       almeno un record); se le sequenze sono piu' di k servono piu' passate,
+       alternando due file temporanei, e solo l'ultima scrive sul file.
+    Se il file sta tutto in una sequenza viene riscritto direttamente.
+    Tutte le sequenze di una passata stanno nello stesso file, quindi i file
+    aperti sono al piu' tre qualunque sia il loro numero.
+
+     $ homework-3 --indirect <N> <pathname del file>
+
+    Ordinamento indiretto in memoria (sul file mappato, quindi non combinabile
+    con '--memory-limit' e '--threads'): si ordina il vettore
+    delle coppie (prefisso, record) con un radix sort sui prefissi, usando
+    'memcmp' solo per i gruppi di record con lo stesso prefisso, e poi si
+    permutano i record sul posto seguendo i cicli della permutazione: ogni
+    record viene spostato una sola volta (piu' un appoggio per ciclo) invece
+    dei tre 'memcpy' per scambio del quicksort. Lo stesso ordinamento delle
+    coppie e' usato per le sequenze dell'ordinamento esterno.
+
+    Per una prova su qualche GB (record da 100 byte):
+     $ head -c 4000000000 /dev/urandom > grande.dat
+     $ time homework-3 --memory-limit 512 --threads 4 100 grande.dat
+
+    Compilazione: gcc homework-3.c -o homework-3 -lpthread
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#define DEFAULT_MEMORY_LIMIT 256    // MiB usati dall'ordinamento esterno
+#define IO_BUFFER_SIZE (1 << 20)    // blocco minimo delle scritture sequenziali
+#define MERGE_MIN_BUFFER (64 << 10) // buffer minimo per sequenza nella fusione
+#define MERGE_MAX_FAN_IN 1024       // sequenze fuse al massimo in una volta
+
 char *swap_buffer;  // riferimento ad buffer di scambio globale
 
 /* trova il pivot in map[i]...map[j] restituendone una copia (allocando la memoria);
@@ -89,19 +137,498 @@ void quicksort(char *map, int p, int r, int size) {
     if (pivot) free(pivot);
 }
 
+/* ---------------- ordinamento esterno ---------------- */
+
+int record_size;    // dimensione dei record (per il confronto delle chiavi)
+
+typedef struct {
+    uint64_t prefix;    // primi 8 byte del record in big-endian (0 se mancanti)
+    char *record;       // record nel buffer della sequenza
+} key_entry_t;
+
+typedef struct {
+    int fd;                 // file da ordinare
+    const char *pathname;
+    long num_records;
+    long records_per_run;
+    long out_records;       // record per scrittura sequenziale
+    long num_runs;
+    long next_run;          // prossima sequenza da ordinare (protetta da 'lock')
+    int run_fd;             // file temporaneo con tutte le sequenze ordinate
+    pthread_mutex_t lock;
+} external_sort_t;
+
+typedef struct {
+    int fd;
+    char *buffer;
+    long buffer_size;       // multiplo della dimensione dei record
+    long position, length;  // record corrente e byte validi nel buffer
+    off_t offset, remaining;
+} run_reader_t;
+
+// (gli homework si compilano da soli, senza la libreria degli esempi)
+double seconds_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec * 1e-9);
+}
+
+// legge/scrive esattamente 'count' byte a partire da 'offset'
+void read_fully(int fd, char *buffer, size_t count, off_t offset) {
+    ssize_t n;
+
+    while (count > 0) {
+        if ((n = pread(fd, buffer, count, offset)) <= 0) {
+            if (n == 0)
+                fprintf(stderr, "file troncato durante l'ordinamento!\n");
+            else
+                perror("pread");
+            exit(1);
+        }
+        buffer += n;
+        count -= n;
+        offset += n;
+    }
+}
+
+void write_fully(int fd, const char *buffer, size_t count, off_t offset) {
+    ssize_t n;
+
+    while (count > 0) {
+        if ((n = pwrite(fd, buffer, count, offset)) == -1) {
+            perror("pwrite");
+            exit(1);
+        }
+        buffer += n;
+        count -= n;
+        offset += n;
+    }
+}
+
+uint64_t key_prefix(const char *record) {
+    uint64_t prefix = 0;
+    int k;
+
+    for (k = 0; k < 8; k++)
+        prefix = (prefix << 8) | (k < record_size ? (unsigned char)record[k] : 0);
+    return(prefix);
+}
+
+/* radix sort LSD delle coppie sul prefisso (8 cifre da 8 bit, saltando quelle
+   uguali per tutti), poi 'memcmp' solo dentro i gruppi con prefisso uguale;
+   'tmp' deve avere spazio per 'count' coppie */
+int compare_entries(const void *a, const void *b);
+
+void sort_key_entries(key_entry_t *entries, long count, key_entry_t *tmp) {
+    long histograms[8][256], offset, c, i, j;
+    key_entry_t *src = entries, *dst = tmp, *swap;
+    int d, b, shift;
+
+    if (count < 2)
+        return;
+
+    memset(histograms, 0, sizeof(histograms));
+    for (i = 0; i < count; i++)
+        for (d = 0; d < 8; d++)
+            histograms[d][(entries[i].prefix >> (8 * d)) & 0xff]++;
+
+    for (d = 0; d < 8; d++) {
+        shift = 8 * d;
+        if (histograms[d][(src[0].prefix >> shift) & 0xff] == count)
+            continue;   // cifra uguale per tutti
+        for (offset = 0, b = 0; b < 256; b++) {
+            c = histograms[d][b];
+            histograms[d][b] = offset;
+            offset += c;
+        }
+        for (i = 0; i < count; i++)
+            dst[histograms[d][(src[i].prefix >> shift) & 0xff]++] = src[i];
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != entries)
+        memcpy(entries, src, count * sizeof(key_entry_t));
+
+    // parita' di prefisso: serve confrontare il resto dei record
+    if (record_size > 8)
+        for (i = 0; i < count; i = j) {
+            for (j = i + 1; j < count && entries[j].prefix == entries[i].prefix; j++)
+                ;
+            if (j - i > 1)
+                qsort(entries + i, j - i, sizeof(key_entry_t), compare_entries);
+        }
+}
+
+int compare_entries(const void *a, const void *b) {
+    const key_entry_t *x = a, *y = b;
+
+    if (x->prefix != y->prefix)
+        return(x->prefix < y->prefix ? -1 : 1);
+    if (record_size <= 8)
+        return(0);
+    return(memcmp(x->record + 8, y->record + 8, record_size - 8));
+}
+
+// crea un file temporaneo accanto a quello da ordinare (stesso file system)
+int create_run_file(const char *pathname) {
+    char template[strlen(pathname) + 16];
+    int fd;
+
+    sprintf(template, "%s.run-XXXXXX", pathname);
+    if ((fd = mkstemp(template)) == -1) {
+        perror("mkstemp");
+        exit(1);
+    }
+    // il file sparira' da solo alla chiusura
+    if (unlink(template) == -1) {
+        perror("unlink");
+        exit(1);
+    }
+    return(fd);
+}
+
+// fase 1: ogni thread ordina sequenze finche' ce ne sono
+void *sort_runs(void *arg) {
+    external_sort_t *es = arg;
+    long run, first, count, i, out_records, out_count;
+    off_t out_offset;
+    char *buffer, *output;
+    key_entry_t *entries, *tmp;
+    int out_fd;
+
+    out_records = es->out_records;
+    buffer = malloc(es->records_per_run * record_size);
+    entries = malloc(es->records_per_run * sizeof(key_entry_t));
+    tmp = malloc(es->records_per_run * sizeof(key_entry_t));
+    output = malloc(out_records * record_size);
+    if (!buffer || !entries || !tmp || !output) {
+        perror("malloc");
+        exit(1);
+    }
+
+    while (1) {
+        pthread_mutex_lock(&es->lock);
+        run = es->next_run++;
+        pthread_mutex_unlock(&es->lock);
+        if (run >= es->num_runs)
+            break;
+
+        first = run * es->records_per_run;
+        count = es->num_records - first;
+        if (count > es->records_per_run)
+            count = es->records_per_run;
+        read_fully(es->fd, buffer, count * record_size, (off_t)first * record_size);
+
+        // si ordinano solo le coppie (prefisso, puntatore): i record restano fermi
+        for (i = 0; i < count; i++) {
+            entries[i].record = buffer + i * record_size;
+            entries[i].prefix = key_prefix(entries[i].record);
+        }
+        sort_key_entries(entries, count, tmp);
+
+        // con una sola sequenza si riscrive direttamente il file originale
+        out_fd = (es->num_runs == 1 ? es->fd : es->run_fd);
+        out_offset = (off_t)first * record_size;
+        out_count = 0;
+        for (i = 0; i < count; i++) {
+            memcpy(output + out_count * record_size, entries[i].record, record_size);
+            if (++out_count == out_records || i == count - 1) {
+                write_fully(out_fd, output, out_count * record_size, out_offset);
+                out_offset += out_count * record_size;
+                out_count = 0;
+            }
+        }
+    }
+
+    free(buffer);
+    free(entries);
+    free(tmp);
+    free(output);
+    return(NULL);
+}
+
+void refill_reader(run_reader_t *reader) {
+    long n = (reader->remaining < reader->buffer_size ? reader->remaining : reader->buffer_size);
+
+    read_fully(reader->fd, reader->buffer, n, reader->offset);
+    reader->offset += n;
+    reader->remaining -= n;
+    reader->length = n;
+    reader->position = 0;
+}
+
+// vero se la testa della sequenza 'a' precede quella di 'b'
+int reader_less(run_reader_t *readers, int a, int b) {
+    int cmp = memcmp(readers[a].buffer + readers[a].position,
+                     readers[b].buffer + readers[b].position, record_size);
+
+    return(cmp < 0 || (cmp == 0 && a < b));
+}
+
+void sift_down(int *heap, int heap_size, int i, run_reader_t *readers) {
+    int child, tmp;
+
+    while ((child = 2 * i + 1) < heap_size) {
+        if (child + 1 < heap_size && reader_less(readers, heap[child + 1], heap[child]))
+            child++;
+        if (!reader_less(readers, heap[child], heap[i]))
+            break;
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+/* fonde le 'k' sequenze consecutive da 'run_records' record (l'ultima puo'
+   essere piu' corta) che iniziano al record 'first' di 'in_fd' in una sola
+   sequenza nella stessa posizione di 'out_fd' */
+void merge_group(int in_fd, int out_fd, long first, long run_records, int k,
+                 long num_records, long buffer_size, char *output) {
+    int heap[k], heap_size = 0, i, top;
+    run_reader_t readers[k];
+    long out_length = 0, run_length;
+    off_t out_offset = (off_t)first * record_size;
+
+    for (i = 0; i < k; i++) {
+        run_length = num_records - (first + i * run_records);
+        if (run_length > run_records)
+            run_length = run_records;
+        readers[i].fd = in_fd;
+        readers[i].buffer_size = buffer_size;
+        readers[i].offset = (off_t)(first + i * run_records) * record_size;
+        readers[i].remaining = (off_t)run_length * record_size;
+        if ((readers[i].buffer = malloc(buffer_size)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        refill_reader(&readers[i]);
+        heap[heap_size++] = i;
+    }
+    for (i = heap_size / 2 - 1; i >= 0; i--)
+        sift_down(heap, heap_size, i, readers);
+
+    while (heap_size > 0) {
+        top = heap[0];
+        memcpy(output + out_length, readers[top].buffer + readers[top].position, record_size);
+        out_length += record_size;
+        if (out_length == buffer_size) {
+            write_fully(out_fd, output, out_length, out_offset);
+            out_offset += out_length;
+            out_length = 0;
+        }
+
+        // avanza nella sequenza (ricaricando il buffer) o la toglie dall'heap
+        readers[top].position += record_size;
+        if (readers[top].position == readers[top].length) {
+            if (readers[top].remaining > 0)
+                refill_reader(&readers[top]);
+            else
+                heap[0] = heap[--heap_size];
+        }
+        sift_down(heap, heap_size, 0, readers);
+    }
+    write_fully(out_fd, output, out_length, out_offset);
+
+    for (i = 0; i < k; i++)
+        free(readers[i].buffer);
+}
+
+/* numero massimo di sequenze fuse insieme: ognuno dei k+1 buffer (k di
+   lettura e uno di scrittura) deve avere almeno MERGE_MIN_BUFFER byte e
+   almeno un record */
+int merge_fan_in(long memory_limit) {
+    long min_buffer = (record_size > MERGE_MIN_BUFFER ? record_size : MERGE_MIN_BUFFER);
+    long k = memory_limit / min_buffer - 1;
+
+    if (k > MERGE_MAX_FAN_IN)
+        k = MERGE_MAX_FAN_IN;
+    return(k < 2 ? 2 : (int)k);
+}
+
+// fase 2: fusione a passate delle sequenze fino a una sola nel file originale
+void merge_runs(external_sort_t *es, long memory_limit) {
+    int fan_in = merge_fan_in(memory_limit), k, pass = 0, out_fd, src = 0;
+    int run_fds[2] = {es->run_fd, -1};  // i due temporanei si scambiano i ruoli
+    long run_records = es->records_per_run, num_runs = es->num_runs;
+    long first, left, buffer_size;
+    double start, elapsed;
+    char *output;
+
+    while (num_runs > 1) {
+        k = (num_runs < fan_in ? num_runs : fan_in);
+        // l'ultima passata scrive sul file, le altre sull'altro temporaneo
+        if (num_runs <= fan_in)
+            out_fd = es->fd;
+        else {
+            if (run_fds[1 - src] == -1)
+                run_fds[1 - src] = create_run_file(es->pathname);
+            out_fd = run_fds[1 - src];
+        }
+
+        // memoria divisa tra i k buffer di lettura e quello di scrittura
+        buffer_size = memory_limit / (k + 1) / record_size * record_size;
+        if (buffer_size < record_size)
+            buffer_size = record_size;
+        if ((output = malloc(buffer_size)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+
+        start = seconds_now();
+        for (first = 0; first < es->num_records; first += run_records * k) {
+            left = (es->num_records - first + run_records - 1) / run_records;
+            merge_group(run_fds[src], out_fd, first, run_records,
+                        (left < k ? left : k), es->num_records, buffer_size, output);
+        }
+        elapsed = seconds_now() - start;
+        free(output);
+
+        printf("passata %d: fusione a %d vie di %ld sequenze in %.3f s (%.1f MiB/s)\n",
+               ++pass, k, num_runs, elapsed,
+               es->num_records * (double)record_size / (1 << 20) / elapsed);
+
+        run_records *= k;
+        num_runs = (num_runs + k - 1) / k;
+        src = 1 - src;
+    }
+
+    if (run_fds[1] != -1)
+        close(run_fds[1]);
+}
+
+void external_sort(int fd, const char *pathname, long num_records, long memory_limit, int num_threads) {
+    external_sort_t es;
+    pthread_t tids[num_threads];
+    long per_thread;
+    double start, runs_time;
+    int i, err;
+
+    // ogni thread tiene in memoria una sequenza, le sue coppie (due volte, per
+    // il radix sort) e un buffer di uscita (al piu' un ottavo della sua quota)
+    per_thread = memory_limit / num_threads;
+    es.fd = fd;
+    es.pathname = pathname;
+    es.num_records = num_records;
+    es.out_records = (per_thread / 8 < IO_BUFFER_SIZE ? per_thread / 8 : IO_BUFFER_SIZE) / record_size;
+    if (es.out_records < 1)
+        es.out_records = 1;
+    per_thread -= es.out_records * record_size;
+    es.records_per_run = per_thread / (record_size + 2 * (long)sizeof(key_entry_t));
+    if (es.records_per_run < 1)
+        es.records_per_run = 1;
+    es.num_runs = (num_records + es.records_per_run - 1) / es.records_per_run;
+    es.next_run = 0;
+    pthread_mutex_init(&es.lock, NULL);
+    es.run_fd = (es.num_runs > 1 ? create_run_file(pathname) : -1);
+    if (num_threads > es.num_runs)
+        num_threads = es.num_runs;
+
+    start = seconds_now();
+    for (i = 0; i < num_threads; i++)
+        if ((err = pthread_create(&tids[i], NULL, sort_runs, &es)) != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(1);
+        }
+    for (i = 0; i < num_threads; i++)
+        pthread_join(tids[i], NULL);
+    runs_time = seconds_now() - start;
+    printf("%ld sequenze da %ld record ordinate con %d thread in %.3f s\n",
+           es.num_runs, es.records_per_run, num_threads, runs_time);
+
+    if (es.num_runs > 1) {
+        merge_runs(&es, memory_limit);
+        close(es.run_fd);
+    }
+
+    pthread_mutex_destroy(&es.lock);
+}
+
+/* ---------------- ordinamento indiretto in memoria ---------------- */
+
+void indirect_sort(char *map, long num_records) {
+    key_entry_t *entries, *tmp;
+    long *source, i, j, next;
+    char *saved;
+
+    entries = malloc(num_records * sizeof(key_entry_t));
+    tmp = malloc(num_records * sizeof(key_entry_t));
+    saved = malloc(record_size);
+    if (!entries || !tmp || !saved) {
+        perror("malloc");
+        exit(1);
+    }
+
+    for (i = 0; i < num_records; i++) {
+        entries[i].record = map + i * record_size;
+        entries[i].prefix = key_prefix(entries[i].record);
+    }
+    sort_key_entries(entries, num_records, tmp);
+
+    // source[i]: record che deve finire in posizione i (riusa 'tmp')
+    source = (long *)tmp;
+    for (i = 0; i < num_records; i++)
+        source[i] = (entries[i].record - map) / record_size;
+    free(entries);
+
+    // permutazione sul posto ciclo per ciclo: si salva il primo record del
+    // ciclo, si "tirano" gli altri al loro posto e si chiude col salvato;
+    // source[j] = j marca le posizioni gia' sistemate
+    for (i = 0; i < num_records; i++) {
+        if (source[i] == i)
+            continue;
+        memcpy(saved, map + i * record_size, record_size);
+        j = i;
+        while (source[j] != i) {
+            next = source[j];
+            memcpy(map + j * record_size, map + next * record_size, record_size);
+            source[j] = j;
+            j = next;
+        }
+        memcpy(map + j * record_size, saved, record_size);
+        source[j] = j;
+    }
+
+    free(tmp);
+    free(saved);
+}
+
 int main(int argc, char *argv[]) {
     struct stat sb;
     int size, i, num_records;
     char *map;
     long fd;
+    long memory_limit = 0;  // 0: ordinamento in memoria con 'mmap'
+    int num_threads = 1;
+    int indirect = 0;
+    int arg = 1;
+    char *pathname;
 
-    if (argc < 3) {
-        fprintf(stderr, "uso: %s <dimensione record> <file>\n", argv[0]);
+    // opzioni dell'ordinamento esterno
+    while (arg < argc && strncmp(argv[arg], "--", 2) == 0) {
+        if (strcmp(argv[arg], "--memory-limit") == 0 && arg + 1 < argc)
+            memory_limit = atol(argv[++arg]);
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+            num_threads = atoi(argv[++arg]);
+            if (memory_limit == 0)
+                memory_limit = DEFAULT_MEMORY_LIMIT;
+        } else if (strcmp(argv[arg], "--indirect") == 0)
+            indirect = 1;
+        else
+            break;
+        arg++;
+    }
+    // l'ordinamento indiretto lavora sul file mappato: niente limite di memoria
+    if ( (argc - arg < 2) || (memory_limit < 0) || (num_threads < 1) || (indirect && memory_limit > 0) ) {
+        fprintf(stderr, "uso: %s [--indirect | [--memory-limit <MiB>] [--threads <T>]] <dimensione record> <file>\n", argv[0]);
         exit(1);
     }
+    pathname = argv[arg + 1];
 
-    if ((fd = open(argv[2], O_RDWR)) == -1) {
-        perror(argv[2]);
+    if ((fd = open(pathname, O_RDWR)) == -1) {
+        perror(pathname);
         exit(1);
     }
 
@@ -110,16 +637,28 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
     if (!S_ISREG(sb.st_mode)) {
-        fprintf(stderr, "%s non è un file\n", argv[2]);
+        fprintf(stderr, "%s non è un file\n", pathname);
         exit(1);
     }
 
-    size = atoi(argv[1]);
+    size = atoi(argv[arg]);
     if ( (size <= 0) || ((sb.st_size % size) != 0) ) {
         fprintf(stderr, "dimensione del record %d non valida o dimensione del file non congruente!\n", size);
         exit(1);
     }
 
+    if (memory_limit > 0) {
+        record_size = size;
+        if (sb.st_size > 0)
+            external_sort(fd, pathname, sb.st_size / size, memory_limit << 20, num_threads);
+        if (close(fd) == -1) {
+            perror("close");
+            exit(1);
+        }
+        printf("Record del file '%s' riordinati!\n", pathname);
+        exit(0);
+    }
+
     if ((map = mmap(NULL, sb.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
         perror("mmap");
         exit(1);
@@ -129,17 +668,23 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
-    // alloca il buffer di scambio globale (al posto di uno locale alla procedura 'partition'
-    swap_buffer = malloc(size);
+    if (indirect) {
+        // ordinamento indiretto: un solo spostamento per record
+        record_size = size;
+        indirect_sort(map, sb.st_size / size);
+    } else {
+        // alloca il buffer di scambio globale (al posto di uno locale alla procedura 'partition'
+        swap_buffer = malloc(size);
 
-    // ordina il contenuto del file
-    num_records = sb.st_size / size;
-    quicksort(map, 0, num_records-1, size);
+        // ordina il contenuto del file
+        num_records = sb.st_size / size;
+        quicksort(map, 0, num_records-1, size);
 
-    // libera la memoria del buffer una volta finito
-    free(swap_buffer);
+        // libera la memoria del buffer una volta finito
+        free(swap_buffer);
+    }
 
-    printf("Record del file '%s' riordinati!\n", argv[2]);
+    printf("Record del file '%s' riordinati!\n", pathname);
 
     if (munmap(map, sb.st_size) == -1) {
         perror ("munmap");
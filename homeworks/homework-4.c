@@ -11,6 +11,30 @@
      $ homework-4 directory-di-esempio file-semplice.txt path/altra-dir/ "nome con spazi.pdf" directory-destinazione
 */
 
+/*
+    Estensione: i file regolari sono copiati con 'copy_fd_sparse' di 'lib-copy'
+    (esempi del corso): niente buffer utente quando possibile e solo le
+    estensioni di dati delle sorgenti, cosi' i buchi (es. immagini di macchine
+    virtuali) restano buchi; con --punch-zeros diventano buchi anche i blocchi
+    nulli delle sorgenti dense.
+     $ homework-4 [--method <metodo>] [--punch-zeros] sorgente... directory-destinazione
+
+    Estensione: con --threads N la visita dell'albero (thread principale) e la
+    copia dei file regolari sono separate: il thread principale crea directory
+    e link simbolici e accoda un "lavoro" per ogni file regolare in una coda
+    circolare limitata (QUEUE_SIZE) da cui pescano N thread copiatori; i file
+    piccoli (fino a SMALL_FILE_SIZE) sono copiati con una sola read e una sola
+    write, quelli grandi con 'copy_fd_sparse'. Permessi e date delle directory
+    sono sistemati alla fine, quando tutti i figli sono stati creati (anche
+    senza --threads: cosi' si copiano pure directory sorgenti senza il
+    permesso di scrittura e le loro date non vengono alterate dalla copia).
+     $ homework-4 --threads 8 albero-enorme directory-destinazione > /dev/null
+
+    Compilazione:
+     $ EX=../operating-systems.2024-2025/lab/examples
+     $ gcc -I$EX homework-4.c $EX/lib-copy.c $EX/lib-uring.c -o homework-4 -lpthread
+*/
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -20,11 +44,163 @@
 #include <libgen.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include "lib-copy.h"
 
 #define BUFSIZE 2048
+#define QUEUE_SIZE 1024                 // lavori in attesa nella coda
+#define SMALL_FILE_SIZE (64 * 1024)     // soglia dei file "piccoli"
+
+int copy_method = COPY_METHOD_AUTO;   // metodo di copia dei file regolari
+int punch_zeros = 0;                  // blocchi nulli trasformati in buchi
+int num_threads = 0;                  // thread copiatori (0: copia diretta)
+
+// un file regolare da copiare
+typedef struct {
+    char *source, *destination;
+    mode_t mode;
+    off_t size;
+} job_t;
+
+// coda circolare limitata dei lavori (produttore: il thread principale)
+job_t queue[QUEUE_SIZE];
+int queue_head = 0, queue_count = 0, scan_done = 0;
+pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;
+
+// directory i cui permessi e date vanno sistemati alla fine
+typedef struct {
+    char *path;
+    mode_t mode;
+    struct timespec times[2];
+} dir_fixup_t;
+
+dir_fixup_t *fixups = NULL;
+int fixups_count = 0, fixups_size = 0;
+
+void copy_regular(const job_t *job) {
+    int sd, dd;
+    ssize_t n, total = 0;
+    char buffer[SMALL_FILE_SIZE];
+
+    // apre il file sorgente di turno in sola lettura
+    if ((sd = open(job->source, O_RDONLY)) == -1) {
+        perror(job->source);
+        exit(1);
+    }
+
+    // apre il file destinazione in sola scrittura, con troncamento e creazione
+    if ((dd = open(job->destination, O_WRONLY|O_CREAT|O_TRUNC, job->mode)) == -1) {
+        perror(job->destination);
+        exit(1);
+    }
+
+    if (job->size <= SMALL_FILE_SIZE && !punch_zeros) {
+        // file piccolo: una read (piu' qualcuna se il file e' cresciuto) e una write
+        while (total < SMALL_FILE_SIZE &&
+               (n = read(sd, buffer + total, SMALL_FILE_SIZE - total)) > 0)
+            total += n;
+        if (n == -1 || write(dd, buffer, total) != total) {
+            perror(job->destination);
+            exit(1);
+        }
+        if (total == SMALL_FILE_SIZE &&
+            copy_fd(sd, dd, copy_method, NULL) == -1) {
+            perror(job->source);
+            exit(1);
+        }
+    } else if (copy_fd_sparse(sd, dd, copy_method, punch_zeros, NULL) == -1) {
+        // copia i dati dalla sorgente alla destinazione (saltando i buchi)
+        perror(job->source);
+        exit(1);
+    }
+
+    // chiude i file attualmente aperti
+    close(sd);
+    close(dd);
+}
+
+void enqueue_job(const char *source, const char *destination, const struct stat *statbuf) {
+    job_t job;
+
+    job.source = strdup(source);
+    job.destination = strdup(destination);
+    job.mode = statbuf->st_mode & 0777;
+    job.size = statbuf->st_size;
+    if (job.source == NULL || job.destination == NULL) {
+        perror("strdup");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    while (queue_count == QUEUE_SIZE)
+        pthread_cond_wait(&queue_not_full, &queue_lock);
+    queue[(queue_head + queue_count) % QUEUE_SIZE] = job;
+    queue_count++;
+    pthread_cond_signal(&queue_not_empty);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+void *copier_thread(void *arg) {
+    job_t job;
+    (void)arg;
+
+    while (1) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_count == 0 && !scan_done)
+            pthread_cond_wait(&queue_not_empty, &queue_lock);
+        if (queue_count == 0) {     // visita finita e coda vuota
+            pthread_mutex_unlock(&queue_lock);
+            return NULL;
+        }
+        job = queue[queue_head];
+        queue_head = (queue_head + 1) % QUEUE_SIZE;
+        queue_count--;
+        pthread_cond_signal(&queue_not_full);
+        pthread_mutex_unlock(&queue_lock);
+
+        copy_regular(&job);
+        free(job.source);
+        free(job.destination);
+    }
+}
+
+void add_dir_fixup(const char *path, const struct stat *statbuf) {
+    if (fixups_count == fixups_size) {
+        fixups_size = (fixups_size == 0 ? 64 : fixups_size * 2);
+        if ((fixups = realloc(fixups, fixups_size * sizeof(dir_fixup_t))) == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    if ((fixups[fixups_count].path = strdup(path)) == NULL) {
+        perror("strdup");
+        exit(1);
+    }
+    fixups[fixups_count].mode = statbuf->st_mode & 0777;
+    fixups[fixups_count].times[0] = statbuf->st_atim;
+    fixups[fixups_count].times[1] = statbuf->st_mtim;
+    fixups_count++;
+}
+
+/* a copia finita: in ordine inverso di creazione, cosi' le sotto-directory
+   (magari senza permesso di scrittura) vengono sistemate prima dei genitori */
+void apply_dir_fixups() {
+    int i;
+
+    for (i = fixups_count - 1; i >= 0; i--) {
+        if (chmod(fixups[i].path, fixups[i].mode) == -1 ||
+            utimensat(AT_FDCWD, fixups[i].path, fixups[i].times, 0) == -1)
+            perror(fixups[i].path);
+        free(fixups[i].path);
+    }
+    free(fixups);
+}
 
 void copy_element(const char *pathname, const char *destination, int depth) {
-    int sd, dd, size, i;
+    int size;
+    job_t job;
     char buffer[BUFSIZE], buffer2[BUFSIZE];
     struct stat statbuf;
     DIR *dp;
@@ -63,43 +239,27 @@ void copy_element(const char *pathname, const char *destination, int depth) {
     case S_IFREG:   // e' un file regolare
         printf("%*s%s (f)--> %s\n", depth, "  ", pathname, buffer);
 
-        // apre il file sorgente di turno in sola lettura
-        if ((sd = open(pathname, O_RDONLY)) == -1) {
-            perror(pathname);
-            exit(1);
-        }
-
-        // apre il file destinazione in sola scrittura, con troncamento e creazione
-        if ((dd = open(buffer, O_WRONLY|O_CREAT|O_TRUNC, statbuf.st_mode & 0777)) == -1) {
-            perror(buffer);
-            exit(1);
+        if (num_threads > 0) {
+            // ci pensera' uno dei thread copiatori
+            enqueue_job(pathname, buffer, &statbuf);
+        } else {
+            job.source = (char *)pathname;
+            job.destination = buffer;
+            job.mode = statbuf.st_mode & 0777;
+            job.size = statbuf.st_size;
+            copy_regular(&job);
         }
-
-        // copia i dati dalla sorgente alla destinazione
-        do {
-            // legge fino ad un massimo di BUFSIZE byte dalla sorgente
-            if ((size = read(sd, buffer, BUFSIZE)) == -1) {
-                perror(pathname);
-                exit(1);
-            }
-            // scrive i byte letti
-            if (write(dd, buffer, size) == -1) {
-                perror(destination);
-                exit(1);
-            }
-        } while (size == BUFSIZE);
-
-        // chiude i file attualmente aperti
-        close(sd);
-        close(dd);
         break;
     case S_IFDIR:   // e' una directory (da copiare ricorsivamente)
         printf("%*s%s/ (d)--> %s/\n", depth, "  ", pathname, buffer);
 
-        if (mkdir(buffer, statbuf.st_mode & 0777) == -1) {
+        /* finche' la copia non e' finita la directory deve essere scrivibile:
+           i permessi originali (e le date) vengono impostati alla fine  */
+        if (mkdir(buffer, (statbuf.st_mode & 0777) | S_IRWXU) == -1) {
             perror(buffer);
             if (errno != EEXIST) exit(1);
         }
+        add_dir_fixup(buffer, &statbuf);
         // apre	la directory
         if ((dp = opendir(pathname)) == NULL) {
             perror(pathname);
@@ -127,15 +287,60 @@ void copy_element(const char *pathname, const char *destination, int depth) {
 }
 
 int main(int argc, char *argv[]) {
-    int i;
+    int i, first = 1;
+    pthread_t *threads = NULL;
+
+    // opzioni della copia dei file regolari
+    while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+        if (strcmp(argv[first], "--method") == 0 && first + 1 < argc) {
+            if ((copy_method = copy_method_from_name(argv[++first])) == -1) {
+                fprintf(stderr, "metodo di copia '%s' non valido!\n", argv[first]);
+                exit(1);
+            }
+        } else if (strcmp(argv[first], "--punch-zeros") == 0)
+            punch_zeros = 1;
+        else if (strcmp(argv[first], "--threads") == 0 && first + 1 < argc) {
+            if ((num_threads = atoi(argv[++first])) < 1) {
+                fprintf(stderr, "numero di thread '%s' non valido!\n", argv[first]);
+                exit(1);
+            }
+        } else
+            break;
+        first++;
+    }
 
-    if (argc < 3) {
-        printf("utilizzo: %s [<sorgente>...] <directory destinazione>\n", argv[0]);
+    if (argc - first < 2) {
+        printf("utilizzo: %s [--method <metodo>] [--punch-zeros] [--threads N] [<sorgente>...] <directory destinazione>\n", argv[0]);
         exit(1);
     }
 
-    for (i = 1; i < argc-1; i++)
+    if (num_threads > 0) {
+        if ((threads = malloc(num_threads * sizeof(pthread_t))) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        for (i = 0; i < num_threads; i++)
+            if ((errno = pthread_create(&threads[i], NULL, copier_thread, NULL)) != 0) {
+                perror("pthread_create");
+                exit(1);
+            }
+    }
+
+    for (i = first; i < argc-1; i++)
         copy_element(argv[i], argv[argc-1], 0);
+
+    if (num_threads > 0) {
+        // visita finita: i copiatori escono appena svuotata la coda
+        pthread_mutex_lock(&queue_lock);
+        scan_done = 1;
+        pthread_cond_broadcast(&queue_not_empty);
+        pthread_mutex_unlock(&queue_lock);
+        for (i = 0; i < num_threads; i++)
+            pthread_join(threads[i], NULL);
+        free(threads);
+    }
+
+    apply_dir_fixups();
 }
 
 
@@ -0,0 +1,403 @@
+/**
+ * confronta i metodi di copia di `lib-copy` su file di dimensione crescente
+ * (da 1 MiB fino al massimo indicato con `--max-size`, di default 8 GiB,
+ * quadruplicando ogni volta ma chiudendo sempre con il massimo): per ogni
+ * metodo riporta la velocità in GB/s e il numero di chiamate di sistema di
+ * trasferimento usate
+ *
+ * NB: la sorgente appena scritta è nella page cache, quindi si misura il costo
+ * della copia e non quello del disco
+ *
+ * con `--sparse` crea invece un file quasi tutto buchi (1 MiB di dati per ogni
+ * GiB) e confronta la copia densa (read/write) con quella sparsa di
+ * `copy_fd_sparse`, riportando byte trasferiti, spazio occupato dalla copia e
+ * correttezza del contenuto
+ *
+ * con `--io_uring` copia invece un file della dimensione indicata con
+ * `lib-uring` al variare della profondità della coda (blocchi in volo), per
+ * vedere da quando in poi un solo thread satura il dispositivo
+ *
+ * con `--append` verifica invece che ogni metodo, copiando in coda a un file
+ * aperto con `O_APPEND` (come `my-cat a >> b`), o copi tutto o fallisca con un
+ * errore: una copia riuscita che perde dati fa terminare con un errore
+ *
+ * uso: copy-benchmark [--max-size <MiB>] [directory]
+ *      copy-benchmark --sparse [dimensione-GiB] [directory]
+ *      copy-benchmark --io_uring [dimensione-MiB] [directory]
+ *      copy-benchmark --append [directory]
+ */
+
+#include "lib-copy.h"
+#include "lib-misc.h"
+#include "lib-uring.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DEFAULT_MAX_SIZE_MIB (8LL * 1024) // 8 GiB
+#define DEFAULT_SPARSE_SIZE_GIB 4
+#define DEFAULT_URING_SIZE_MIB 1024
+#define APPEND_PREFIX "intestazione gia' presente\n"
+#define MIB (1024LL * 1024LL)
+#define GIB (1024LL * MIB)
+
+/* crea la sorgente di `size` byte (contenuto non banale per non avere pagine
+ * tutte uguali) */
+void create_source(const char *pathname, long long size) {
+    int fd;
+    char *buffer;
+    long long written = 0;
+    long chunk;
+
+    if ((buffer = malloc(MIB)) == NULL)
+        exit_with_sys_err("malloc");
+    for (long i = 0; i < MIB; i++)
+        buffer[i] = (char)(i * 31 + i / 4096);
+
+    if ((fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) ==
+        -1)
+        exit_with_sys_err(pathname);
+    while (written < size) {
+        chunk = (size - written < MIB ? size - written : MIB);
+        if (write(fd, buffer, chunk) != chunk)
+            exit_with_sys_err(pathname);
+        written += chunk;
+    }
+
+    close(fd);
+    free(buffer);
+}
+
+/* crea un file di `size_gib` GiB con 1 MiB di dati all'inizio di ogni GiB */
+void create_sparse_source(const char *pathname, long size_gib) {
+    int fd;
+    char *buffer;
+
+    if ((buffer = malloc(MIB)) == NULL)
+        exit_with_sys_err("malloc");
+    memset(buffer, 'x', MIB);
+
+    if ((fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) ==
+        -1)
+        exit_with_sys_err(pathname);
+    for (long i = 0; i < size_gib; i++)
+        if (pwrite(fd, buffer, MIB, i * GIB) != MIB)
+            exit_with_sys_err(pathname);
+    if (ftruncate(fd, size_gib * GIB) == -1)
+        exit_with_sys_err("ftruncate");
+
+    close(fd);
+    free(buffer);
+}
+
+/* vero se i due file hanno la stessa dimensione e lo stesso contenuto nei
+ * primi 2 MiB di ogni GiB (dati e inizio del buco successivo) */
+bool same_sparse_content(const char *pathname1, const char *pathname2,
+                         long size_gib) {
+    int fd1, fd2;
+    struct stat sb1, sb2;
+    char *buffer1, *buffer2;
+    bool same;
+
+    if ((fd1 = open(pathname1, O_RDONLY)) == -1)
+        exit_with_sys_err(pathname1);
+    if ((fd2 = open(pathname2, O_RDONLY)) == -1)
+        exit_with_sys_err(pathname2);
+    if (fstat(fd1, &sb1) == -1 || fstat(fd2, &sb2) == -1)
+        exit_with_sys_err("fstat");
+    if ((buffer1 = malloc(2 * MIB)) == NULL ||
+        (buffer2 = malloc(2 * MIB)) == NULL)
+        exit_with_sys_err("malloc");
+
+    same = (sb1.st_size == sb2.st_size);
+    for (long i = 0; same && i < size_gib; i++)
+        same = (pread(fd1, buffer1, 2 * MIB, i * GIB) == 2 * MIB &&
+                pread(fd2, buffer2, 2 * MIB, i * GIB) == 2 * MIB &&
+                memcmp(buffer1, buffer2, 2 * MIB) == 0);
+
+    free(buffer1);
+    free(buffer2);
+    close(fd1);
+    close(fd2);
+
+    return same;
+}
+
+void run_sparse_test(long size_gib, const char *source,
+                     const char *destination) {
+    int sd, dd;
+    copy_stats_t stats;
+    struct stat sb;
+    double timestamp, elapsed;
+
+    printf("file di %ld GiB con %ld MiB di dati\n", size_gib, size_gib);
+    create_sparse_source(source, size_gib);
+
+    printf("%-8s %16s %16s %16s %10s %8s\n", "copia", "byte trasferiti",
+           "byte buchi", "byte occupati", "secondi", "uguale");
+    for (int sparse = 0; sparse <= 1; sparse++) {
+        if ((sd = open(source, O_RDONLY)) == -1)
+            exit_with_sys_err(source);
+        if ((dd = open(destination, O_WRONLY | O_CREAT | O_TRUNC,
+                       S_IRUSR | S_IWUSR)) == -1)
+            exit_with_sys_err(destination);
+
+        timestamp = seconds_now();
+        if ((sparse ? copy_fd_sparse(sd, dd, COPY_METHOD_AUTO, false, &stats)
+                    : copy_fd(sd, dd, COPY_METHOD_READ_WRITE, &stats)) == -1)
+            exit_with_sys_err("copia");
+        elapsed = seconds_now() - timestamp;
+        if (fstat(dd, &sb) == -1)
+            exit_with_sys_err("fstat");
+        close(sd);
+        close(dd);
+
+        printf("%-8s %16llu %16llu %16lld %10.3f %8s\n",
+               (sparse ? "sparsa" : "densa"), stats.bytes, stats.holes,
+               (long long)sb.st_blocks * 512, elapsed,
+               (same_sparse_content(source, destination, size_gib) ? "sì"
+                                                                   : "NO"));
+    }
+}
+
+void run_uring_sweep(long size_mib, const char *source,
+                     const char *destination) {
+    int sd, dd;
+    uring_stats_t stats;
+    double timestamp, elapsed;
+
+    if (!uring_available())
+        exit_with_err_msg("io_uring non disponibile su questo sistema!\n");
+    create_source(source, size_mib * MIB);
+
+    printf("%10s %10s %10s %14s %10s %8s\n", "profondità", "blocco KiB",
+           "GB/s", "sottomissioni", "ripieghi", "fissi");
+    for (unsigned int depth = 1; depth <= 128; depth *= 2) {
+        if ((sd = open(source, O_RDONLY)) == -1)
+            exit_with_sys_err(source);
+        if ((dd = open(destination, O_WRONLY | O_CREAT | O_TRUNC,
+                       S_IRUSR | S_IWUSR)) == -1)
+            exit_with_sys_err(destination);
+
+        timestamp = seconds_now();
+        if (uring_copy_range(sd, 0, dd, 0, -1, depth, URING_DEFAULT_BLOCK_SIZE,
+                             &stats) == -1)
+            exit_with_sys_err("io_uring");
+        elapsed = seconds_now() - timestamp;
+        printf("%10u %10d %10.2f %14lu %10lu %8s\n", depth,
+               URING_DEFAULT_BLOCK_SIZE / 1024, stats.bytes / elapsed / 1e9,
+               stats.submissions, stats.fallbacks,
+               (stats.fixed_buffers ? "sì" : "no"));
+
+        close(sd);
+        close(dd);
+    }
+}
+
+/* legge fino a `size` byte (meno solo alla fine del file) */
+long long read_up_to(int fd, char *buffer, long long size) {
+    ssize_t got;
+    long long done = 0;
+
+    while (done < size && (got = read(fd, buffer + done, size - done)) > 0)
+        done += got;
+
+    return done;
+}
+
+/* vero se `pathname` contiene `APPEND_PREFIX` seguito da `size` byte uguali a
+ * quelli di `source` */
+bool same_appended_content(const char *pathname, const char *source,
+                           long long size) {
+    int fd, sd;
+    size_t prefix = strlen(APPEND_PREFIX);
+    char *buffer1, *buffer2;
+    bool same;
+
+    if ((fd = open(pathname, O_RDONLY)) == -1)
+        exit_with_sys_err(pathname);
+    if ((sd = open(source, O_RDONLY)) == -1)
+        exit_with_sys_err(source);
+    if ((buffer1 = malloc(prefix + size + 1)) == NULL ||
+        (buffer2 = malloc(size)) == NULL)
+        exit_with_sys_err("malloc");
+
+    // un byte in più per accorgersi anche di dati di troppo
+    same = (read_up_to(fd, buffer1, prefix + size + 1) == (long long)prefix + size &&
+            read_up_to(sd, buffer2, size) == size &&
+            memcmp(buffer1, APPEND_PREFIX, prefix) == 0 &&
+            memcmp(buffer1 + prefix, buffer2, size) == 0);
+
+    free(buffer1);
+    free(buffer2);
+    close(fd);
+    close(sd);
+
+    return same;
+}
+
+/* caso di regressione: `splice` attraverso la pipe intermedia toglieva i dati
+ * alla sorgente prima di scoprire che la destinazione in `O_APPEND` non è
+ * supportata, e il ripiego su read/write ripartiva senza di loro */
+bool run_append_test(const char *source, const char *destination) {
+    const long long sizes[] = {1000, 3 * MIB + 17};
+    int sd, dd, result;
+    copy_stats_t stats;
+    bool all_ok = true;
+
+    printf("%10s  %-16s %-16s %s\n", "dimensione", "metodo", "usato",
+           "esito");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        create_source(source, sizes[i]);
+
+        for (int method = COPY_METHOD_AUTO; method < COPY_METHODS; method++) {
+            if ((dd = open(destination, O_WRONLY | O_CREAT | O_TRUNC,
+                           S_IRUSR | S_IWUSR)) == -1)
+                exit_with_sys_err(destination);
+            if (write(dd, APPEND_PREFIX, strlen(APPEND_PREFIX)) !=
+                (ssize_t)strlen(APPEND_PREFIX))
+                exit_with_sys_err(destination);
+            close(dd);
+
+            if ((sd = open(source, O_RDONLY)) == -1)
+                exit_with_sys_err(source);
+            if ((dd = open(destination, O_WRONLY | O_APPEND)) == -1)
+                exit_with_sys_err(destination);
+            result = copy_fd(sd, dd, method, &stats);
+            close(sd);
+            close(dd);
+
+            if (result == -1) {
+                // rifiutare la destinazione è lecito (tranne che in `auto`)
+                printf("%10lld  %-16s %-16s errore: %s\n", sizes[i],
+                       copy_method_names[method], "-", strerror(errno));
+                if (method == COPY_METHOD_AUTO)
+                    all_ok = false;
+            } else if (same_appended_content(destination, source, sizes[i]))
+                printf("%10lld  %-16s %-16s ok\n", sizes[i],
+                       copy_method_names[method],
+                       copy_method_names[stats.method]);
+            else {
+                printf("%10lld  %-16s %-16s DATI PERSI\n", sizes[i],
+                       copy_method_names[method],
+                       copy_method_names[stats.method]);
+                all_ok = false;
+            }
+        }
+    }
+
+    return all_ok;
+}
+
+int main(int argc, char *argv[]) {
+    long long max_size_mib = DEFAULT_MAX_SIZE_MIB, size_mib;
+    int arg = 1;
+    const char *directory = ".";
+    char source[4096], destination[4096];
+    int sd, dd;
+    copy_stats_t stats;
+    double timestamp, elapsed;
+
+    if (argc > 1 && strcmp(argv[1], "--sparse") == 0) {
+        long size_gib = DEFAULT_SPARSE_SIZE_GIB;
+        if (argc > 2 && (size_gib = atol(argv[2])) < 1)
+            exit_with_err_msg("dimensione (%ld GiB) non valida!\n", size_gib);
+        if (argc > 3)
+            directory = argv[3];
+        snprintf(source, sizeof(source), "%s/copy-benchmark.src", directory);
+        snprintf(destination, sizeof(destination), "%s/copy-benchmark.dst",
+                 directory);
+        run_sparse_test(size_gib, source, destination);
+        unlink(source);
+        unlink(destination);
+        exit(EXIT_SUCCESS);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--io_uring") == 0) {
+        long size_mib = DEFAULT_URING_SIZE_MIB;
+        if (argc > 2 && (size_mib = atol(argv[2])) < 1)
+            exit_with_err_msg("dimensione (%ld MiB) non valida!\n", size_mib);
+        if (argc > 3)
+            directory = argv[3];
+        snprintf(source, sizeof(source), "%s/copy-benchmark.src", directory);
+        snprintf(destination, sizeof(destination), "%s/copy-benchmark.dst",
+                 directory);
+        run_uring_sweep(size_mib, source, destination);
+        unlink(source);
+        unlink(destination);
+        exit(EXIT_SUCCESS);
+    }
+
+    if (argc > 1 && strcmp(argv[1], "--append") == 0) {
+        bool all_ok;
+        if (argc > 2)
+            directory = argv[2];
+        snprintf(source, sizeof(source), "%s/copy-benchmark.src", directory);
+        snprintf(destination, sizeof(destination), "%s/copy-benchmark.dst",
+                 directory);
+        all_ok = run_append_test(source, destination);
+        unlink(source);
+        unlink(destination);
+        exit(all_ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (arg + 1 < argc && strcmp(argv[arg], "--max-size") == 0) {
+        if ((max_size_mib = atoll(argv[arg + 1])) < 1)
+            exit_with_err_msg("dimensione massima (%s MiB) non valida!\n",
+                              argv[arg + 1]);
+        arg += 2;
+    }
+    if (arg < argc)
+        directory = argv[arg++];
+    if (arg < argc)
+        exit_with_err_msg("uso: %s [--max-size <MiB>] [directory]\n",
+                          argv[0]);
+
+    snprintf(source, sizeof(source), "%s/copy-benchmark.src", directory);
+    snprintf(destination, sizeof(destination), "%s/copy-benchmark.dst",
+             directory);
+
+    printf("%10s  %-16s %10s %14s\n", "dimensione", "metodo", "GB/s",
+           "chiamate");
+    for (size_mib = 1;; size_mib = (size_mib * 4 < max_size_mib
+                                        ? size_mib * 4
+                                        : max_size_mib)) {
+        create_source(source, size_mib * MIB);
+
+        for (int method = COPY_METHOD_AUTO + 1; method < COPY_METHODS;
+             method++) {
+            if ((sd = open(source, O_RDONLY)) == -1)
+                exit_with_sys_err(source);
+            if ((dd = open(destination, O_WRONLY | O_CREAT | O_TRUNC,
+                           S_IRUSR | S_IWUSR)) == -1)
+                exit_with_sys_err(destination);
+
+            timestamp = seconds_now();
+            if (copy_fd(sd, dd, method, &stats) == -1) {
+                // metodo non supportato su questo sistema / file system
+                printf("%7lld MiB  %-16s %10s %14s\n", size_mib,
+                       copy_method_names[method], "-", "-");
+            } else {
+                elapsed = seconds_now() - timestamp;
+                printf("%7lld MiB  %-16s %10.2f %14lu\n", size_mib,
+                       copy_method_names[method], stats.bytes / elapsed / 1e9,
+                       stats.syscalls);
+            }
+
+            close(sd);
+            close(dd);
+        }
+
+        if (size_mib >= max_size_mib)
+            break;
+    }
+
+    unlink(source);
+    unlink(destination);
+
+    exit(EXIT_SUCCESS);
+}
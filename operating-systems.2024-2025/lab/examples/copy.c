@@ -1,12 +1,30 @@
 /**
  * copia il contenuto di un file sorgente su un file di destinazione usando
- * read` e `write`
+ * `read` e `write`
+ *
+ * con `--method` la copia è affidata a `lib-copy`, che evita il passaggio dei
+ * dati in un buffer utente (copy_file_range, sendfile o splice) scegliendo
+ * automaticamente (`auto`) il primo metodo supportato dalla coppia di file;
+ * `io_uring` tiene invece in volo più blocchi letti e scritti in modo
+ * asincrono (vedi `lib-uring`)
+ *
+ * con `--sparse` vengono copiate solo le estensioni di dati della sorgente
+ * (i buchi restano buchi, vedi `hole.c`) e con `--punch-zeros` anche i blocchi
+ * a zero di una sorgente densa diventano buchi; per una prova:
+ * > truncate -s 4G grande.img && echo dati >> grande.img
+ * > ./copy --sparse grande.img copia.img && du -h grande.img copia.img
+ *
+ * uso: copy [--method auto|copy_file_range|sendfile|splice|io_uring|read-write]
+ *          [--sparse] [--punch-zeros] <sorgente> <destinazione>
  */
 
+#include "lib-copy.h"
 #include "lib-misc.h"
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -17,33 +35,71 @@
 // #define BUFSIZ 8192
 
 int main(int argc, char *argv[]) {
-    int sd, dd, size, result;
+    int sd, dd, size, result, method = -1, arg = 1;
+    bool sparse = false, punch_zeros = false;
     char buffer[BUFSIZ];
+    char *source, *destination;
+    copy_stats_t stats;
+
+    // opzioni: una qualsiasi attiva la copia con `lib-copy`
+    while (arg < argc && strncmp(argv[arg], "--", 2) == 0) {
+        if (strcmp(argv[arg], "--method") == 0 && arg + 1 < argc) {
+            if ((method = copy_method_from_name(argv[++arg])) == -1)
+                exit_with_err_msg("metodo di copia '%s' non valido!\n",
+                                  argv[arg]);
+        } else if (strcmp(argv[arg], "--sparse") == 0)
+            sparse = true;
+        else if (strcmp(argv[arg], "--punch-zeros") == 0)
+            sparse = punch_zeros = true;
+        else
+            break;
+        arg++;
+    }
+    if ((sparse || punch_zeros) && method == -1)
+        method = COPY_METHOD_AUTO;
 
     // controlla il numero di parametri
-    if (argc != 3)
-        exit_with_err_msg("utilizzo: %s <sorgente> <destinazione>\n", argv[0]);
+    if (argc - arg != 2)
+        exit_with_err_msg("utilizzo: %s [--method <metodo>] [--sparse] "
+                          "[--punch-zeros] <sorgente> <destinazione>\n",
+                          argv[0]);
+    source = argv[arg];
+    destination = argv[arg + 1];
 
-    printf("creo una copia di '%s' su '%s'\n", argv[1], argv[2]);
+    printf("creo una copia di '%s' su '%s'\n", source, destination);
 
     // apre il file sorgente in sola lettura
-    if ((sd = open(argv[1], O_RDONLY)) == -1)
-        exit_with_sys_err(argv[1]);
+    if ((sd = open(source, O_RDONLY)) == -1)
+        exit_with_sys_err(source);
 
     // apre il file destinazione in sola scrittura, con troncamento e creazione
-    if ((dd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR)) ==
-        -1)
-        exit_with_sys_err(argv[2]);
+    if ((dd = open(destination, O_WRONLY | O_CREAT | O_TRUNC,
+                   S_IRUSR | S_IWUSR)) == -1)
+        exit_with_sys_err(destination);
+
+    if (method != -1) {
+        // copia "zero-copy" con il metodo scelto (eventualmente sparsa)
+        if ((sparse ? copy_fd_sparse(sd, dd, method, punch_zeros, &stats)
+                    : copy_fd(sd, dd, method, &stats)) == -1)
+            exit_with_sys_err(copy_method_names[stats.method]);
+        printf("copiati %llu byte con %s (%lu chiamate di sistema), %llu "
+               "byte lasciati come buchi\n",
+               stats.bytes, copy_method_names[stats.method], stats.syscalls,
+               stats.holes);
+        close(sd);
+        close(dd);
+        exit(EXIT_SUCCESS);
+    }
 
     // copia i dati dalla sorgente alla destinazione
     do {
         // legge fino ad un massimo di BUFSIZ byte dalla sorgente
         if ((size = read(sd, buffer, BUFSIZ)) == -1)
-            exit_with_sys_err(argv[1]);
+            exit_with_sys_err(source);
 
         // scrive i byte letti
         if ((result = write(dd, buffer, size)) == -1)
-            exit_with_sys_err(argv[2]);
+            exit_with_sys_err(destination);
     } while (size == BUFSIZ);
 
     // chiude i file prima di uscire
@@ -2,37 +2,69 @@
  * conteggia il numero di byte contenuti in un file specificato
  * sulla riga di comando usando le chiamate `read`: esistono altri modi più
  * efficienti per ottenere questa informazione (vedi `stat`)
+ *
+ * già che i dati passano di qui vengono contate anche righe e parole (come
+ * `wc`) con `wc_count` di `lib-misc`, che esamina 16/32 byte alla volta con
+ * istruzioni SSE2/AVX2; con `--scalar` si usa invece la versione che esamina
+ * un byte alla volta e con `--verbose` si vede ogni singola `read`; per un
+ * confronto su un testo grande:
+ * > for i in $(seq 200); do cat /usr/share/dict/words; done > grande.txt
+ * > ./count grande.txt; ./count --scalar grande.txt; time wc grande.txt
+ *
+ * uso: count [--scalar] [--verbose] <file>
  */
 
 #include "lib-misc.h"
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-#define BUFSIZE 1024
+#define BUFSIZE (128 * 1024)
 
 int main(int argc, char *argv[]) {
-    int fd, size;
-    int total = 0;
-    char buffer[BUFSIZE];
+    int fd, size, arg = 1;
+    bool scalar = false, verbose = false;
+    static char buffer[BUFSIZE];
+    wc_counts_t counts = {0};
+    double timestamp, elapsed;
 
-    if (argc < 2)
-        exit_with_err_msg("utilizzo: %s <file>\n", argv[0]);
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--scalar") == 0)
+            scalar = true;
+        else if (strcmp(argv[arg], "--verbose") == 0)
+            verbose = true;
+        else
+            break;
+    }
+    if (arg >= argc)
+        exit_with_err_msg("utilizzo: %s [--scalar] [--verbose] <file>\n",
+                          argv[0]);
 
     // apre il file sorgente in sola lettura
-    if ((fd = open(argv[1], O_RDONLY)) == -1)
-        exit_with_sys_err(argv[1]);
+    if ((fd = open(argv[arg], O_RDONLY)) == -1)
+        exit_with_sys_err(argv[arg]);
 
     // copia tutti i dati in memoria per conteggiare la dimensione
+    timestamp = seconds_now();
     do {
         if ((size = read(fd, buffer, BUFSIZE)) == -1)
-            exit_with_sys_err(argv[1]);
-        total += size;
-        printf("ho letto %d byte\n", size);
+            exit_with_sys_err(argv[arg]);
+        if (scalar)
+            wc_count_scalar(&counts, buffer, size);
+        else
+            wc_count(&counts, buffer, size);
+        if (verbose)
+            printf("ho letto %d byte\n", size);
     } while (size > 0);
+    elapsed = seconds_now() - timestamp;
 
-    printf("La dimensione totale e' di %d byte\n", total);
+    printf("La dimensione totale e' di %llu byte\n", counts.bytes);
+    printf("righe %llu, parole %llu (%s, %.3f s, %.2f GB/s)\n", counts.lines,
+           counts.words, (scalar ? "scalare" : "vettoriale"), elapsed,
+           counts.bytes / elapsed / 1e9);
 
     close(fd);
 
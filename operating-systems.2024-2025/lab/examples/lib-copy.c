@@ -0,0 +1,512 @@
+/*
+ * libreria di servizio ufficiosa per copiare il contenuto di un descrittore su
+ * un altro evitando, quando possibile, il passaggio dei dati in un buffer
+ * utente (vedi `lib-copy.h`)
+ *
+ * - `copy_file_range`: copia tra file regolari interamente nel kernel (e, su
+ *   file system che lo supportano, senza nemmeno copiare i blocchi)
+ * - `sendfile`: dalla page cache della sorgente alla destinazione
+ * - `splice`: sposta pagine tra un file e una pipe; se nessuno dei due estremi
+ *   è una pipe se ne usa una intermedia
+ * - `io_uring`: blocchi letti e scritti in modo asincrono da `lib-uring`
+ * - `read`/`write`: con un buffer da `COPY_BUFFER_SIZE` byte
+ *
+ * ogni metodo copia `length` byte dalle posizioni correnti dei due descrittori
+ * (o fino alla fine della sorgente se `length` è negativo): la copia "sparsa"
+ * lo usa per copiare un'estensione di dati alla volta.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // per `copy_file_range` e `splice`
+#endif
+
+#include "lib-copy.h"
+#include "lib-uring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#define COPY_PIPE_SIZE (1 << 20) // capacità richiesta per la pipe intermedia
+#define COPY_ZERO_BLOCK 4096     // granularità del rilevamento dei blocchi nulli
+
+const char *copy_method_names[COPY_METHODS] = {
+    "auto", "copy_file_range", "sendfile", "splice", "io_uring", "read-write"};
+
+int copy_method_from_name(const char *name) {
+    assert(name);
+
+    for (int m = 0; m < COPY_METHODS; m++)
+        if (strcmp(name, copy_method_names[m]) == 0)
+            return m;
+
+    return -1;
+}
+
+/* errori che, al primo tentativo, indicano solo un metodo non applicabile alla
+ * coppia di descrittori */
+static bool __copy_unsupported(int err) {
+    return (err == EINVAL || err == ENOSYS || err == EXDEV ||
+            err == EOPNOTSUPP || err == EBADF || err == ESPIPE);
+}
+
+/* quanto chiedere alla prossima chiamata: al più `max` e non oltre `length` */
+static size_t __copy_request(long long length, unsigned long long done,
+                             size_t max) {
+    if (length < 0 || (unsigned long long)length - done > max)
+        return max;
+
+    return (size_t)((unsigned long long)length - done);
+}
+
+static bool __copy_is_zero(const char *block, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        if (block[i] != 0)
+            return false;
+
+    return true;
+}
+
+/* `splice` (come `sendfile` e `copy_file_range`) rifiuta una destinazione
+ * aperta con `O_APPEND` */
+static bool __copy_is_append(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+
+    return (flags != -1 && (flags & O_APPEND));
+}
+
+/* scrive tutto `buffer` gestendo le scritture parziali (es. su pipe) */
+static int __copy_write_all(int dd, const char *buffer, size_t size,
+                            copy_stats_t *stats) {
+    ssize_t written;
+
+    for (size_t done = 0; done < size; done += written) {
+        stats->syscalls++;
+        if ((written = write(dd, buffer + done, size - done)) == -1) {
+            if (errno != EINTR)
+                return -1;
+            written = 0;
+        }
+    }
+
+    return 0;
+}
+
+/* con `punch_zeros` i blocchi di `COPY_ZERO_BLOCK` byte tutti nulli non vengono
+ * scritti ma saltati con `lseek` (la destinazione deve essere un file
+ * regolare: il salto lascia un buco); i blocchi consecutivi dello stesso tipo
+ * sono accorpati in un'unica `write` o in un unico salto, che per i buchi può
+ * estendersi anche alle letture successive */
+static int __copy_with_read_write(int sd, int dd, long long length,
+                                  bool punch_zeros, copy_stats_t *stats) {
+    char *buffer;
+    ssize_t size;
+    size_t block, start, end;
+    bool zero;
+    off_t hole = 0; // salto ancora da fare prima della prossima scrittura
+    unsigned long long done = 0;
+
+    // allineato alla pagina: le copie del kernel da/verso la page cache
+    // procedono a pagine intere
+    if (posix_memalign((void **)&buffer, 4096, COPY_BUFFER_SIZE) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    while (length < 0 || done < (unsigned long long)length) {
+        stats->syscalls++;
+        if ((size = read(sd, buffer,
+                         __copy_request(length, done, COPY_BUFFER_SIZE))) ==
+            -1) {
+            if (errno == EINTR)
+                continue;
+            goto error;
+        }
+        if (size == 0)
+            break;
+        done += size;
+
+        if (!punch_zeros) {
+            if (__copy_write_all(dd, buffer, size, stats) == -1)
+                goto error;
+            stats->bytes += size;
+            continue;
+        }
+
+        // scrive solo le sequenze di blocchi non nulli
+        for (start = 0; start < (size_t)size; start = end) {
+            block = ((size_t)size - start < COPY_ZERO_BLOCK ? (size_t)size - start
+                                                            : COPY_ZERO_BLOCK);
+            zero = __copy_is_zero(buffer + start, block);
+            for (end = start + block; end < (size_t)size; end += block) {
+                block = ((size_t)size - end < COPY_ZERO_BLOCK ? (size_t)size - end
+                                                              : COPY_ZERO_BLOCK);
+                if (__copy_is_zero(buffer + end, block) != zero)
+                    break;
+            }
+
+            if (zero) {
+                hole += end - start;
+                stats->holes += end - start;
+                continue;
+            }
+            if (hole > 0) {
+                stats->syscalls++;
+                if (lseek(dd, hole, SEEK_CUR) == -1)
+                    goto error;
+                hole = 0;
+            }
+            if (__copy_write_all(dd, buffer + start, end - start, stats) == -1)
+                goto error;
+            stats->bytes += end - start;
+        }
+    }
+
+    // la posizione finale della destinazione è comunque la fine della copia
+    if (hole > 0) {
+        stats->syscalls++;
+        if (lseek(dd, hole, SEEK_CUR) == -1)
+            goto error;
+    }
+
+    free(buffer);
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
+
+#ifdef __linux__
+
+static int __copy_with_copy_file_range(int sd, int dd, long long length,
+                                       copy_stats_t *stats) {
+    ssize_t size;
+    unsigned long long done = 0;
+
+    while (length < 0 || done < (unsigned long long)length) {
+        stats->syscalls++;
+        if ((size = copy_file_range(
+                 sd, NULL, dd, NULL,
+                 __copy_request(length, done, COPY_CHUNK_SIZE), 0)) == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (size == 0)
+            break;
+        done += size;
+        stats->bytes += size;
+    }
+
+    return 0;
+}
+
+static int __copy_with_sendfile(int sd, int dd, long long length,
+                                copy_stats_t *stats) {
+    ssize_t size;
+    unsigned long long done = 0;
+
+    while (length < 0 || done < (unsigned long long)length) {
+        stats->syscalls++;
+        if ((size = sendfile(dd, sd, NULL,
+                             __copy_request(length, done, COPY_CHUNK_SIZE))) ==
+            -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (size == 0)
+            break;
+        done += size;
+        stats->bytes += size;
+    }
+
+    return 0;
+}
+
+static bool __copy_is_pipe(int fd) {
+    struct stat sb;
+
+    return (fstat(fd, &sb) == 0 && S_ISFIFO(sb.st_mode));
+}
+
+/* riversa sulla destinazione con read/write i `size` byte rimasti nella pipe
+ * intermedia: sono già stati tolti alla sorgente e altrimenti andrebbero persi */
+static int __copy_drain_pipe(int pd, int dd, ssize_t size,
+                             copy_stats_t *stats) {
+    char buffer[BUFSIZ];
+    ssize_t got;
+
+    while (size > 0) {
+        stats->syscalls++;
+        if ((got = read(pd, buffer,
+                        (size_t)size < sizeof(buffer) ? (size_t)size
+                                                      : sizeof(buffer))) ==
+            -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (got == 0)
+            break;
+        if (__copy_write_all(dd, buffer, got, stats) == -1)
+            return -1;
+        size -= got;
+        stats->bytes += got;
+    }
+
+    return 0;
+}
+
+static int __copy_with_splice(int sd, int dd, long long length,
+                              copy_stats_t *stats) {
+    int pipe_fds[2], saved_errno;
+    ssize_t size, moved;
+    unsigned long long done = 0;
+
+    // controllato prima di togliere qualunque dato alla sorgente
+    if (__copy_is_append(dd)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // un estremo è già una pipe: basta una `splice` diretta
+    if (__copy_is_pipe(sd) || __copy_is_pipe(dd)) {
+        while (length < 0 || done < (unsigned long long)length) {
+            stats->syscalls++;
+            if ((size = splice(sd, NULL, dd, NULL,
+                               __copy_request(length, done, COPY_CHUNK_SIZE),
+                               SPLICE_F_MOVE | SPLICE_F_MORE)) == -1) {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            if (size == 0)
+                break;
+            done += size;
+            stats->bytes += size;
+        }
+        return 0;
+    }
+
+    // altrimenti sorgente -> pipe intermedia -> destinazione
+    if (pipe(pipe_fds) == -1)
+        return -1;
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, COPY_PIPE_SIZE); // se fallisce pazienza
+
+    while (length < 0 || done < (unsigned long long)length) {
+        stats->syscalls++;
+        if ((size = splice(sd, NULL, pipe_fds[1], NULL,
+                           __copy_request(length, done, COPY_PIPE_SIZE),
+                           SPLICE_F_MOVE | SPLICE_F_MORE)) == -1) {
+            if (errno == EINTR)
+                continue;
+            goto error;
+        }
+        if (size == 0)
+            break;
+        done += size;
+
+        // svuota la pipe sulla destinazione
+        while (size > 0) {
+            stats->syscalls++;
+            if ((moved = splice(pipe_fds[0], NULL, dd, NULL, size,
+                                SPLICE_F_MOVE | SPLICE_F_MORE)) == -1) {
+                if (errno == EINTR)
+                    continue;
+                saved_errno = errno;
+                if (__copy_drain_pipe(pipe_fds[0], dd, size, stats) == 0)
+                    errno = saved_errno;
+                goto error;
+            }
+            size -= moved;
+            stats->bytes += moved;
+        }
+    }
+
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    return 0;
+
+error:
+    saved_errno = errno;
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    errno = saved_errno;
+    return -1;
+}
+
+#endif
+
+/* `lib-uring` lavora su posizioni esplicite: si parte da quelle correnti dei
+ * descrittori e le si aggiorna alla fine (su una destinazione non regolare si
+ * scrive invece sulla posizione corrente, un blocco alla volta) */
+static int __copy_with_io_uring(int sd, int dd, long long length,
+                                copy_stats_t *stats) {
+    uring_stats_t uring_stats;
+    struct stat ds;
+    off_t src_offset, dst_offset = -1;
+    int result;
+
+    if ((src_offset = lseek(sd, 0, SEEK_CUR)) == -1 || fstat(dd, &ds) == -1)
+        return -1;
+    if (S_ISREG(ds.st_mode) && (dst_offset = lseek(dd, 0, SEEK_CUR)) == -1)
+        return -1;
+
+    result = uring_copy_range(sd, src_offset, dd, dst_offset, length,
+                              URING_DEFAULT_DEPTH, URING_DEFAULT_BLOCK_SIZE,
+                              &uring_stats);
+    stats->bytes += uring_stats.bytes;
+    stats->syscalls += uring_stats.submissions;
+
+    lseek(sd, src_offset + uring_stats.bytes, SEEK_SET);
+    if (dst_offset != -1)
+        lseek(dd, dst_offset + uring_stats.bytes, SEEK_SET);
+
+    return result;
+}
+
+static int __copy_with(copy_method_t method, int sd, int dd, long long length,
+                       copy_stats_t *stats) {
+    stats->method = method;
+
+    switch (method) {
+#ifdef __linux__
+    case COPY_METHOD_COPY_FILE_RANGE:
+        return __copy_with_copy_file_range(sd, dd, length, stats);
+    case COPY_METHOD_SENDFILE:
+        return __copy_with_sendfile(sd, dd, length, stats);
+    case COPY_METHOD_SPLICE:
+        return __copy_with_splice(sd, dd, length, stats);
+#endif
+    case COPY_METHOD_IO_URING:
+        return __copy_with_io_uring(sd, dd, length, stats);
+    case COPY_METHOD_READ_WRITE:
+        return __copy_with_read_write(sd, dd, length, false, stats);
+    default:
+        errno = ENOSYS;
+        return -1;
+    }
+}
+
+/* copia `length` byte: in modalità automatica prova i metodi in un ordine che
+ * dipende dalla coppia di descrittori (e, se ci riesce, fissa in
+ * `stats->method` quello scelto per le chiamate successive) */
+static int __copy_range(int sd, int dd, copy_method_t method, long long length,
+                        copy_stats_t *stats) {
+    struct stat ss, ds;
+    copy_method_t ladder[COPY_METHODS - 1];
+    unsigned long long bytes = stats->bytes;
+    int steps = 0;
+
+    if (method != COPY_METHOD_AUTO)
+        return __copy_with(method, sd, dd, length, stats);
+
+    if (fstat(sd, &ss) == -1 || fstat(dd, &ds) == -1)
+        return -1;
+    if (__copy_is_append(dd)) {
+        // nessun metodo del kernel accetta `O_APPEND` (es. `my-cat a >> b`)
+    } else if (S_ISREG(ss.st_mode) && S_ISREG(ds.st_mode)) {
+        ladder[steps++] = COPY_METHOD_COPY_FILE_RANGE;
+        ladder[steps++] = COPY_METHOD_SENDFILE;
+        ladder[steps++] = COPY_METHOD_SPLICE;
+    } else if (S_ISFIFO(ss.st_mode) || S_ISFIFO(ds.st_mode)) {
+        ladder[steps++] = COPY_METHOD_SPLICE;
+        ladder[steps++] = COPY_METHOD_SENDFILE;
+    } else {
+        ladder[steps++] = COPY_METHOD_SENDFILE;
+        ladder[steps++] = COPY_METHOD_SPLICE;
+    }
+    ladder[steps++] = COPY_METHOD_READ_WRITE;
+
+    for (int i = 0; i < steps; i++) {
+        if (__copy_with(ladder[i], sd, dd, length, stats) == 0)
+            return 0;
+        // si scende al metodo successivo solo se non si è copiato nulla (un
+        // metodo che fallisce a metà non lascia dati in sospeso: vedi
+        // `__copy_drain_pipe`)
+        if (stats->bytes > bytes || !__copy_unsupported(errno))
+            return -1;
+    }
+
+    return -1;
+}
+
+int copy_fd(int sd, int dd, copy_method_t method, copy_stats_t *stats) {
+    copy_stats_t local_stats;
+
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(copy_stats_t));
+
+    return __copy_range(sd, dd, method, -1, stats);
+}
+
+int copy_fd_sparse(int sd, int dd, copy_method_t method, bool punch_zeros,
+                   copy_stats_t *stats) {
+    copy_stats_t local_stats;
+    struct stat ss, ds;
+    off_t data, hole;
+
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(copy_stats_t));
+
+    if (fstat(sd, &ss) == -1 || fstat(dd, &ds) == -1)
+        return -1;
+    // solo tra file regolari ha senso parlare di buchi
+    if (!S_ISREG(ss.st_mode) || !S_ISREG(ds.st_mode))
+        return __copy_range(sd, dd, method, -1, stats);
+
+    // i blocchi nulli si possono riconoscere solo guardando i dati
+    if (punch_zeros)
+        method = COPY_METHOD_READ_WRITE;
+
+    // la destinazione viene riscritta da capo: i buchi sono le parti mai
+    // scritte prima del `ftruncate` finale
+    if (ftruncate(dd, 0) == -1)
+        return -1;
+
+    for (data = 0; data < ss.st_size; data = hole) {
+#ifdef SEEK_DATA
+        if ((data = lseek(sd, data, SEEK_DATA)) == -1) {
+            if (errno == ENXIO)
+                break; // solo un buco fino alla fine del file
+            if (errno != EINVAL)
+                return -1;
+            // file system senza supporto: un'unica estensione di dati
+            data = 0;
+            hole = ss.st_size;
+        } else if ((hole = lseek(sd, data, SEEK_HOLE)) == -1)
+            return -1;
+#else
+        hole = ss.st_size;
+#endif
+        if (lseek(sd, data, SEEK_SET) == -1 || lseek(dd, data, SEEK_SET) == -1)
+            return -1;
+
+        if (punch_zeros) {
+            stats->method = COPY_METHOD_READ_WRITE;
+            if (__copy_with_read_write(sd, dd, hole - data, true, stats) == -1)
+                return -1;
+        } else if (__copy_range(sd, dd, method, hole - data, stats) == -1)
+            return -1;
+        // le estensioni successive usano il metodo trovato con la prima
+        method = stats->method;
+    }
+
+    // ricrea l'eventuale buco finale e fissa la dimensione
+    if (ftruncate(dd, ss.st_size) == -1)
+        return -1;
+    stats->holes = ss.st_size - stats->bytes;
+
+    return 0;
+}
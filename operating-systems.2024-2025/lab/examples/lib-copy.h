@@ -0,0 +1,64 @@
+/*
+ * libreria di servizio ufficiosa per copiare il contenuto di un descrittore su
+ * un altro evitando, quando possibile, il passaggio dei dati in un buffer
+ * utente: i metodi sono provati in ordine (copy_file_range -> sendfile ->
+ * splice attraverso una pipe -> read/write con un buffer grande) e in
+ * modalità automatica si scende al successivo se il primo tentativo fallisce
+ * perché la coppia sorgente/destinazione non è supportata (es. file system
+ * diversi, destinazione non regolare, sistema non Linux).
+ *
+ * il metodo `io_uring` (da chiedere esplicitamente, vedi `lib-uring`) copia
+ * da un file regolare tenendo in volo più letture e scritture con una sola
+ * chiamata di sistema per gruppo di richieste.
+ *
+ * la copia "sparsa" percorre solo le estensioni di dati della sorgente
+ * (`lseek` con `SEEK_DATA`/`SEEK_HOLE`) lasciando buchi nella destinazione al
+ * posto di quelli della sorgente e, a richiesta, anche al posto dei blocchi
+ * tutti nulli di una sorgente densa.
+ */
+
+#ifndef LIB_OSLAB_COPY_H
+#define LIB_OSLAB_COPY_H
+
+#include "lib-misc.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define COPY_BUFFER_SIZE (1 << 20) // buffer dell'ultima risorsa read/write
+#define COPY_CHUNK_SIZE (1L << 30) // massimo per singola chiamata zero-copy
+
+typedef enum {
+    COPY_METHOD_AUTO,
+    COPY_METHOD_COPY_FILE_RANGE,
+    COPY_METHOD_SENDFILE,
+    COPY_METHOD_SPLICE,
+    COPY_METHOD_IO_URING,
+    COPY_METHOD_READ_WRITE,
+    COPY_METHODS
+} copy_method_t;
+
+extern const char *copy_method_names[COPY_METHODS];
+
+typedef struct {
+    copy_method_t method;    // metodo effettivamente usato
+    unsigned long long bytes; // byte copiati
+    unsigned long long holes; // byte lasciati come buchi (copia sparsa)
+    unsigned long syscalls;  // chiamate di sistema di trasferimento eseguite
+} copy_stats_t;
+
+/* restituisce il metodo con nome `name` o -1 se non esiste */
+int copy_method_from_name(const char *name);
+
+/* copia da `sd` (dalla posizione corrente) fino alla fine su `dd`: restituisce
+ * 0 o -1 con `errno` impostato; `stats` (opzionale) viene azzerato e
+ * riempito */
+int copy_fd(int sd, int dd, copy_method_t method, copy_stats_t *stats);
+
+/* come `copy_fd` ma, tra file regolari, copia dall'inizio solo le estensioni
+ * di dati (la destinazione viene troncata e riportata alla dimensione della
+ * sorgente); con `punch_zeros` anche i blocchi nulli diventano buchi (e la
+ * copia usa necessariamente read/write) */
+int copy_fd_sparse(int sd, int dd, copy_method_t method, bool punch_zeros,
+                   copy_stats_t *stats);
+
+#endif /* LIB_OSLAB_COPY_H */
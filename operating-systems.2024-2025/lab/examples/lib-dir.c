@@ -0,0 +1,462 @@
+/*
+ * libreria di servizio ufficiosa per scandire le directory a lotti (vedi
+ * `lib-dir.h`)
+ *
+ * `getdents64` riempie il buffer con record di lunghezza variabile uno dopo
+ * l'altro: ogni record ha inode, lunghezza del record (`d_reclen`, già
+ * allineata), tipo e nome terminato da zero; il buffer viene riletto solo
+ * quando tutti i record del lotto precedente sono stati consumati.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // per `syscall`, `statx` e le costanti `DT_*`
+#endif
+
+#include "lib-dir.h"
+#include "lib-work-stealing.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#ifdef SYS_getdents64
+#define DIR_GETDENTS
+#endif
+#endif
+
+#ifdef DIR_GETDENTS
+/* il record di `getdents64` (la glibc non lo espone sempre) */
+struct __linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+static bool __is_dot_or_dotdot(const char *name) {
+    return (name[0] == '.' &&
+            (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')));
+}
+
+static dir_entry_type_t __type_from_mode(mode_t mode) {
+    if (S_ISREG(mode))
+        return DIR_ENTRY_FILE;
+    if (S_ISDIR(mode))
+        return DIR_ENTRY_DIR;
+    if (S_ISLNK(mode))
+        return DIR_ENTRY_SYMLINK;
+    return DIR_ENTRY_OTHER;
+}
+
+/* tipo di una voce `DT_UNKNOWN`: `statx` chiede solo il tipo (il file system
+ * può evitare di aggiornare il resto), `fstatat` dove non c'è */
+static int __stat_type(dir_scan_t *scan, const char *name,
+                       dir_entry_type_t *type) {
+    struct stat sb;
+
+    scan->stats++;
+#ifdef STATX_TYPE
+    struct statx stx;
+
+    if (statx(scan->fd, name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+              STATX_TYPE, &stx) == 0) {
+        *type = __type_from_mode(stx.stx_mode);
+        return 0;
+    }
+    if (errno != ENOSYS)
+        return -1;
+#endif
+    if (fstatat(scan->fd, name, &sb, AT_SYMLINK_NOFOLLOW) == -1)
+        return -1;
+    *type = __type_from_mode(sb.st_mode);
+
+    return 0;
+}
+
+#ifdef DT_UNKNOWN
+/* tipo dal campo `d_type`: -1 se il file system non lo ha fornito */
+static int __type_from_dtype(unsigned char d_type) {
+    switch (d_type) {
+    case DT_REG:
+        return DIR_ENTRY_FILE;
+    case DT_DIR:
+        return DIR_ENTRY_DIR;
+    case DT_LNK:
+        return DIR_ENTRY_SYMLINK;
+    case DT_UNKNOWN:
+        return -1;
+    default:
+        return DIR_ENTRY_OTHER;
+    }
+}
+#endif
+
+int dir_scan_open(dir_scan_t *scan, int dirfd, const char *path) {
+    int fd;
+
+    if ((fd = openat(dirfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return -1;
+
+    return dir_scan_fdopen(scan, fd);
+}
+
+int dir_scan_fdopen(dir_scan_t *scan, int fd) {
+    memset(scan, 0, sizeof(*scan));
+    scan->fd = fd;
+
+#ifdef DIR_GETDENTS
+    if ((scan->buffer = malloc(DIR_SCAN_BUFFER_SIZE)) == NULL) {
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+#else
+    // `fdopendir` si prende il descrittore, che resta usabile per le `*at`
+    if ((scan->dir = fdopendir(fd)) == NULL) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+int dir_scan_next(dir_scan_t *scan, dir_entry_t *entry) {
+    int type;
+
+#ifdef DIR_GETDENTS
+    struct __linux_dirent64 *record;
+    long n;
+
+    do {
+        // lotto esaurito: ne legge un altro
+        if (scan->pos >= scan->used) {
+            if ((n = syscall(SYS_getdents64, scan->fd, scan->buffer,
+                             DIR_SCAN_BUFFER_SIZE)) == -1)
+                return -1;
+            if (n == 0)
+                return 0;
+            scan->batches++;
+            scan->used = n;
+            scan->pos = 0;
+        }
+        record = (struct __linux_dirent64 *)(scan->buffer + scan->pos);
+        scan->pos += record->d_reclen;
+    } while (__is_dot_or_dotdot(record->d_name));
+
+    entry->name = record->d_name;
+    entry->ino = record->d_ino;
+    type = __type_from_dtype(record->d_type);
+#else
+    struct dirent *record;
+
+    do {
+        errno = 0;
+        if ((record = readdir((DIR *)scan->dir)) == NULL)
+            return (errno == 0 ? 0 : -1);
+        scan->batches++;
+    } while (__is_dot_or_dotdot(record->d_name));
+
+    entry->name = record->d_name;
+    entry->ino = record->d_ino;
+#ifdef DT_UNKNOWN
+    type = __type_from_dtype(record->d_type);
+#else
+    type = -1;
+#endif
+#endif
+
+    if (type == -1) {
+        dir_entry_type_t stat_type;
+
+        if (__stat_type(scan, entry->name, &stat_type) == -1)
+            return -1;
+        type = stat_type;
+    }
+    entry->type = (dir_entry_type_t)type;
+
+    return 1;
+}
+
+int dir_scan_size(dir_scan_t *scan, const dir_entry_t *entry, off_t *size) {
+    struct stat sb;
+
+#ifdef STATX_SIZE
+    struct statx stx;
+
+    if (statx(scan->fd, entry->name, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+              STATX_SIZE, &stx) == 0) {
+        *size = stx.stx_size;
+        return 0;
+    }
+    if (errno != ENOSYS)
+        return -1;
+#endif
+    if (fstatat(scan->fd, entry->name, &sb, AT_SYMLINK_NOFOLLOW) == -1)
+        return -1;
+    *size = sb.st_size;
+
+    return 0;
+}
+
+void dir_scan_close(dir_scan_t *scan) {
+    if (scan->dir != NULL)
+        closedir((DIR *)scan->dir); // chiude anche `fd`
+    else
+        close(scan->fd);
+    free(scan->buffer);
+    scan->fd = -1;
+}
+
+/* visita parallela: ogni directory è un nodo con il proprio output; in
+ * modalità ordinata il nodo ricorda per ogni sottodirectory in che punto del
+ * proprio output va inserito quello del figlio, così alla fine l'albero dei
+ * nodi si riscrive in profondità esattamente come una visita sequenziale */
+
+#define DIR_WALK_MAX_OPEN 256 // sottodirectory in attesa con il descrittore
+#define DIR_OUTPUT_MIN_SIZE 4096
+
+struct dir_output {
+    char *data;
+    size_t used, size;
+};
+
+typedef struct dir_walk_node dir_walk_node_t;
+
+typedef struct {
+    size_t offset; // punto dell'output del padre
+    dir_walk_node_t *node_ptr;
+} dir_walk_child_t;
+
+typedef struct {
+    ws_pool_t pool;
+    ws_group_t group;
+    bool ordered;
+    FILE *out;
+    dir_walk_function_t function;
+    void *arg;
+    long open_fds;          // descrittori delle sottodirectory in attesa
+    dir_walk_stats_t stats; // aggiornate atomicamente
+    int error;              // primo errore incontrato
+} dir_walk_data_t;
+
+struct dir_walk_node {
+    char *path;
+    int fd; // -1: da aprire per percorso (troppi descrittori in attesa)
+    int depth;
+    dir_output_t out;
+    dir_walk_child_t *children;
+    size_t num_children, max_children;
+    dir_walk_data_t *walk_ptr;
+};
+
+static void __dir_output_reserve(dir_output_t *out, size_t bytes) {
+    if (out->used + bytes <= out->size)
+        return;
+    out->size = (out->size == 0 ? DIR_OUTPUT_MIN_SIZE : out->size * 2);
+    if (out->size < out->used + bytes)
+        out->size = out->used + bytes;
+    if ((out->data = realloc(out->data, out->size)) == NULL)
+        exit_with_sys_err("realloc");
+}
+
+void dir_output_printf(dir_output_t *out, const char *format, ...) {
+    va_list args;
+    int n;
+
+    va_start(args, format);
+    n = vsnprintf(out->data + out->used, out->size - out->used, format, args);
+    va_end(args);
+    if (n < 0)
+        return;
+    if ((size_t)n >= out->size - out->used) {
+        // non ci stava: allarga e riprova
+        __dir_output_reserve(out, n + 1);
+        va_start(args, format);
+        vsnprintf(out->data + out->used, out->size - out->used, format, args);
+        va_end(args);
+    }
+    out->used += n;
+}
+
+static void __dir_walk_error(dir_walk_data_t *walk, const char *path) {
+    int expected = 0, e = errno;
+
+    fprintf(stderr, "%s: %s\n", path, strerror(e));
+    __atomic_compare_exchange_n(&walk->error, &expected, e, false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static dir_walk_node_t *__dir_walk_node_new(dir_walk_data_t *walk,
+                                            const char *parent,
+                                            const char *name, int depth) {
+    dir_walk_node_t *node;
+    size_t length = strlen(parent) + 1 + strlen(name) + 1;
+
+    if ((node = calloc(1, sizeof(dir_walk_node_t))) == NULL ||
+        (node->path = malloc(length)) == NULL)
+        exit_with_sys_err("malloc");
+    if (parent[0] != '\0')
+        snprintf(node->path, length, "%s/%s", parent, name);
+    else
+        strcpy(node->path, name);
+    node->fd = -1;
+    node->depth = depth;
+    node->walk_ptr = walk;
+
+    return node;
+}
+
+static void __dir_walk_node_free(dir_walk_node_t *node) {
+    free(node->out.data);
+    free(node->children);
+    free(node->path);
+    free(node);
+}
+
+static void __dir_walk_task(void *arg);
+
+/* accoda la sottodirectory `name` di `node` (aperta ora se possibile) */
+static void __dir_walk_descend(dir_walk_node_t *node, int dirfd,
+                               const char *name) {
+    dir_walk_data_t *walk = node->walk_ptr;
+    dir_walk_node_t *child =
+        __dir_walk_node_new(walk, node->path, name, node->depth + 1);
+
+    if (__atomic_add_fetch(&walk->open_fds, 1, __ATOMIC_RELAXED) <=
+        DIR_WALK_MAX_OPEN) {
+        if ((child->fd = openat(dirfd, name,
+                                O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+            __atomic_sub_fetch(&walk->open_fds, 1, __ATOMIC_RELAXED);
+            if (errno != EMFILE && errno != ENFILE) {
+                __dir_walk_error(walk, child->path);
+                __dir_walk_node_free(child);
+                return;
+            }
+        }
+    } else
+        __atomic_sub_fetch(&walk->open_fds, 1, __ATOMIC_RELAXED);
+
+    if (walk->ordered) {
+        if (node->num_children == node->max_children) {
+            node->max_children =
+                (node->max_children == 0 ? 16 : node->max_children * 2);
+            if ((node->children =
+                     realloc(node->children, node->max_children *
+                                                 sizeof(dir_walk_child_t))) ==
+                NULL)
+                exit_with_sys_err("realloc");
+        }
+        node->children[node->num_children].offset = node->out.used;
+        node->children[node->num_children++].node_ptr = child;
+    }
+    ws_spawn(&walk->pool, &walk->group, __dir_walk_task, child);
+}
+
+/* il compito di una directory: ne scandisce le voci e accoda le
+ * sottodirectory come nuovi compiti */
+static void __dir_walk_task(void *arg) {
+    dir_walk_node_t *node = (dir_walk_node_t *)arg;
+    dir_walk_data_t *walk = node->walk_ptr;
+    dir_scan_t scan;
+    dir_entry_t entry;
+    dir_visit_t visit = {&entry, node->path, -1, node->depth};
+    unsigned long long entries = 0;
+    int ret;
+
+    if (node->fd != -1)
+        __atomic_sub_fetch(&walk->open_fds, 1, __ATOMIC_RELAXED);
+    else if ((node->fd = open(node->path,
+                              O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+        __dir_walk_error(walk, node->path);
+        goto done;
+    }
+    if (dir_scan_fdopen(&scan, node->fd) == -1) {
+        __dir_walk_error(walk, node->path);
+        goto done;
+    }
+    visit.dirfd = scan.fd;
+
+    while ((ret = dir_scan_next(&scan, &entry)) == 1) {
+        entries++;
+        if (walk->function(&visit, &node->out, walk->arg) &&
+            entry.type == DIR_ENTRY_DIR)
+            __dir_walk_descend(node, scan.fd, entry.name);
+    }
+    if (ret == -1)
+        __dir_walk_error(walk, node->path);
+
+    __atomic_add_fetch(&walk->stats.entries, entries, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&walk->stats.directories, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&walk->stats.batches, scan.batches, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&walk->stats.stats, scan.stats, __ATOMIC_RELAXED);
+    dir_scan_close(&scan);
+
+done:
+    // senza ordine l'output della directory esce subito (una `fwrite` sola,
+    // quindi non si mescola con quello delle altre)
+    if (!walk->ordered) {
+        if (walk->out != NULL && node->out.used > 0)
+            fwrite(node->out.data, 1, node->out.used, walk->out);
+        __dir_walk_node_free(node);
+    }
+}
+
+/* scrive l'output di `node` inserendo al posto giusto quello dei figli */
+static void __dir_walk_emit(dir_walk_node_t *node, FILE *out) {
+    size_t pos = 0;
+
+    for (size_t i = 0; i < node->num_children; i++) {
+        dir_walk_child_t *child = &node->children[i];
+
+        if (out != NULL)
+            fwrite(node->out.data + pos, 1, child->offset - pos, out);
+        pos = child->offset;
+        __dir_walk_emit(child->node_ptr, out);
+    }
+    if (out != NULL && node->out.used > pos)
+        fwrite(node->out.data + pos, 1, node->out.used - pos, out);
+    __dir_walk_node_free(node);
+}
+
+int dir_walk(const char *root, unsigned int threads, bool ordered, FILE *out,
+             dir_walk_function_t function, void *arg, dir_walk_stats_t *stats) {
+    dir_walk_data_t walk;
+    dir_walk_node_t *node;
+
+    memset(&walk, 0, sizeof(walk));
+    walk.ordered = ordered;
+    walk.out = out;
+    walk.function = function;
+    walk.arg = arg;
+
+    node = __dir_walk_node_new(&walk, "", root, 0);
+    ws_pool_init(&walk.pool, (threads > 0 ? threads : 1));
+    ws_group_init(&walk.group);
+    ws_spawn(&walk.pool, &walk.group, __dir_walk_task, node);
+    ws_sync(&walk.pool, &walk.group);
+    ws_pool_destroy(&walk.pool);
+
+    if (ordered)
+        __dir_walk_emit(node, out);
+    if (stats != NULL)
+        *stats = walk.stats;
+    if (walk.error != 0) {
+        errno = walk.error;
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * libreria di servizio ufficiosa per scandire il contenuto di una directory
+ * con poche chiamate di sistema anche su alberi con milioni di voci:
+ * - le voci sono lette a lotti con `getdents64` in un buffer grande
+ *   (`DIR_SCAN_BUFFER_SIZE`) invece che una alla volta attraverso `readdir`
+ * - il tipo di ogni voce viene preso dal campo `d_type` del lotto e solo se il
+ *   file system non lo fornisce (`DT_UNKNOWN`) si interroga l'inode con
+ *   `statx` chiedendo il solo tipo (`STATX_TYPE`)
+ * - le sottodirectory e le informazioni sulle voci sono aperte e lette
+ *   relativamente al descrittore della directory (`openat`, `statx`/`fstatat`)
+ *   senza comporre percorsi e senza cambiare la directory corrente
+ *
+ * sui sistemi diversi da Linux si ripiega su `fdopendir`/`readdir` e
+ * `fstatat` con la stessa interfaccia.
+ *
+ * `dir_walk` visita un intero albero in parallelo con il pool di
+ * `lib-work-stealing`: ogni directory è un compito che ne scandisce le voci,
+ * apre le sottodirectory (`openat` sul proprio descrittore) e le accoda come
+ * nuovi compiti, che i lavoratori liberi possono rubare; l'output prodotto per
+ * ogni directory viene scritto appena la directory è finita (ordine libero, il
+ * più veloce) oppure, in modalità ordinata, ricomposto alla fine nello stesso
+ * ordine della visita in profondità sequenziale.
+ */
+
+#ifndef LIB_OSLAB_DIR_H
+#define LIB_OSLAB_DIR_H
+
+#include "lib-misc.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define DIR_SCAN_BUFFER_SIZE (256 * 1024) // byte di voci per `getdents64`
+
+typedef enum {
+    DIR_ENTRY_FILE,    // file regolare
+    DIR_ENTRY_DIR,     // directory
+    DIR_ENTRY_SYMLINK, // collegamento simbolico (non seguito)
+    DIR_ENTRY_OTHER    // dispositivi, pipe con nome, socket
+} dir_entry_type_t;
+
+typedef struct {
+    const char *name;       // valido fino alla successiva `dir_scan_next`
+    unsigned long long ino; // numero di inode
+    dir_entry_type_t type;
+} dir_entry_t;
+
+typedef struct {
+    int fd;       // descrittore della directory (per le chiamate `*at`)
+    char *buffer; // lotto di voci corrente
+    size_t used;  // byte validi nel lotto
+    size_t pos;   // prossima voce da restituire
+    void *dir;    // `DIR *` della versione con `readdir`
+    unsigned long batches; // lotti letti (chiamate di lettura eseguite)
+    unsigned long stats;   // voci di tipo sconosciuto interrogate sull'inode
+} dir_scan_t;
+
+/* l'output di una directory durante `dir_walk` (vedi `dir_output_printf`) */
+typedef struct dir_output dir_output_t;
+
+/* una voce incontrata da `dir_walk` */
+typedef struct {
+    const dir_entry_t *entry;
+    const char *path; // percorso della directory che contiene la voce
+    int dirfd;        // descrittore della stessa directory (per le `*at`)
+    int depth;        // 0 per le voci della radice
+} dir_visit_t;
+
+/* chiamata per ogni voce: restituisce true se `dir_walk` deve scendere nella
+ * voce (conta solo per le directory); le voci della stessa directory sono
+ * visitate in sequenza ma directory diverse lo sono in parallelo da
+ * lavoratori diversi, quindi lo stato condiviso tra chiamate va protetto */
+typedef bool (*dir_walk_function_t)(const dir_visit_t *visit,
+                                    dir_output_t *out, void *arg);
+
+typedef struct {
+    unsigned long long entries;     // voci visitate
+    unsigned long long directories; // directory scandite
+    unsigned long long batches;     // lotti di voci letti
+    unsigned long long stats;       // voci interrogate sull'inode
+} dir_walk_stats_t;
+
+/* apre la directory `path` relativa al descrittore di directory `dirfd` (o
+ * alla directory corrente con `AT_FDCWD`) e prepara `scan`: restituisce 0 o
+ * -1 con `errno` impostato */
+int dir_scan_open(dir_scan_t *scan, int dirfd, const char *path);
+
+/* come `dir_scan_open` ma su una directory già aperta: `fd` passa a `scan`
+ * (e viene chiuso da `dir_scan_close`, anche in caso di errore) */
+int dir_scan_fdopen(dir_scan_t *scan, int fd);
+
+/* mette in `entry` la voce successiva saltando `.` e `..`: restituisce 1, 0 a
+ * fine directory o -1 con `errno` impostato */
+int dir_scan_next(dir_scan_t *scan, dir_entry_t *entry);
+
+/* legge la dimensione della voce `entry` (senza seguire i collegamenti
+ * simbolici) chiedendo al kernel solo quella: 0 o -1 con `errno` impostato */
+int dir_scan_size(dir_scan_t *scan, const dir_entry_t *entry, off_t *size);
+
+/* chiude la directory e libera il buffer dei lotti */
+void dir_scan_close(dir_scan_t *scan);
+
+/* visita l'albero sotto `root` con `threads` lavoratori chiamando `function`
+ * per ogni voce; ciò che `function` scrive con `dir_output_printf` finisce su
+ * `out` (se non NULL) a blocchi di una directory alla volta, oppure con
+ * `ordered` esattamente nell'ordine di una visita in profondità sequenziale
+ * (tenendolo in memoria fino alla fine della visita); restituisce 0 o -1 con
+ * `errno` impostato e il messaggio d'errore sullo standard error (la visita
+ * delle altre directory prosegue comunque); `stats` è opzionale */
+int dir_walk(const char *root, unsigned int threads, bool ordered, FILE *out,
+             dir_walk_function_t function, void *arg, dir_walk_stats_t *stats);
+
+/* aggiunge testo formattato come con `printf` all'output della directory */
+void dir_output_printf(dir_output_t *out, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#endif /* LIB_OSLAB_DIR_H */
@@ -7,9 +7,568 @@
  * - fornire un layer di compatibilità (leggi "hack") per i sistemi Apple per
  *   supplire al mancato supporto di alcune chiamate POSIX (semafori numerici
  *   e barriere)
+ * - misurare il tempo trascorso con un orologio monotono (per i benchmark)
+ * - contare righe, parole e byte di un testo in un solo passaggio (come `wc`),
+ *   contare le occorrenze di una parola e invertire blocchi di byte, con
+ *   istruzioni vettoriali SSE2/AVX2 dove disponibili
+ * - contare in un solo passaggio le occorrenze di un intero insieme di parole
+ *   con un automa a tabella densa
  */
 
 #include "lib-misc.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h> // intrinseci AVX2 (compilando con `-mavx2`)
+#elif defined(__SSE2__)
+#include <emmintrin.h> // intrinseci SSE2 (sempre presenti su x86-64)
+#endif
+
+double seconds_now(void) {
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+        exit_with_sys_err("clock_gettime");
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* conteggio di righe, parole e byte: per ogni blocco di 32 (AVX2) o 16 (SSE2)
+ * byte si costruiscono con un confronto vettoriale due maschere di bit, una
+ * per i `\n` e una per gli spazi bianchi; le righe sono i bit della prima,
+ * le parole i byte non-spazio preceduti da uno spazio, cioè i bit di
+ * `~spazi & ((spazi << 1) | riporto)` dove il riporto è l'ultimo bit del
+ * blocco precedente: nessun salto condizionale per byte */
+
+static inline bool __wc_is_space(unsigned char c) {
+    return (c == ' ' || (c >= '\t' && c <= '\r'));
+}
+
+void wc_count_scalar(wc_counts_t *counts, const char *data, size_t size) {
+    bool in_word = counts->in_word;
+
+    for (size_t i = 0; i < size; i++) {
+        unsigned char c = data[i];
+        if (c == '\n')
+            counts->lines++;
+        if (__wc_is_space(c))
+            in_word = false;
+        else if (!in_word) {
+            in_word = true;
+            counts->words++;
+        }
+    }
+    counts->bytes += size;
+    counts->in_word = in_word;
+}
+
+void wc_count(wc_counts_t *counts, const char *data, size_t size) {
+    size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    // bit 1 se il byte che precede il blocco è uno spazio (o se si è all'inizio)
+    unsigned int carry = !counts->in_word;
+    unsigned long long lines = 0, words = 0;
+
+#if defined(__AVX2__)
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i blank = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8('\r' - '\t');
+
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        // `c - '\t'` (senza segno) <= 4 sse `c` è tra `\t` e `\r`
+        __m256i shifted = _mm256_sub_epi8(v, tab);
+        __m256i controls = _mm256_cmpeq_epi8(
+            _mm256_min_epu8(shifted, four), shifted);
+        unsigned int spaces = (unsigned int)_mm256_movemask_epi8(
+            _mm256_or_si256(controls, _mm256_cmpeq_epi8(v, blank)));
+        unsigned int newlines =
+            (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline));
+
+        lines += __builtin_popcount(newlines);
+        words += __builtin_popcount(~spaces & ((spaces << 1) | carry));
+        carry = spaces >> 31;
+    }
+#else
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i blank = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8('\r' - '\t');
+
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i shifted = _mm_sub_epi8(v, tab);
+        __m128i controls =
+            _mm_cmpeq_epi8(_mm_min_epu8(shifted, four), shifted);
+        unsigned int spaces = (unsigned int)_mm_movemask_epi8(
+            _mm_or_si128(controls, _mm_cmpeq_epi8(v, blank)));
+        unsigned int newlines =
+            (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+
+        lines += __builtin_popcount(newlines);
+        words += __builtin_popcount(~spaces & 0xffff &
+                                    ((spaces << 1) | carry));
+        carry = spaces >> 15;
+    }
+#endif
+
+    counts->lines += lines;
+    counts->words += words;
+    counts->bytes += i;
+    counts->in_word = !carry;
+#endif
+
+    // la coda (o tutto, senza SIMD) byte per byte
+    wc_count_scalar(counts, data + i, size - i);
+}
+
+/* ricerca di una parola: un candidato che inizia in `i` deve avere il primo
+ * byte uguale al primo della parola, il byte `i + length - 1` uguale
+ * all'ultimo, uno spazio (o l'inizio) prima e uno spazio (o la fine) dopo;
+ * le quattro condizioni sono verificate per 32 (AVX2) o 16 (SSE2) posizioni
+ * alla volta con quattro caricamenti sfalsati e solo le posizioni che le
+ * superano tutte vengono confrontate per intero; maiuscole e minuscole si
+ * equivalgono mettendo a 1 il bit 0x20 (che le distingue) sia nel testo sia
+ * nella parola, ma solo se il carattere della parola è una lettera: per una
+ * lettera minuscola `c` si ha `(b | 0x20) == c` solo per `b` uguale a `c` o
+ * alla sua maiuscola */
+
+static inline unsigned char __ascii_lower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z' ? c | 0x20 : c);
+}
+
+static inline bool __ascii_is_letter(unsigned char c) {
+    c = __ascii_lower(c);
+    return (c >= 'a' && c <= 'z');
+}
+
+/* vero se la parola si trova, intera, alla posizione `i` */
+static inline bool __word_at(const char *data, size_t size, size_t i,
+                             const char *word, size_t length) {
+    if ((i > 0 && !__wc_is_space(data[i - 1])) ||
+        (i + length < size && !__wc_is_space(data[i + length])))
+        return false;
+    for (size_t j = 0; j < length; j++)
+        if (__ascii_lower(data[i + j]) != __ascii_lower(word[j]))
+            return false;
+    return true;
+}
+
+/* la parola non può essere trovata se è vuota o contiene spazi */
+static bool __word_is_valid(const char *word, size_t length) {
+    if (length == 0)
+        return false;
+    for (size_t j = 0; j < length; j++)
+        if (__wc_is_space(word[j]))
+            return false;
+    return true;
+}
+
+unsigned long long word_count_scalar(const char *data, size_t size,
+                                     const char *word, size_t length) {
+    unsigned long long count = 0;
+    size_t i = 0, begin;
+
+    if (!__word_is_valid(word, length))
+        return 0;
+
+    while (i < size) {
+        // salta gli spazi, poi misura la parola
+        while (i < size && __wc_is_space(data[i]))
+            i++;
+        for (begin = i; i < size && !__wc_is_space(data[i]); i++)
+            ;
+        if (i - begin == length && __word_at(data, size, begin, word, length))
+            count++;
+    }
+
+    return count;
+}
+
+unsigned long long word_count(const char *data, size_t size, const char *word,
+                              size_t length) {
+    unsigned long long count = 0;
+    size_t i = 0;
+
+    if (!__word_is_valid(word, length) || length > size)
+        return 0;
+
+    // la posizione 0 non ha un byte precedente da caricare
+    if (__word_at(data, size, 0, word, length))
+        count++;
+    i = 1;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    const unsigned char first = __ascii_lower(word[0]);
+    const unsigned char last = __ascii_lower(word[length - 1]);
+    const char first_fold = (__ascii_is_letter(first) ? 0x20 : 0);
+    const char last_fold = (__ascii_is_letter(last) ? 0x20 : 0);
+    unsigned int mask;
+
+#if defined(__AVX2__)
+    const __m256i first_v = _mm256_set1_epi8(first);
+    const __m256i last_v = _mm256_set1_epi8(last);
+    const __m256i first_fold_v = _mm256_set1_epi8(first_fold);
+    const __m256i last_fold_v = _mm256_set1_epi8(last_fold);
+    const __m256i blank = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i four = _mm256_set1_epi8('\r' - '\t');
+#define __WORD_SPACES(v)                                                       \
+    _mm256_or_si256(                                                           \
+        _mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_sub_epi8((v), tab), four),    \
+                          _mm256_sub_epi8((v), tab)),                          \
+        _mm256_cmpeq_epi8((v), blank))
+
+    for (; i + length + 32 <= size; i += 32) {
+        __m256i before = _mm256_loadu_si256((const __m256i *)(data + i - 1));
+        __m256i head = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i tail =
+            _mm256_loadu_si256((const __m256i *)(data + i + length - 1));
+        __m256i after =
+            _mm256_loadu_si256((const __m256i *)(data + i + length));
+        __m256i candidates = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_or_si256(head, first_fold_v), first_v),
+                _mm256_cmpeq_epi8(_mm256_or_si256(tail, last_fold_v), last_v)),
+            _mm256_and_si256(__WORD_SPACES(before), __WORD_SPACES(after)));
+        mask = (unsigned int)_mm256_movemask_epi8(candidates);
+#else
+    const __m128i first_v = _mm_set1_epi8(first);
+    const __m128i last_v = _mm_set1_epi8(last);
+    const __m128i first_fold_v = _mm_set1_epi8(first_fold);
+    const __m128i last_fold_v = _mm_set1_epi8(last_fold);
+    const __m128i blank = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i four = _mm_set1_epi8('\r' - '\t');
+#define __WORD_SPACES(v)                                                       \
+    _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8((v), tab), four),    \
+                                _mm_sub_epi8((v), tab)),                       \
+                 _mm_cmpeq_epi8((v), blank))
+
+    for (; i + length + 16 <= size; i += 16) {
+        __m128i before = _mm_loadu_si128((const __m128i *)(data + i - 1));
+        __m128i head = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(data + i + length - 1));
+        __m128i after = _mm_loadu_si128((const __m128i *)(data + i + length));
+        __m128i candidates = _mm_and_si128(
+            _mm_and_si128(
+                _mm_cmpeq_epi8(_mm_or_si128(head, first_fold_v), first_v),
+                _mm_cmpeq_epi8(_mm_or_si128(tail, last_fold_v), last_v)),
+            _mm_and_si128(__WORD_SPACES(before), __WORD_SPACES(after)));
+        mask = (unsigned int)_mm_movemask_epi8(candidates);
+#endif
+        // un confronto completo per ogni candidato rimasto
+        for (; mask != 0; mask &= mask - 1)
+            if (__word_at(data, size, i + __builtin_ctz(mask), word, length))
+                count++;
+    }
+#undef __WORD_SPACES
+#endif
+
+    // la coda (o tutto, senza SIMD) una posizione alla volta
+    for (; i + length <= size; i++)
+        if (__word_at(data, size, i, word, length))
+            count++;
+
+    return count;
+}
+
+long long word_count_file(const char *pathname, const char *word) {
+    struct stat sb;
+    char *data;
+    unsigned long long count;
+    int fd, saved_errno;
+
+    if ((fd = open(pathname, O_RDONLY)) == -1)
+        return -1;
+    if (fstat(fd, &sb) == -1)
+        goto error;
+    if (sb.st_size == 0) { // un file vuoto non si può mappare
+        close(fd);
+        return 0;
+    }
+    if ((data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) ==
+        MAP_FAILED)
+        goto error;
+    close(fd);
+
+    count = word_count(data, sb.st_size, word, strlen(word));
+    munmap(data, sb.st_size);
+
+    return count;
+
+error:
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+}
+
+/* insiemi di parole: l'automa di Aho-Corasick riconosce più parole in un
+ * solo passaggio seguendo una transizione per byte; dato che qui una parola
+ * conta solo se occupa un'intera sequenza di non-spazi, una corrispondenza
+ * può iniziare solo dopo uno spazio e i collegamenti di fallimento
+ * dell'automa si riducono a due casi: uno spazio riporta alla radice, un
+ * byte che esce dal trie porta in uno stato "morto" fino al prossimo spazio.
+ * la tabella delle transizioni è densa ma su un alfabeto compresso: i byte
+ * che compaiono nelle parole (senza distinguere maiuscole e minuscole ASCII)
+ * hanno una classe ciascuna, gli spazi la classe 0 e tutti gli altri byte
+ * un'unica classe; le righe hanno un numero di colonne potenza di 2 e le
+ * transizioni puntano direttamente all'inizio della riga di arrivo, così il
+ * ciclo interno è un solo accesso in tabella per byte; gli stati finali sono
+ * rinumerati in fondo alla tabella, così "uno spazio chiude una parola" è un
+ * unico confronto (`classe == 0` e riga oltre `first_final`) che è falso
+ * quasi sempre e il processore lo predice senza errori */
+
+#define WORD_SET_ROOT 0
+#define WORD_SET_DEAD 1u
+
+/* rinumera gli stati mettendo in fondo quelli finali (radice e stato morto
+ * non lo sono mai, quindi restano 0 e 1) */
+static int __word_set_finals_last(word_set_t *set, unsigned int columns) {
+    unsigned int *ids = NULL, *next = NULL, num_finals = 0, plain = 0, s, k;
+    bool *final = NULL;
+
+    if ((final = calloc(set->num_states, sizeof(bool))) == NULL ||
+        (ids = malloc(set->num_states * sizeof(unsigned int))) == NULL ||
+        (next = malloc((size_t)set->num_states * columns *
+                       sizeof(unsigned int))) == NULL) {
+        free(final);
+        free(ids);
+        word_set_destroy(set);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (unsigned int w = 0; w < set->num_words; w++)
+        if (!final[set->final_rows[w] >> set->shift]) {
+            final[set->final_rows[w] >> set->shift] = true;
+            num_finals++;
+        }
+    for (s = 0; s < set->num_states; s++)
+        ids[s] = (final[s] ? set->num_states - num_finals + (s - plain)
+                           : plain++);
+
+    for (s = 0; s < set->num_states; s++)
+        for (k = 0; k < columns; k++)
+            next[(ids[s] << set->shift) + k] =
+                ids[set->next[(s << set->shift) + k] >> set->shift]
+                << set->shift;
+    for (unsigned int w = 0; w < set->num_words; w++)
+        set->final_rows[w] = ids[set->final_rows[w] >> set->shift]
+                             << set->shift;
+    set->first_final = (set->num_states - num_finals) << set->shift;
+
+    free(set->next);
+    set->next = next;
+    free(ids);
+    free(final);
+
+    return 0;
+}
+
+int word_set_init(word_set_t *set, const char *const *words,
+                  unsigned int num_words) {
+    unsigned int num_classes = 1, columns, max_states = 2, state, j;
+    size_t length;
+
+    memset(set, 0, sizeof(*set));
+
+    // una classe per ogni byte (ripiegato in minuscolo) usato dalle parole
+    for (unsigned int w = 0; w < num_words; w++) {
+        if ((length = strlen(words[w])) == 0 ||
+            !__word_is_valid(words[w], length)) {
+            errno = EINVAL;
+            return -1;
+        }
+        max_states += length;
+        for (j = 0; j < length; j++) {
+            unsigned char c = __ascii_lower(words[w][j]);
+            if (set->classes[c] == 0)
+                set->classes[c] = num_classes++;
+        }
+    }
+    for (j = 0; j < 256; j++)
+        if (!__wc_is_space(j) && set->classes[j] == 0)
+            set->classes[j] = num_classes; // gli altri byte
+    for (j = 'A'; j <= 'Z'; j++)
+        set->classes[j] = set->classes[j | 0x20];
+    num_classes++;
+    for (columns = 1; columns < num_classes; columns <<= 1)
+        set->shift++;
+
+    if ((set->next = malloc((size_t)max_states * columns *
+                            sizeof(unsigned int))) == NULL ||
+        (set->final_rows = malloc(num_words * sizeof(unsigned int))) == NULL) {
+        free(set->next);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // ogni stato nuovo: spazio -> radice, tutto il resto -> stato morto
+    set->num_states = 2;
+    for (state = 0; state < 2; state++) {
+        set->next[state << set->shift] = WORD_SET_ROOT;
+        for (j = 1; j < columns; j++)
+            set->next[(state << set->shift) + j] = WORD_SET_DEAD
+                                                   << set->shift;
+    }
+
+    // il trie delle parole
+    for (unsigned int w = 0; w < num_words; w++) {
+        state = WORD_SET_ROOT;
+        for (j = 0; words[w][j] != '\0'; j++) {
+            unsigned int *slot =
+                &set->next[(state << set->shift) +
+                           set->classes[(unsigned char)words[w][j]]];
+            if (*slot == WORD_SET_DEAD << set->shift) {
+                unsigned int fresh = set->num_states++;
+                set->next[fresh << set->shift] = WORD_SET_ROOT;
+                for (unsigned int k = 1; k < columns; k++)
+                    set->next[(fresh << set->shift) + k] = WORD_SET_DEAD
+                                                           << set->shift;
+                *slot = fresh << set->shift;
+            }
+            state = *slot >> set->shift;
+        }
+        set->final_rows[w] = state << set->shift;
+    }
+    set->num_words = num_words;
+
+    return __word_set_finals_last(set, columns);
+}
+
+/* un passo dell'automa sul byte `byte` a partire dalla riga `row` */
+#define __WORD_SET_STEP(row, byte)                                             \
+    do {                                                                       \
+        unsigned int c = classes[(unsigned char)(byte)];                       \
+        /* `(row >= first_final) > c` sse stato finale e spazio: un salto */   \
+        if ((unsigned int)((row) >= first_final) > c)                          \
+            hits[((row) - first_final) >> shift]++;                            \
+        (row) = next[(row) + c];                                               \
+    } while (0)
+
+int word_set_count(const word_set_t *set, const char *data, size_t size,
+                   unsigned long long *counts) {
+    unsigned long long *hits;
+    const unsigned int *next = set->next;
+    const unsigned char *classes = set->classes;
+    const unsigned int shift = set->shift, first_final = set->first_final;
+    unsigned int row = WORD_SET_ROOT, row2 = WORD_SET_ROOT;
+    size_t half, i;
+
+    // quante volte un'intera parola è terminata in ogni stato finale
+    if ((hits = calloc((set->num_states - (first_final >> shift)),
+                       sizeof(unsigned long long))) == NULL)
+        return -1;
+
+    /* ogni passo dipende dal precedente (la riga viene dalla tabella), quindi
+     * il testo è diviso in due metà su uno spazio e le due metà sono
+     * percorse insieme da due automi indipendenti, che il processore esegue
+     * in parallelo; la seconda metà parte da uno spazio e quindi dalla
+     * radice, la prima finisce prima di uno spazio */
+    for (half = size / 2; half < size && classes[(unsigned char)data[half]];
+         half++)
+        ;
+    if (half == size)
+        half = 0; // nessuno spazio dopo la metà: un automa solo
+
+    for (i = 0; i < half && half + i < size; i++) {
+        __WORD_SET_STEP(row, data[i]);
+        __WORD_SET_STEP(row2, data[half + i]);
+    }
+    for (; i < half; i++)
+        __WORD_SET_STEP(row, data[i]);
+    for (i += half; i < size; i++)
+        __WORD_SET_STEP(row2, data[i]);
+
+    // la fine di ogni metà chiude la sua ultima parola
+    if (row >= first_final)
+        hits[(row - first_final) >> shift]++;
+    if (row2 >= first_final)
+        hits[(row2 - first_final) >> shift]++;
+
+    for (unsigned int w = 0; w < set->num_words; w++)
+        counts[w] += hits[(set->final_rows[w] - first_final) >> shift];
+    free(hits);
+
+    return 0;
+}
+
+void word_set_destroy(word_set_t *set) {
+    free(set->next);
+    free(set->final_rows);
+    memset(set, 0, sizeof(*set));
+}
+
+/* inversione: si caricano un blocco vettoriale dall'inizio di `front` e uno
+ * dalla fine di `back`, se ne inverte l'ordine dei byte nei registri e li si
+ * salva scambiati; con AVX2 l'inversione dei 32 byte è un `vpshufb` (inverte
+ * ognuna delle due metà da 16) più uno scambio delle metà, con SSE2 (che non
+ * ha `pshufb`) si invertono parole da 32 bit, poi da 16 bit, poi i byte */
+
+#if defined(__AVX2__)
+static inline __m256i __reverse_vector(__m256i v) {
+    const __m256i mask = _mm256_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11,
+        10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+    return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, mask), 0x4E);
+}
+#define REVERSE_WIDTH 32
+#elif defined(__SSE2__)
+static inline __m128i __reverse_vector(__m128i v) {
+    v = _mm_shuffle_epi32(v, 0x1B);
+    v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+#define REVERSE_WIDTH 16
+#endif
+
+void reverse_swap_scalar(char *front, char *back, size_t size) {
+    char temp;
+
+    for (size_t i = 0; i < size; i++) {
+        temp = back[size - 1 - i];
+        back[size - 1 - i] = front[i];
+        front[i] = temp;
+    }
+}
+
+void reverse_swap(char *front, char *back, size_t size) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + REVERSE_WIDTH <= size; i += REVERSE_WIDTH) {
+        char *b = back + size - REVERSE_WIDTH - i;
+        __m256i f = _mm256_loadu_si256((const __m256i *)(front + i));
+        __m256i r = _mm256_loadu_si256((const __m256i *)b);
+        _mm256_storeu_si256((__m256i *)(front + i), __reverse_vector(r));
+        _mm256_storeu_si256((__m256i *)b, __reverse_vector(f));
+    }
+#elif defined(__SSE2__)
+    for (; i + REVERSE_WIDTH <= size; i += REVERSE_WIDTH) {
+        char *b = back + size - REVERSE_WIDTH - i;
+        __m128i f = _mm_loadu_si128((const __m128i *)(front + i));
+        __m128i r = _mm_loadu_si128((const __m128i *)b);
+        _mm_storeu_si128((__m128i *)(front + i), __reverse_vector(r));
+        _mm_storeu_si128((__m128i *)b, __reverse_vector(f));
+    }
+#endif
+
+    // i byte rimasti: `front[i..size)` con `back[0..size-i)`
+    reverse_swap_scalar(front + i, back, size - i);
+}
+
+void reverse_bytes(char *buffer, size_t size) {
+    // prima metà contro seconda metà (l'eventuale byte centrale resta lì)
+    reverse_swap(buffer, buffer + size - size / 2, size / 2);
+}
 
 /* una reimplemntazione (non del tutto pulita) dei semafori numerici e delle
  * barriere: strumenti POSIX che però non sono supportati dal sistema operativo
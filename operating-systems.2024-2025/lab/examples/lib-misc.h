@@ -7,6 +7,12 @@
  * - fornire un layer di compatibilità (leggi "hack") per i sistemi Apple per
  *   supplire al mancato supporto di alcune chiamate POSIX (semafori numerici
  *   e barriere)
+ * - misurare il tempo trascorso con un orologio monotono (per i benchmark)
+ * - contare righe, parole e byte di un testo in un solo passaggio (come `wc`),
+ *   contare le occorrenze di una parola e invertire blocchi di byte, con
+ *   istruzioni vettoriali SSE2/AVX2 dove disponibili
+ * - contare in un solo passaggio le occorrenze di un intero insieme di parole
+ *   con un automa a tabella densa
  */
 
 #ifndef LIB_OSLAB_MISC_H
@@ -18,6 +24,8 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,6 +60,83 @@
  * compilatore a trattarlo come una vera e propria funzione (ad esempio
  * obbligando l'uso del punto-e-virgola subito dopo) */
 
+/* secondi trascorsi da un istante fisso (`CLOCK_MONOTONIC`): ha senso solo la
+ * differenza tra due chiamate; esce su errore */
+double seconds_now(void);
+
+/* contatori di `wc_count`: una parola è una sequenza massimale di caratteri
+ * diversi dagli spazi bianchi di `isspace` nella localizzazione "C" (spazio,
+ * `\t`, `\n`, `\v`, `\f`, `\r`) */
+typedef struct {
+    unsigned long long lines; // caratteri `\n`
+    unsigned long long words;
+    unsigned long long bytes;
+    bool in_word; // l'ultimo byte visto non era uno spazio
+} wc_counts_t;
+
+/* aggiunge a `counts` righe, parole e byte dei `size` byte di `data`: può
+ * essere chiamata più volte su blocchi consecutivi dello stesso testo (una
+ * parola a cavallo tra due blocchi viene contata una volta sola); i contatori
+ * vanno azzerati prima del primo blocco */
+void wc_count(wc_counts_t *counts, const char *data, size_t size);
+
+/* come `wc_count` ma un byte alla volta (per confronto) */
+void wc_count_scalar(wc_counts_t *counts, const char *data, size_t size);
+
+/* conta le occorrenze di `word` (lunga `length` byte) come parola intera nei
+ * `size` byte di `data` senza distinguere maiuscole e minuscole ASCII: le
+ * parole sono delimitate dagli spazi bianchi come in `wc_count`, quindi il
+ * risultato è lo stesso di leggere il testo con `fscanf("%s")` e confrontare
+ * ogni parola con `strcasecmp` (es. "Ciao" conta per "ciao", "ciao," no) */
+unsigned long long word_count(const char *data, size_t size, const char *word,
+                              size_t length);
+
+/* come `word_count` ma una parola alla volta (per confronto) */
+unsigned long long word_count_scalar(const char *data, size_t size,
+                                     const char *word, size_t length);
+
+/* come `word_count` sull'intero contenuto del file `pathname`, mappato in
+ * memoria in sola lettura; restituisce -1 con `errno` impostato (senza
+ * stampare nulla) se il file non si può aprire o mappare */
+long long word_count_file(const char *pathname, const char *word);
+
+/* un insieme di parole compilato in un automa (vedi `word_set_init`) */
+typedef struct {
+    unsigned int num_words;
+    unsigned int num_states;
+    unsigned int shift;          // log2 delle colonne di una riga della tabella
+    unsigned char classes[256];  // classe di ogni byte (0: spazio bianco)
+    unsigned int *next;          // riga (già moltiplicata) per stato e classe
+    unsigned int *final_rows;    // riga di arrivo di ogni parola
+    unsigned int first_final;    // riga del primo stato finale (sono in fondo)
+} word_set_t;
+
+/* compila le `num_words` parole di `words` in un automa di Aho-Corasick
+ * ridotto alle parole intere: restituisce 0 o -1 con `errno` a `EINVAL` se
+ * una parola è vuota o contiene spazi (o `ENOMEM`) */
+int word_set_init(word_set_t *set, const char *const *words,
+                  unsigned int num_words);
+
+/* aggiunge a `counts[w]` le occorrenze della parola `w` nei `size` byte di
+ * `data`, con gli stessi criteri di `word_count`, leggendo il testo una sola
+ * volta qualunque sia il numero di parole: 0 o -1 con `errno` impostato */
+int word_set_count(const word_set_t *set, const char *data, size_t size,
+                   unsigned long long *counts);
+
+void word_set_destroy(word_set_t *set);
+
+/* scambia il blocco `front` di `size` byte con il blocco `back` (stessa
+ * dimensione, non sovrapposto) invertendo l'ordine dei byte: `front[i]` <->
+ * `back[size - 1 - i]`; invertire un file equivale a farlo sulla prima metà e
+ * sulla seconda metà (letta dalla fine) */
+void reverse_swap(char *front, char *back, size_t size);
+
+/* come `reverse_swap` ma un byte alla volta (per confronto) */
+void reverse_swap_scalar(char *front, char *back, size_t size);
+
+/* inverte sul posto l'ordine dei `size` byte di `buffer` */
+void reverse_bytes(char *buffer, size_t size);
+
 #ifdef __APPLE__
 
 /* layer di compatibilità degli esempi per Mac OS */
@@ -0,0 +1,588 @@
+/*
+ * libreria di servizio ufficiosa con le code di numeri thread-safe degli
+ * esempi sul modello produttori-consumatori (vedi `lib-number-queue.h`)
+ *
+ * la coda lock-free segue l'algoritmo della coda limitata di Dmitry Vyukov:
+ * la cella `i` è libera per l'inserimento in posizione `pos` quando il suo
+ * numero di sequenza vale `pos` ed è pronta per l'estrazione quando vale
+ * `pos + 1`; i thread si bloccano (con una futex sotto Linux) solo quando la
+ * coda è effettivamente vuota o piena.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // necessaria per `syscall` (usata per le futex)
+#endif
+
+#include "lib-number-queue.h"
+#include <limits.h>
+#include <sched.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+/* < safe-number-queue > */
+void safe_number_queue_init(safe_number_queue_t *queue_ptr,
+                            unsigned long capacity, unsigned int producers) {
+    assert(queue_ptr);
+    assert(capacity > 0);
+    assert(producers > 0);
+    int err;
+
+    queue_ptr->capacity = capacity;
+    queue_ptr->size = queue_ptr->in = queue_ptr->out = 0;
+    queue_ptr->data = malloc(queue_ptr->capacity * sizeof(long));
+    assert(queue_ptr->data);
+
+    if ((err = pthread_mutex_init(&queue_ptr->mutex, NULL)))
+        exit_with_err("pthread_mutex_init", err);
+    if ((err = pthread_cond_init(&queue_ptr->full, NULL)))
+        exit_with_err("pthread_cond_init", err);
+    if ((err = pthread_cond_init(&queue_ptr->empty, NULL)))
+        exit_with_err("pthread_cond_init", err);
+
+    queue_ptr->active_producers = producers;
+}
+
+void safe_number_queue_destroy(safe_number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(queue_ptr->capacity > 0);
+    assert(queue_ptr->data);
+    int err;
+
+    free(queue_ptr->data);
+    queue_ptr->data = NULL;
+    queue_ptr->capacity = queue_ptr->size = 0;
+    queue_ptr->in = queue_ptr->out = 0;
+
+    if ((err = pthread_mutex_destroy(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_destroy", err);
+    if ((err = pthread_cond_destroy(&queue_ptr->full)))
+        exit_with_err("pthread_cond_destroy", err);
+    if ((err = pthread_cond_destroy(&queue_ptr->empty)))
+        exit_with_err("pthread_cond_destroy", err);
+}
+
+bool safe_number_queue_is_empty(safe_number_queue_t *const queue_ptr) {
+    assert(queue_ptr);
+    int err;
+    bool return_value;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return_value = (queue_ptr->size == 0);
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return return_value;
+}
+
+bool safe_number_queue_is_full(safe_number_queue_t *const queue_ptr) {
+    assert(queue_ptr);
+    int err;
+    bool return_value;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return_value = (queue_ptr->size == queue_ptr->capacity);
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return return_value;
+}
+
+void safe_number_queue_push(safe_number_queue_t *queue_ptr, long num,
+                            bool last) {
+    // `last`: se a `true` (1) indica che è l'ultimo inserimento del produttore
+    assert(queue_ptr);
+    int err;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    // NB: al ritorno di `wait` reitera sempre il controllo!
+    while (queue_ptr->size == queue_ptr->capacity)
+        if ((err = pthread_cond_wait(&queue_ptr->full, &queue_ptr->mutex)))
+            exit_with_err("pthread_cond_wait", err);
+    // NB: qui avrei potuto usare `safe_number_queue_is_full` nella condizione
+    // ma avrei acquisito due volte il lock (errore `EDEADLK` sulla wait)
+
+    queue_ptr->data[queue_ptr->in] = num;
+    queue_ptr->in = (queue_ptr->in + 1) % queue_ptr->capacity;
+    queue_ptr->size++;
+
+    if (last) {
+        assert(queue_ptr->active_producers > 0);
+        queue_ptr->active_producers--;
+    }
+
+    if (queue_ptr->size == 1)
+        if ((err = pthread_cond_broadcast(&queue_ptr->empty)))
+            exit_with_err("pthread_cond_broadcast", err);
+    // usando `pthread_cond_signal` con più consumatori possono esserci dei
+    // blocchi per consumatori che restano dormienti pur avendo visto uscire
+    // anche l'ultimo produttore
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+}
+
+bool safe_number_queue_pop(long *extr_num_ptr, safe_number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(extr_num_ptr);
+    int err;
+    bool return_value;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    while (queue_ptr->size == 0 && queue_ptr->active_producers > 0)
+        if ((err = pthread_cond_wait(&queue_ptr->empty, &queue_ptr->mutex)))
+            exit_with_err("pthread_cond_wait", err);
+
+    if (queue_ptr->size == 0 && queue_ptr->active_producers == 0)
+        // se la coda è vuota e non ci sono più produttori
+        return_value = false;
+    else {
+        *extr_num_ptr = queue_ptr->data[queue_ptr->out];
+        queue_ptr->out = (queue_ptr->out + 1) % queue_ptr->capacity;
+        queue_ptr->size--;
+
+        return_value = true;
+
+        if (queue_ptr->size == queue_ptr->capacity - 1)
+            if ((err = pthread_cond_broadcast(&queue_ptr->full)))
+                exit_with_err("pthread_cond_broadcast", err);
+        // anche qui, usando `pthread_cond_signal` con più produttori possono
+        // esserci dei blocchi per produttori che restano dormienti
+    }
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return return_value;
+}
+
+unsigned long safe_number_queue_push_n(safe_number_queue_t *queue_ptr,
+                                       const long *nums, unsigned long n,
+                                       bool last) {
+    assert(queue_ptr);
+    assert(nums);
+    assert(n > 0);
+    int err;
+    unsigned long count, first_part;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    while (queue_ptr->size == queue_ptr->capacity)
+        if ((err = pthread_cond_wait(&queue_ptr->full, &queue_ptr->mutex)))
+            exit_with_err("pthread_cond_wait", err);
+
+    count = queue_ptr->capacity - queue_ptr->size;
+    if (count > n)
+        count = n;
+
+    // copia contigua in (al più) due parti: fino alla fine del vettore e poi,
+    // superato il punto di "giro", dall'inizio
+    first_part = queue_ptr->capacity - queue_ptr->in;
+    if (first_part > count)
+        first_part = count;
+    memcpy(queue_ptr->data + queue_ptr->in, nums, first_part * sizeof(long));
+    memcpy(queue_ptr->data, nums + first_part,
+           (count - first_part) * sizeof(long));
+    queue_ptr->in = (queue_ptr->in + count) % queue_ptr->capacity;
+    queue_ptr->size += count;
+
+    if (last && count == n) {
+        assert(queue_ptr->active_producers > 0);
+        queue_ptr->active_producers--;
+    }
+
+    // un solo risveglio per tutto il blocco (se la coda era vuota)
+    if (queue_ptr->size == count)
+        if ((err = pthread_cond_broadcast(&queue_ptr->empty)))
+            exit_with_err("pthread_cond_broadcast", err);
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return count;
+}
+
+unsigned long safe_number_queue_pop_n(long *extr_nums, unsigned long n,
+                                      safe_number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(extr_nums);
+    assert(n > 0);
+    int err;
+    unsigned long count, first_part;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    while (queue_ptr->size == 0 && queue_ptr->active_producers > 0)
+        if ((err = pthread_cond_wait(&queue_ptr->empty, &queue_ptr->mutex)))
+            exit_with_err("pthread_cond_wait", err);
+
+    count = (queue_ptr->size < n ? queue_ptr->size : n);
+    if (count > 0) {
+        first_part = queue_ptr->capacity - queue_ptr->out;
+        if (first_part > count)
+            first_part = count;
+        memcpy(extr_nums, queue_ptr->data + queue_ptr->out,
+               first_part * sizeof(long));
+        memcpy(extr_nums + first_part, queue_ptr->data,
+               (count - first_part) * sizeof(long));
+        queue_ptr->out = (queue_ptr->out + count) % queue_ptr->capacity;
+        queue_ptr->size -= count;
+
+        // un solo risveglio per tutto il blocco (se la coda era piena)
+        if (queue_ptr->size + count == queue_ptr->capacity)
+            if ((err = pthread_cond_broadcast(&queue_ptr->full)))
+                exit_with_err("pthread_cond_broadcast", err);
+    }
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return count;
+}
+
+void safe_number_queue_print(safe_number_queue_t *const queue_ptr) {
+    assert(queue_ptr);
+    int err;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    printf("{ ");
+    for (unsigned long i = 0; i < queue_ptr->size; i++)
+        printf("%lu%s",
+               queue_ptr->data[(queue_ptr->out + i) % queue_ptr->capacity],
+               (i + 1 < queue_ptr->size ? ", " : ""));
+    printf(" } [%lu/%lu]\n", queue_ptr->size, queue_ptr->capacity);
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+}
+/* < safe-number-queue > */
+
+/* < sem-number-queue > */
+void sem_number_queue_init(sem_number_queue_t *queue_ptr,
+                           unsigned long capacity, unsigned int producers,
+                           unsigned int consumers) {
+    assert(queue_ptr);
+    assert(capacity > 0);
+    assert(producers > 0);
+
+    queue_ptr->capacity = capacity;
+    queue_ptr->size = queue_ptr->in = queue_ptr->out = 0;
+    queue_ptr->data = malloc(queue_ptr->capacity * sizeof(long));
+    assert(queue_ptr->data);
+
+    // NB: i semafori (come le altre chiamate POSIX) riportano l'errore in
+    // `errno` e non nel valore di ritorno come le funzioni delle pthread
+    if (sem_init(&queue_ptr->full, 0, 0) == -1)
+        exit_with_sys_err("sem_init");
+    if (sem_init(&queue_ptr->empty, 0, capacity) == -1)
+        exit_with_sys_err("sem_init");
+    if (sem_init(&queue_ptr->mutex, 0, 1) == -1)
+        exit_with_sys_err("sem_init");
+
+    queue_ptr->active_producers = producers;
+    queue_ptr->consumers = consumers;
+}
+
+void sem_number_queue_destroy(sem_number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(queue_ptr->data);
+
+    free(queue_ptr->data);
+    queue_ptr->data = NULL;
+    queue_ptr->capacity = queue_ptr->size = 0;
+    queue_ptr->in = queue_ptr->out = 0;
+
+    if (sem_destroy(&queue_ptr->full) == -1 ||
+        sem_destroy(&queue_ptr->empty) == -1 ||
+        sem_destroy(&queue_ptr->mutex) == -1)
+        exit_with_sys_err("sem_destroy");
+}
+
+void sem_number_queue_push(sem_number_queue_t *queue_ptr, long num, bool last) {
+    assert(queue_ptr);
+    bool end_of_work = false;
+
+    if (sem_wait(&queue_ptr->empty) == -1 || sem_wait(&queue_ptr->mutex) == -1)
+        exit_with_sys_err("sem_wait");
+
+    queue_ptr->data[queue_ptr->in] = num;
+    queue_ptr->in = (queue_ptr->in + 1) % queue_ptr->capacity;
+    queue_ptr->size++;
+    if (last) {
+        assert(queue_ptr->active_producers > 0);
+        end_of_work = (--queue_ptr->active_producers == 0);
+    }
+
+    if (sem_post(&queue_ptr->mutex) == -1 || sem_post(&queue_ptr->full) == -1)
+        exit_with_sys_err("sem_post");
+
+    // un gettone in più per ogni consumatore: chi lo prende trova la coda
+    // vuota e capisce che il flusso è finito
+    if (end_of_work)
+        for (unsigned int i = 0; i < queue_ptr->consumers; i++)
+            if (sem_post(&queue_ptr->full) == -1)
+                exit_with_sys_err("sem_post");
+}
+
+bool sem_number_queue_pop(long *extr_num_ptr, sem_number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(extr_num_ptr);
+    bool return_value;
+
+    if (sem_wait(&queue_ptr->full) == -1 || sem_wait(&queue_ptr->mutex) == -1)
+        exit_with_sys_err("sem_wait");
+
+    if (queue_ptr->size == 0) // solo dopo l'ultimo produttore
+        return_value = false;
+    else {
+        *extr_num_ptr = queue_ptr->data[queue_ptr->out];
+        queue_ptr->out = (queue_ptr->out + 1) % queue_ptr->capacity;
+        queue_ptr->size--;
+        return_value = true;
+    }
+
+    if (sem_post(&queue_ptr->mutex) == -1)
+        exit_with_sys_err("sem_post");
+    if (return_value)
+        if (sem_post(&queue_ptr->empty) == -1)
+            exit_with_sys_err("sem_post");
+
+    return return_value;
+}
+/* < sem-number-queue > */
+
+/* < lock-free-number-queue > */
+/* le operazioni atomiche sono quelle integrate in GCC/Clang (`__atomic_*`):
+ * gli esempi sono compilati con `-std=c99` e quindi senza `stdatomic.h` */
+#define atomic_load(ptr) __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define atomic_load_acquire(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define atomic_load_relaxed(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define atomic_store_release(ptr, v)                                           \
+    __atomic_store_n((ptr), (v), __ATOMIC_RELEASE)
+#define atomic_fetch_add(ptr, v) __atomic_fetch_add((ptr), (v), __ATOMIC_SEQ_CST)
+#define atomic_fetch_sub(ptr, v) __atomic_fetch_sub((ptr), (v), __ATOMIC_SEQ_CST)
+#define atomic_cas(ptr, expected_ptr, desired)                                 \
+    __atomic_compare_exchange_n((ptr), (expected_ptr), (desired), true,        \
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)
+
+/* attende che `*word` sia diverso da `expected` (o un risveglio spurio) */
+static void __futex_wait(unsigned int *word, unsigned int expected) {
+#ifdef __linux__
+    if (syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL,
+                0) == -1 &&
+        errno != EAGAIN && errno != EINTR)
+        exit_with_sys_err("futex");
+#else
+    // su sistemi senza futex (es. Mac OS) ci si limita a cedere la CPU
+    (void)word;
+    (void)expected;
+    sched_yield();
+#endif
+}
+
+/* risveglia tutti i thread in attesa su `word` */
+static void __futex_wake_all(unsigned int *word) {
+#ifdef __linux__
+    if (syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL,
+                0) == -1)
+        exit_with_sys_err("futex");
+#else
+    (void)word;
+#endif
+}
+
+/* segnala un evento: l'incremento del contatore fa fallire le `__futex_wait`
+ * di chi aveva letto il valore precedente, quindi nessun risveglio va perso */
+static void __lock_free_number_queue_notify(unsigned int *event,
+                                            unsigned int *waiters) {
+    atomic_fetch_add(event, 1);
+    if (atomic_load(waiters) > 0)
+        __futex_wake_all(event);
+}
+
+void lock_free_number_queue_init(lock_free_number_queue_t *queue_ptr,
+                                 unsigned long capacity,
+                                 unsigned int producers) {
+    assert(queue_ptr);
+    assert(capacity > 0);
+    assert(producers > 0);
+
+    // arrotondamento alla potenza di 2 successiva
+    queue_ptr->capacity = 1;
+    while (queue_ptr->capacity < capacity)
+        queue_ptr->capacity <<= 1;
+    queue_ptr->mask = queue_ptr->capacity - 1;
+
+    queue_ptr->slots =
+        malloc(queue_ptr->capacity * sizeof(lock_free_number_queue_slot_t));
+    assert(queue_ptr->slots);
+    for (unsigned long i = 0; i < queue_ptr->capacity; i++)
+        queue_ptr->slots[i].sequence = i;
+
+    queue_ptr->in = queue_ptr->out = 0;
+    queue_ptr->more_data = queue_ptr->data_waiters = 0;
+    queue_ptr->more_space = queue_ptr->space_waiters = 0;
+    queue_ptr->active_producers = producers;
+}
+
+void lock_free_number_queue_destroy(lock_free_number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(queue_ptr->capacity > 0);
+    assert(queue_ptr->slots);
+
+    free(queue_ptr->slots);
+    queue_ptr->slots = NULL;
+    queue_ptr->capacity = queue_ptr->mask = 0;
+    queue_ptr->in = queue_ptr->out = 0;
+}
+
+bool lock_free_number_queue_is_empty(
+    lock_free_number_queue_t *const queue_ptr) {
+    assert(queue_ptr);
+
+    return (atomic_load(&queue_ptr->in) == atomic_load(&queue_ptr->out));
+}
+
+bool lock_free_number_queue_is_full(lock_free_number_queue_t *const queue_ptr) {
+    assert(queue_ptr);
+
+    return (atomic_load(&queue_ptr->in) - atomic_load(&queue_ptr->out) >=
+            queue_ptr->capacity);
+}
+
+void lock_free_number_queue_push(lock_free_number_queue_t *queue_ptr, long num,
+                                 bool last) {
+    // `last`: se a `true` (1) indica che è l'ultimo inserimento del produttore
+    assert(queue_ptr);
+    lock_free_number_queue_slot_t *slot;
+    unsigned long pos = atomic_load_relaxed(&queue_ptr->in);
+    unsigned int spins = 0;
+
+    while (true) {
+        slot = &queue_ptr->slots[pos & queue_ptr->mask];
+        long diff = (long)(atomic_load_acquire(&slot->sequence) - pos);
+
+        if (diff == 0) {
+            // cella libera: proviamo a prenotarla avanzando `in`
+            if (atomic_cas(&queue_ptr->in, &pos, pos + 1))
+                break;
+            // NB: in caso di fallimento `pos` è già stato aggiornato
+        } else if (diff < 0) {
+            // la cella contiene ancora un elemento di un giro precedente: la
+            // coda è piena
+            if (++spins < NUMBER_QUEUE_SPIN_LIMIT) {
+                sched_yield();
+            } else {
+                unsigned int event;
+                atomic_fetch_add(&queue_ptr->space_waiters, 1);
+                event = atomic_load(&queue_ptr->more_space);
+                // reitera il controllo dopo essersi registrato come in attesa
+                if ((long)(atomic_load(&slot->sequence) - pos) < 0)
+                    __futex_wait(&queue_ptr->more_space, event);
+                atomic_fetch_sub(&queue_ptr->space_waiters, 1);
+                spins = 0;
+            }
+            pos = atomic_load_relaxed(&queue_ptr->in);
+        } else
+            // un altro produttore ci ha preceduto
+            pos = atomic_load_relaxed(&queue_ptr->in);
+    }
+
+    // la cella è nostra: scrittura del valore e pubblicazione
+    slot->value = num;
+    atomic_store_release(&slot->sequence, pos + 1);
+
+    if (last) {
+        assert(atomic_load(&queue_ptr->active_producers) > 0);
+        atomic_fetch_sub(&queue_ptr->active_producers, 1);
+    }
+
+    // come nel monitor vanno risvegliati tutti i consumatori: con l'ultimo
+    // produttore uscito devono accorgersi della fine del flusso
+    __lock_free_number_queue_notify(&queue_ptr->more_data,
+                                    &queue_ptr->data_waiters);
+}
+
+bool lock_free_number_queue_pop(long *extr_num_ptr,
+                                lock_free_number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(extr_num_ptr);
+    lock_free_number_queue_slot_t *slot;
+    unsigned long pos = atomic_load_relaxed(&queue_ptr->out);
+    unsigned int spins = 0;
+
+    while (true) {
+        slot = &queue_ptr->slots[pos & queue_ptr->mask];
+        long diff = (long)(atomic_load_acquire(&slot->sequence) - (pos + 1));
+
+        if (diff == 0) {
+            // cella pronta: proviamo a prenotarla avanzando `out`
+            if (atomic_cas(&queue_ptr->out, &pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            // cella non ancora scritta: la coda è vuota
+            if (atomic_load(&queue_ptr->active_producers) == 0) {
+                // nessun produttore attivo: un ultimo controllo e poi si esce
+                if ((long)(atomic_load(&slot->sequence) - (pos + 1)) < 0 &&
+                    pos == atomic_load(&queue_ptr->out))
+                    return false;
+            } else if (++spins < NUMBER_QUEUE_SPIN_LIMIT) {
+                sched_yield();
+            } else {
+                unsigned int event;
+                atomic_fetch_add(&queue_ptr->data_waiters, 1);
+                event = atomic_load(&queue_ptr->more_data);
+                if ((long)(atomic_load(&slot->sequence) - (pos + 1)) < 0 &&
+                    atomic_load(&queue_ptr->active_producers) > 0)
+                    __futex_wait(&queue_ptr->more_data, event);
+                atomic_fetch_sub(&queue_ptr->data_waiters, 1);
+                spins = 0;
+            }
+            pos = atomic_load_relaxed(&queue_ptr->out);
+        } else
+            // un altro consumatore ci ha preceduto
+            pos = atomic_load_relaxed(&queue_ptr->out);
+    }
+
+    // lettura del valore e rilascio della cella per il giro successivo
+    *extr_num_ptr = slot->value;
+    atomic_store_release(&slot->sequence, pos + queue_ptr->capacity);
+
+    __lock_free_number_queue_notify(&queue_ptr->more_space,
+                                    &queue_ptr->space_waiters);
+
+    return true;
+}
+
+void lock_free_number_queue_print(lock_free_number_queue_t *const queue_ptr) {
+    assert(queue_ptr);
+    unsigned long out = atomic_load(&queue_ptr->out);
+    unsigned long in = atomic_load(&queue_ptr->in);
+    unsigned long size = (in > out ? in - out : 0);
+
+    // NB: senza lock la stampa è solo indicativa (i valori possono cambiare
+    // mentre vengono letti)
+    printf("{ ");
+    for (unsigned long i = 0; i < size; i++)
+        printf("%lu%s", queue_ptr->slots[(out + i) & queue_ptr->mask].value,
+               (i + 1 < size ? ", " : ""));
+    printf(" } [%lu/%lu]\n", size, queue_ptr->capacity);
+}
+/* < lock-free-number-queue > */
@@ -0,0 +1,137 @@
+/*
+ * libreria di servizio ufficiosa con le code di numeri thread-safe di
+ * capacità limitata viste negli esempi sul modello produttori-consumatori
+ * (multi-produttore/multi-consumatore):
+ * - `safe_number_queue`: mutex e variabili condizione integrati nella
+ *   struttura dati (nello stile dei monitor), con inserimenti ed estrazioni
+ *   anche a blocchi; è la coda `< safe-number-queue >` dell'esempio
+ *   `thread-safe-number-queue-as-monitor.c`, che la mostra per intero,
+ *   riportata qui per il benchmark
+ * - `sem_number_queue`: la coda di `thread-prod-cons-with-sem.c` con i tre
+ *   semafori integrati nella struttura dati
+ * - `lock_free_number_queue`: anello senza lock con un numero di sequenza per
+ *   cella (vedi `thread-lock-free-number-queue.c`)
+ *
+ * tutte hanno la stessa semantica di fine flusso: ogni produttore marca il
+ * proprio ultimo inserimento con `last` e, una volta usciti tutti i
+ * produttori, l'estrazione da una coda vuota restituisce `false` (o 0).
+ */
+
+#ifndef LIB_OSLAB_NUMBER_QUEUE_H
+#define LIB_OSLAB_NUMBER_QUEUE_H
+
+#include "lib-misc.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+
+#define NUMBER_QUEUE_CACHE_LINE 64
+#define NUMBER_QUEUE_SPIN_LIMIT 100 // tentativi a vuoto prima di bloccarsi
+
+typedef struct {
+    unsigned long capacity;
+    unsigned long size;
+    unsigned long in, out;
+    long *data;
+    pthread_mutex_t mutex;
+    pthread_cond_t full;  // potrebbe anche essere chiamata `more_space`
+    pthread_cond_t empty; // e questa `more_data`
+    unsigned int active_producers;
+} safe_number_queue_t;
+
+void safe_number_queue_init(safe_number_queue_t *queue_ptr,
+                            unsigned long capacity, unsigned int producers);
+void safe_number_queue_destroy(safe_number_queue_t *queue_ptr);
+bool safe_number_queue_is_empty(safe_number_queue_t *const queue_ptr);
+bool safe_number_queue_is_full(safe_number_queue_t *const queue_ptr);
+
+/* `last`: se a `true` indica che è l'ultimo inserimento del produttore */
+void safe_number_queue_push(safe_number_queue_t *queue_ptr, long num,
+                            bool last);
+
+/* restituisce `false` se la coda è vuota e non ci sono più produttori */
+bool safe_number_queue_pop(long *extr_num_ptr, safe_number_queue_t *queue_ptr);
+
+/* variante a blocchi di `safe_number_queue_push`: inserisce fino a `n`
+ * elementi di `nums` con una sola acquisizione del lock (bloccandosi solo se
+ * la coda è piena) e ne restituisce il numero effettivo; `last` ha effetto
+ * solo se sono stati inseriti tutti gli `n` elementi */
+unsigned long safe_number_queue_push_n(safe_number_queue_t *queue_ptr,
+                                       const long *nums, unsigned long n,
+                                       bool last);
+
+/* variante a blocchi di `safe_number_queue_pop`: estrae fino a `n` elementi
+ * in `extr_nums` con una sola acquisizione del lock e ne restituisce il
+ * numero effettivo (0 se la coda è vuota e non ci sono più produttori) */
+unsigned long safe_number_queue_pop_n(long *extr_nums, unsigned long n,
+                                      safe_number_queue_t *queue_ptr);
+
+void safe_number_queue_print(safe_number_queue_t *const queue_ptr);
+
+typedef struct {
+    unsigned long capacity;
+    unsigned long size;
+    unsigned long in, out;
+    long *data;
+    sem_t full, empty, mutex;
+    unsigned int active_producers;
+    unsigned int consumers;
+} sem_number_queue_t;
+
+/* `consumers` serve all'ultimo produttore per "sbloccare" un'ultima volta
+ * tutti i consumatori, che trovando la coda vuota capiscono che il flusso è
+ * finito */
+void sem_number_queue_init(sem_number_queue_t *queue_ptr,
+                           unsigned long capacity, unsigned int producers,
+                           unsigned int consumers);
+void sem_number_queue_destroy(sem_number_queue_t *queue_ptr);
+void sem_number_queue_push(sem_number_queue_t *queue_ptr, long num, bool last);
+bool sem_number_queue_pop(long *extr_num_ptr, sem_number_queue_t *queue_ptr);
+
+typedef struct {
+    unsigned long sequence;
+    long value;
+} lock_free_number_queue_slot_t;
+
+typedef struct {
+    unsigned long capacity; // sempre una potenza di 2...
+    unsigned long mask;     // ...così `pos % capacity` diventa `pos & mask`
+    lock_free_number_queue_slot_t *slots;
+
+    // i due indici stanno su linee di cache distinte per evitare che
+    // produttori e consumatori si "rubino" a vicenda la stessa linea (false
+    // sharing)
+    unsigned long in __attribute__((aligned(NUMBER_QUEUE_CACHE_LINE)));
+    unsigned long out __attribute__((aligned(NUMBER_QUEUE_CACHE_LINE)));
+
+    // contatori di eventi (usati come parole delle futex) e numero di thread
+    // in attesa su ognuno: permettono di evitare la chiamata di sistema di
+    // risveglio quando nessuno dorme
+    unsigned int more_data __attribute__((aligned(NUMBER_QUEUE_CACHE_LINE)));
+    unsigned int data_waiters;
+    unsigned int more_space __attribute__((aligned(NUMBER_QUEUE_CACHE_LINE)));
+    unsigned int space_waiters;
+
+    unsigned int active_producers
+        __attribute__((aligned(NUMBER_QUEUE_CACHE_LINE)));
+} lock_free_number_queue_t;
+
+/* NB: `capacity` viene arrotondata alla potenza di 2 successiva */
+void lock_free_number_queue_init(lock_free_number_queue_t *queue_ptr,
+                                 unsigned long capacity,
+                                 unsigned int producers);
+void lock_free_number_queue_destroy(lock_free_number_queue_t *queue_ptr);
+
+/* NB: le due interrogazioni seguenti (come la stampa) restituiscono una
+ * fotografia che può essere già superata al momento del ritorno */
+bool lock_free_number_queue_is_empty(lock_free_number_queue_t *const queue_ptr);
+bool lock_free_number_queue_is_full(lock_free_number_queue_t *const queue_ptr);
+
+/* bloccante (con una futex sotto Linux) solo a coda piena */
+void lock_free_number_queue_push(lock_free_number_queue_t *queue_ptr, long num,
+                                 bool last);
+bool lock_free_number_queue_pop(long *extr_num_ptr,
+                                lock_free_number_queue_t *queue_ptr);
+void lock_free_number_queue_print(lock_free_number_queue_t *const queue_ptr);
+
+#endif /* LIB_OSLAB_NUMBER_QUEUE_H */
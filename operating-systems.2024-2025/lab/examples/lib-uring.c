@@ -0,0 +1,408 @@
+/*
+ * libreria di servizio ufficiosa per copiare dati tra descrittori con
+ * `io_uring` (vedi `lib-uring.h`)
+ *
+ * un `io_uring` è formato da due code circolari condivise con il kernel
+ * (mappate con `mmap` sul descrittore restituito da `io_uring_setup`):
+ * - nella coda delle sottomissioni (SQ) l'utente scrive le richieste (SQE) e
+ *   ne avanza la coda (`tail`); il kernel le consuma avanzando la testa
+ * - nella coda dei completamenti (CQ) il kernel scrive i risultati (CQE) e
+ *   l'utente li consuma avanzando la testa
+ * gli indici sono letti e scritti con semantica acquire/release perché
+ * l'altro lato li osserva in modo concorrente.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // per `syscall`
+#endif
+
+#include "lib-uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#ifdef __NR_io_uring_setup
+#define URING_SUPPORTED
+#endif
+#endif
+#endif
+
+#ifdef URING_SUPPORTED
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+typedef struct {
+    int fd;
+    unsigned int entries;
+    unsigned int to_submit; // SQE scritte ma non ancora pubblicate (`tail`)
+    // coda delle sottomissioni
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    // coda dei completamenti
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    // mappature da rilasciare
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+} __uring_t;
+
+/* un blocco in volo: una coppia lettura->scrittura sullo stesso buffer */
+typedef struct {
+    bool busy;
+    off_t src, dst;  // posizioni (`dst` negativa: posizione corrente)
+    size_t length;
+    int read_result; // risultato della lettura (già arrivato)
+} __uring_block_t;
+
+static int __uring_setup(__uring_t *ring, unsigned int entries) {
+    struct io_uring_params params;
+    int saved_errno;
+
+    memset(ring, 0, sizeof(__uring_t));
+    memset(&params, 0, sizeof(params));
+    if ((ring->fd = syscall(__NR_io_uring_setup, entries, &params)) == -1) {
+        if (errno == EPERM) // disabilitato (`kernel.io_uring_disabled`)
+            errno = ENOSYS;
+        return -1;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    // con `IORING_FEAT_SINGLE_MMAP` le due code stanno in un'unica mappatura
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size)
+            ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+
+    if ((ring->sq_ptr =
+             mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  ring->fd, IORING_OFF_SQ_RING)) == MAP_FAILED)
+        goto error;
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ptr = ring->sq_ptr;
+    else if ((ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED, ring->fd, IORING_OFF_CQ_RING)) ==
+             MAP_FAILED)
+        goto error;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if ((ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, ring->fd, IORING_OFF_SQES)) ==
+        MAP_FAILED)
+        goto error;
+
+    ring->sq_head = (unsigned int *)((char *)ring->sq_ptr + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)((char *)ring->sq_ptr + params.sq_off.tail);
+    ring->sq_mask =
+        (unsigned int *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+    ring->sq_array =
+        (unsigned int *)((char *)ring->sq_ptr + params.sq_off.array);
+    ring->cq_head = (unsigned int *)((char *)ring->cq_ptr + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)((char *)ring->cq_ptr + params.cq_off.tail);
+    ring->cq_mask =
+        (unsigned int *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+    ring->cqes =
+        (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+
+    return 0;
+
+error:
+    saved_errno = errno;
+    if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED)
+        munmap(ring->sq_ptr, ring->sq_size);
+    if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED &&
+        ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_size);
+    close(ring->fd);
+    errno = saved_errno;
+    return -1;
+}
+
+static void __uring_destroy(__uring_t *ring) {
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_size);
+    munmap(ring->sq_ptr, ring->sq_size);
+    close(ring->fd); // rilascia anche i buffer registrati
+}
+
+/* prenota la prossima SQE libera (il chiamante non ne chiede mai più di
+ * `entries` prima di sottometterle) */
+static struct io_uring_sqe *__uring_get_sqe(__uring_t *ring) {
+    unsigned int tail = *ring->sq_tail + ring->to_submit;
+    unsigned int index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    assert(tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) <
+           ring->entries);
+    ring->sq_array[index] = index;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->to_submit++;
+
+    return sqe;
+}
+
+/* rende visibili al kernel le SQE preparate, le sottomette e attende almeno
+ * `min_complete` completamenti; una volta pubblicata la coda le SQE non vanno
+ * più contate in `to_submit`: quelle che il kernel non ha ancora consumato
+ * (sottomissione parziale) sono tra la sua testa e la coda e vengono
+ * ripassate alla chiamata successiva senza avanzare di nuovo la coda */
+static int __uring_submit_and_wait(__uring_t *ring, unsigned int min_complete) {
+    unsigned int tail = *ring->sq_tail + ring->to_submit;
+    unsigned int pending;
+
+    __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+    ring->to_submit = 0;
+    pending = tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    while (syscall(__NR_io_uring_enter, ring->fd, pending, min_complete,
+                   IORING_ENTER_GETEVENTS, NULL, 0) == -1)
+        if (errno != EINTR)
+            return -1;
+
+    return 0;
+}
+
+static void __uring_prep_rw(struct io_uring_sqe *sqe, int opcode, int fd,
+                            char *buffer, size_t length, off_t offset,
+                            int buffer_index, __u64 user_data) {
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buffer;
+    sqe->len = length;
+    sqe->off = (offset < 0 ? (__u64)-1 : (__u64)offset);
+    sqe->buf_index = (buffer_index < 0 ? 0 : buffer_index);
+    sqe->user_data = user_data;
+}
+
+/* completa in modo bloccante un blocco la cui catena lettura->scrittura si è
+ * interrotta (lettura corta, ad esempio per una sorgente troncata nel
+ * frattempo) o la cui scrittura è stata parziale: i primi `written` byte sono
+ * già a destinazione; restituisce i byte del blocco copiati in tutto */
+static ssize_t __uring_finish_block(int sd, int dd, char *buffer,
+                                    const __uring_block_t *block,
+                                    size_t written) {
+    ssize_t size, result;
+    size_t done = written;
+
+    while (done < block->length) {
+        if ((size = pread(sd, buffer + done, block->length - done,
+                          block->src + done)) == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (size == 0)
+            break; // la sorgente si è accorciata
+        for (ssize_t moved = 0; moved < size; moved += result) {
+            result = (block->dst < 0
+                          ? write(dd, buffer + done + moved, size - moved)
+                          : pwrite(dd, buffer + done + moved, size - moved,
+                                   block->dst + done + moved));
+            if (result == -1) {
+                if (errno != EINTR)
+                    return -1;
+                result = 0;
+            }
+        }
+        done += size;
+    }
+
+    return done;
+}
+
+bool uring_available(void) {
+    __uring_t ring;
+
+    if (__uring_setup(&ring, 2) == -1)
+        return false;
+    __uring_destroy(&ring);
+
+    return true;
+}
+
+int uring_copy_range(int sd, off_t src_offset, int dd, off_t dst_offset,
+                     long long length, unsigned int depth, size_t block_size,
+                     uring_stats_t *stats) {
+    uring_stats_t local_stats;
+    __uring_t ring;
+    __uring_block_t *blocks;
+    struct iovec *iovecs;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    struct stat sb;
+    char *buffers;
+    unsigned int in_flight = 0, head, tail, b;
+    unsigned int pending_cqes = 0, batch_cqes;
+    unsigned long long next = 0;
+    int error = 0;
+    ssize_t copied;
+
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(uring_stats_t));
+
+    // le letture in volo hanno posizioni esplicite: serve un file regolare
+    if (fstat(sd, &sb) == -1)
+        return -1;
+    if (!S_ISREG(sb.st_mode) || src_offset < 0 || block_size == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (length < 0)
+        length = (sb.st_size > src_offset ? sb.st_size - src_offset : 0);
+    if (length == 0)
+        return 0;
+
+    if (depth < 1)
+        depth = 1;
+    if (depth > URING_MAX_DEPTH)
+        depth = URING_MAX_DEPTH;
+    // sulla posizione corrente le scritture vanno fatte una alla volta
+    if (dst_offset < 0)
+        depth = 1;
+    if ((unsigned long long)depth * block_size > (unsigned long long)length)
+        depth = (length + block_size - 1) / block_size;
+
+    if (__uring_setup(&ring, 2 * depth) == -1)
+        return -1;
+    if (posix_memalign((void **)&buffers, 4096, depth * block_size) != 0 ||
+        (blocks = calloc(depth, sizeof(__uring_block_t))) == NULL ||
+        (iovecs = calloc(depth, sizeof(struct iovec))) == NULL) {
+        __uring_destroy(&ring);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // registra i buffer: il kernel li blocca in memoria una volta per tutte
+    for (b = 0; b < depth; b++) {
+        iovecs[b].iov_base = buffers + b * block_size;
+        iovecs[b].iov_len = block_size;
+    }
+    stats->fixed_buffers = (syscall(__NR_io_uring_register, ring.fd,
+                                    IORING_REGISTER_BUFFERS, iovecs,
+                                    depth) == 0);
+
+    while (in_flight > 0 || (error == 0 && next < (unsigned long long)length)) {
+        // riempie i blocchi liberi con nuove coppie lettura->scrittura
+        for (b = 0; b < depth && error == 0 &&
+                    next < (unsigned long long)length;
+             b++) {
+            if (blocks[b].busy)
+                continue;
+            blocks[b].busy = true;
+            blocks[b].src = src_offset + next;
+            blocks[b].dst = (dst_offset < 0 ? -1 : dst_offset + (off_t)next);
+            blocks[b].length = ((unsigned long long)length - next < block_size
+                                    ? (size_t)(length - next)
+                                    : block_size);
+            blocks[b].read_result = 0;
+            next += blocks[b].length;
+            in_flight++;
+            pending_cqes += 2; // lettura e scrittura (anche se annullata)
+
+            sqe = __uring_get_sqe(&ring);
+            __uring_prep_rw(
+                sqe, (stats->fixed_buffers ? IORING_OP_READ_FIXED
+                                           : IORING_OP_READ),
+                sd, iovecs[b].iov_base, blocks[b].length, blocks[b].src,
+                (stats->fixed_buffers ? (int)b : -1), 2 * b);
+            sqe->flags |= IOSQE_IO_LINK; // la scrittura aspetta la lettura
+            sqe = __uring_get_sqe(&ring);
+            __uring_prep_rw(
+                sqe, (stats->fixed_buffers ? IORING_OP_WRITE_FIXED
+                                           : IORING_OP_WRITE),
+                dd, iovecs[b].iov_base, blocks[b].length, blocks[b].dst,
+                (stats->fixed_buffers ? (int)b : -1), 2 * b + 1);
+        }
+
+        // una sola chiamata sottomette tutto e attende che finisca circa metà
+        // dei blocchi in volo (due completamenti ciascuno): attendendone uno
+        // solo si farebbe una chiamata per blocco, mentre così ogni giro
+        // raccoglie e rimpiazza un gruppo di blocchi mentre l'altra metà
+        // tiene occupato il dispositivo
+        batch_cqes = 2 * (depth / 2 > 0 ? depth / 2 : 1);
+        if (batch_cqes > pending_cqes)
+            batch_cqes = pending_cqes;
+        stats->submissions++;
+        if (__uring_submit_and_wait(&ring, batch_cqes) == -1) {
+            // non si possono più raccogliere i completamenti: si abbandona
+            // il ring
+            error = errno;
+            break;
+        }
+
+        head = *ring.cq_head;
+        tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            cqe = &ring.cqes[head & *ring.cq_mask];
+            b = cqe->user_data / 2;
+            pending_cqes--;
+            if (cqe->user_data % 2 == 0) { // lettura
+                blocks[b].read_result = cqe->res;
+                continue;
+            }
+
+            // scrittura: il blocco è finito (bene o male)
+            if (blocks[b].read_result < 0 &&
+                blocks[b].read_result != -ECANCELED) {
+                if (error == 0)
+                    error = -blocks[b].read_result;
+            } else if (cqe->res < 0 && cqe->res != -ECANCELED) {
+                if (error == 0)
+                    error = -cqe->res;
+            } else if ((size_t)cqe->res == blocks[b].length)
+                stats->bytes += cqe->res;
+            else if (error == 0) {
+                stats->fallbacks++;
+                if ((copied = __uring_finish_block(
+                         sd, dd, iovecs[b].iov_base, &blocks[b],
+                         (cqe->res < 0 ? 0 : cqe->res))) == -1)
+                    error = errno;
+                else
+                    stats->bytes += copied;
+            }
+            blocks[b].busy = false;
+            in_flight--;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    __uring_destroy(&ring);
+    free(iovecs);
+    free(blocks);
+    // con blocchi ancora in volo il kernel potrebbe scrivere nei buffer anche
+    // dopo la chiusura del ring: meglio perderli che riutilizzarli
+    if (in_flight == 0)
+        free(buffers);
+
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+#else
+
+bool uring_available(void) { return false; }
+
+int uring_copy_range(int sd, off_t src_offset, int dd, off_t dst_offset,
+                     long long length, unsigned int depth, size_t block_size,
+                     uring_stats_t *stats) {
+    if (stats != NULL)
+        memset(stats, 0, sizeof(uring_stats_t));
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
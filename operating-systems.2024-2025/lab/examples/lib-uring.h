@@ -0,0 +1,53 @@
+/*
+ * libreria di servizio ufficiosa per copiare dati tra descrittori con
+ * `io_uring` (Linux >= 5.6), usando direttamente le chiamate di sistema
+ * (`io_uring_setup`, `io_uring_enter`, `io_uring_register`) senza liburing:
+ * - il file viene diviso in blocchi e fino a `depth` coppie lettura->scrittura
+ *   sono in volo contemporaneamente; ogni scrittura è collegata alla propria
+ *   lettura (`IOSQE_IO_LINK`) e parte solo quando questa è terminata
+ * - i buffer dei blocchi sono registrati presso il kernel una volta sola
+ *   (`IORING_REGISTER_BUFFERS`, operazioni `*_FIXED`): se il limite di memoria
+ *   bloccabile non lo permette si usano le operazioni normali
+ * - le nuove richieste vengono accumulate e sottomesse in blocco con la
+ *   stessa `io_uring_enter` che attende il completamento di circa metà dei
+ *   blocchi in volo, poi tutti i blocchi liberi vengono riempiti di nuovo
+ *
+ * dove `io_uring` non è disponibile (altri sistemi, header mancanti, kernel
+ * vecchio o disabilitato) le funzioni falliscono con `errno` a `ENOSYS` e il
+ * chiamante può ripiegare sulle chiamate bloccanti.
+ */
+
+#ifndef LIB_OSLAB_URING_H
+#define LIB_OSLAB_URING_H
+
+#include "lib-misc.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define URING_DEFAULT_DEPTH 16               // coppie lettura->scrittura in volo
+#define URING_DEFAULT_BLOCK_SIZE (256 * 1024) // byte per blocco
+#define URING_MAX_DEPTH 256
+
+typedef struct {
+    unsigned long long bytes; // byte copiati
+    unsigned long submissions; // chiamate `io_uring_enter` eseguite
+    unsigned long fallbacks;   // blocchi completati con `pread`/`pwrite`
+    bool fixed_buffers;        // buffer registrati usati davvero
+} uring_stats_t;
+
+/* vero se su questo sistema è possibile creare un `io_uring` */
+bool uring_available(void);
+
+/* copia `length` byte (se negativo: fino alla fine della sorgente) dalla
+ * posizione `src_offset` della sorgente `sd` (un file regolare) alla posizione
+ * `dst_offset` della destinazione `dd`; con `dst_offset` negativo si scrive
+ * sulla posizione corrente (es. pipe o terminale) e si tiene in volo un solo
+ * blocco per non riordinare le scritture; le posizioni correnti dei
+ * descrittori non vengono usate né modificate (salvo il caso precedente);
+ * restituisce 0 o -1 con `errno` impostato; `stats` (opzionale) viene
+ * azzerato e riempito */
+int uring_copy_range(int sd, off_t src_offset, int dd, off_t dst_offset,
+                     long long length, unsigned int depth, size_t block_size,
+                     uring_stats_t *stats);
+
+#endif /* LIB_OSLAB_URING_H */
@@ -0,0 +1,784 @@
+/*
+ * libreria di servizio ufficiosa per l'indice invertito delle parole (vedi
+ * `lib-word-index.h`)
+ *
+ * l'aggiornamento procede in quattro passi:
+ * 1. elenca i file delle directory con `lib-dir` e ne legge i metadati con
+ *    `fstatat`; i file che compaiono nel vecchio indice con gli stessi
+ *    metadati sono invariati e ricevono solo il nuovo numero
+ * 2. divide i file da leggere in pezzi elaborati in parallelo con
+ *    `ws_parallel_for`: ogni pezzo ha la propria tabella hash parola ->
+ *    postings, quindi i lavoratori non condividono nulla; i file di un pezzo
+ *    sono letti in sequenza, così il postings di una parola per il file
+ *    corrente è sempre l'ultimo e il conteggio è un semplice incremento
+ * 3. unisce in una sola tabella i postings dei file invariati (rinumerati)
+ *    presi dal vecchio indice mappato e quelli delle tabelle dei pezzi
+ * 4. ordina il dizionario e scrive il nuovo file accanto al vecchio, poi lo
+ *    rinomina sopra di esso
+ *
+ * in lettura il dizionario viene cercato per bisezione direttamente nella
+ * mappa: una ricerca tocca poche pagine dell'indice e nessun file indicizzato.
+ */
+
+#include "lib-word-index.h"
+#include "lib-dir.h"
+#include "lib-work-stealing.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WORD_INDEX_CHUNKS_PER_WORKER 8 // pezzi per lavoratore (bilanciamento)
+#define WORD_INDEX_MAP_CAPACITY 1024   // posizioni iniziali di una tabella
+#define WORD_INDEX_WRITE_BUFFER (1 << 20)
+#define WORD_INDEX_NONE UINT32_MAX      // file senza numero nel vecchio indice
+#define WORD_INDEX_SEEN (UINT32_MAX - 1) // file ancora presente ma modificato
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/* una parola nella tabella hash con i suoi postings in costruzione */
+typedef struct {
+    char *term; // in minuscolo e terminata da zero (NULL: posizione libera)
+    uint32_t length;
+    uint32_t hash;
+    word_index_posting_t *postings;
+    uint32_t num_postings;
+    uint32_t max_postings;
+} word_index_entry_t;
+
+/* tabella hash a indirizzamento aperto (scansione lineare) */
+typedef struct {
+    word_index_entry_t *slots;
+    size_t capacity; // potenza di 2
+    size_t used;
+} word_index_map_t;
+
+/* un file trovato nelle directory */
+typedef struct {
+    char *path;
+    word_index_file_t meta;
+    uint32_t old; // numero nel vecchio indice se invariato, o `WORD_INDEX_NONE`
+} word_index_source_t;
+
+/* lo stato condiviso dai pezzi di lettura */
+typedef struct {
+    word_index_source_t *sources;
+    uint32_t *todo; // numeri dei file da leggere
+    size_t num_todo;
+    size_t num_chunks;
+    word_index_map_t *maps;     // una tabella per pezzo
+    unsigned long long *bytes;  // byte letti per pezzo
+} word_index_build_data_t;
+
+static inline bool __is_space(unsigned char c) {
+    return (c == ' ' || (c >= '\t' && c <= '\r'));
+}
+
+static inline unsigned char __lower(unsigned char c) {
+    return (c >= 'A' && c <= 'Z' ? c | 0x20 : c);
+}
+
+static uint32_t __hash_string(const char *s, size_t length) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)s[i]) * FNV_PRIME;
+    return hash;
+}
+
+/* ordine del dizionario: byte per byte (senza segno), poi per lunghezza */
+static int __compare_terms(const char *a, size_t a_length, const char *b,
+                           size_t b_length) {
+    int cmp = memcmp(a, b, (a_length < b_length ? a_length : b_length));
+
+    if (cmp != 0)
+        return cmp;
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+static void __map_init(word_index_map_t *map) {
+    map->capacity = WORD_INDEX_MAP_CAPACITY;
+    map->used = 0;
+    if ((map->slots = calloc(map->capacity, sizeof(word_index_entry_t))) ==
+        NULL)
+        exit_with_sys_err("calloc");
+}
+
+static void __map_destroy(word_index_map_t *map) {
+    for (size_t i = 0; i < map->capacity; i++) {
+        free(map->slots[i].term);
+        free(map->slots[i].postings);
+    }
+    free(map->slots);
+}
+
+static void __map_grow(word_index_map_t *map) {
+    size_t capacity = map->capacity * 2, mask = capacity - 1;
+    word_index_entry_t *slots;
+
+    if ((slots = calloc(capacity, sizeof(word_index_entry_t))) == NULL)
+        exit_with_sys_err("calloc");
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->slots[i].term == NULL)
+            continue;
+        size_t j = map->slots[i].hash & mask;
+        while (slots[j].term != NULL)
+            j = (j + 1) & mask;
+        slots[j] = map->slots[i];
+    }
+    free(map->slots);
+    map->slots = slots;
+    map->capacity = capacity;
+}
+
+/* la voce della parola `word` di `length` byte (anche con maiuscole) di cui
+ * `hash` è l'hash in minuscolo, inserita vuota se manca */
+static word_index_entry_t *__map_get(word_index_map_t *map, const char *word,
+                                     uint32_t length, uint32_t hash) {
+    word_index_entry_t *entry;
+    size_t mask, i;
+
+    // al massimo mezza piena, così le scansioni restano brevi
+    if ((map->used + 1) * 2 > map->capacity)
+        __map_grow(map);
+
+    mask = map->capacity - 1;
+    for (i = hash & mask; map->slots[i].term != NULL; i = (i + 1) & mask) {
+        entry = &map->slots[i];
+        if (entry->hash != hash || entry->length != length)
+            continue;
+        uint32_t j = 0;
+        while (j < length && entry->term[j] == (char)__lower(word[j]))
+            j++;
+        if (j == length)
+            return entry;
+    }
+
+    entry = &map->slots[i];
+    if ((entry->term = malloc(length + 1)) == NULL)
+        exit_with_sys_err("malloc");
+    for (uint32_t j = 0; j < length; j++)
+        entry->term[j] = __lower(word[j]);
+    entry->term[length] = '\0';
+    entry->length = length;
+    entry->hash = hash;
+    map->used++;
+
+    return entry;
+}
+
+static void __entry_reserve(word_index_entry_t *entry, uint32_t extra) {
+    uint32_t max = (entry->max_postings > 0 ? entry->max_postings : 4);
+
+    if (entry->num_postings + extra <= entry->max_postings)
+        return;
+    while (max < entry->num_postings + extra)
+        max *= 2;
+    if ((entry->postings = realloc(entry->postings,
+                                   max * sizeof(word_index_posting_t))) == NULL)
+        exit_with_sys_err("realloc");
+    entry->max_postings = max;
+}
+
+/* conta un'occorrenza nel file `file` (l'ultimo aggiunto o uno nuovo) */
+static inline void __entry_count(word_index_entry_t *entry, uint32_t file) {
+    if (entry->num_postings > 0 &&
+        entry->postings[entry->num_postings - 1].file == file) {
+        entry->postings[entry->num_postings - 1].count++;
+        return;
+    }
+    __entry_reserve(entry, 1);
+    entry->postings[entry->num_postings].file = file;
+    entry->postings[entry->num_postings].count = 1;
+    entry->num_postings++;
+}
+
+static void __meta_from_stat(word_index_file_t *meta, const struct stat *st) {
+    meta->size = st->st_size;
+    meta->dev = st->st_dev;
+    meta->ino = st->st_ino;
+#ifdef __APPLE__
+    meta->mtime_sec = st->st_mtimespec.tv_sec;
+    meta->mtime_nsec = st->st_mtimespec.tv_nsec;
+#else
+    meta->mtime_sec = st->st_mtim.tv_sec;
+    meta->mtime_nsec = st->st_mtim.tv_nsec;
+#endif
+    meta->path_offset = 0;
+}
+
+static bool __meta_equal(const word_index_file_t *a,
+                         const word_index_file_t *b) {
+    return (a->size == b->size && a->dev == b->dev && a->ino == b->ino &&
+            a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec);
+}
+
+/* aggiunge alla tabella `map` le parole del file `source` (numero `file`):
+ * un file illeggibile viene segnalato e marcato come da rileggere la volta
+ * successiva (nessun file ha un tempo di modifica negativo) */
+static void __index_file(word_index_map_t *map, word_index_source_t *source,
+                         uint32_t file, unsigned long long *bytes) {
+    struct stat st;
+    const char *data;
+    int fd;
+
+    if ((fd = open(source->path, O_RDONLY)) == -1 || fstat(fd, &st) == -1) {
+        fprintf(stderr, "%s: %s\n", source->path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        source->meta.mtime_nsec = -1;
+        return;
+    }
+    // i metadati del file effettivamente letto, non quelli dell'elenco
+    __meta_from_stat(&source->meta, &st);
+    if (st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", source->path, strerror(errno));
+        source->meta.mtime_nsec = -1;
+        return;
+    }
+    posix_madvise((void *)data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    size_t size = st.st_size, i = 0;
+    while (i < size) {
+        while (i < size && __is_space(data[i]))
+            i++;
+        if (i == size)
+            break;
+
+        size_t begin = i;
+        uint32_t hash = FNV_OFFSET_BASIS;
+        while (i < size && !__is_space(data[i]))
+            hash = (hash ^ __lower(data[i++])) * FNV_PRIME;
+        if (i - begin > UINT32_MAX)
+            continue; // non rappresentabile nel dizionario
+
+        __entry_count(__map_get(map, data + begin, i - begin, hash), file);
+    }
+    *bytes += size;
+
+    munmap((void *)data, st.st_size);
+}
+
+static void __build_chunks(long begin, long end, void *arg) {
+    word_index_build_data_t *build = arg;
+
+    for (long c = begin; c < end; c++) {
+        size_t first = c * build->num_todo / build->num_chunks;
+        size_t last = (c + 1) * build->num_todo / build->num_chunks;
+
+        __map_init(&build->maps[c]);
+        for (size_t t = first; t < last; t++)
+            __index_file(&build->maps[c], &build->sources[build->todo[t]],
+                         build->todo[t], &build->bytes[c]);
+    }
+}
+
+/* aggiunge a `sources` i file regolari di `dir`, escluso l'indice stesso */
+static void __list_dir(const char *dir, const struct stat *self,
+                       word_index_source_t **sources, size_t *num_sources,
+                       size_t *max_sources) {
+    dir_scan_t scan;
+    dir_entry_t entry;
+    struct stat st;
+    int ret;
+
+    if (dir_scan_open(&scan, AT_FDCWD, dir) == -1) {
+        fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+        return;
+    }
+
+    while ((ret = dir_scan_next(&scan, &entry)) == 1) {
+        // i collegamenti simbolici vengono seguiti (come con `stat`)
+        if (entry.type != DIR_ENTRY_FILE && entry.type != DIR_ENTRY_SYMLINK)
+            continue;
+        if (fstatat(scan.fd, entry.name, &st, 0) == -1 || !S_ISREG(st.st_mode))
+            continue;
+        if (self != NULL && st.st_dev == self->st_dev &&
+            st.st_ino == self->st_ino)
+            continue;
+
+        if (*num_sources == *max_sources) {
+            *max_sources = (*max_sources > 0 ? *max_sources * 2 : 1024);
+            *sources = realloc(*sources,
+                               *max_sources * sizeof(word_index_source_t));
+            if (*sources == NULL)
+                exit_with_sys_err("realloc");
+        }
+        word_index_source_t *source = &(*sources)[(*num_sources)++];
+        size_t length = strlen(dir) + 1 + strlen(entry.name) + 1;
+        if ((source->path = malloc(length)) == NULL)
+            exit_with_sys_err("malloc");
+        snprintf(source->path, length, "%s/%s", dir, entry.name);
+        __meta_from_stat(&source->meta, &st);
+        source->old = WORD_INDEX_NONE;
+    }
+    if (ret == -1)
+        fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+
+    dir_scan_close(&scan);
+}
+
+/* vero se la voce `term` punta dentro la mappa */
+static bool __term_valid(const word_index_t *index,
+                         const word_index_term_t *term) {
+    uint64_t strings_size = index->size - index->header->strings_offset;
+
+    return (term->term_offset < strings_size &&
+            term->term_length < strings_size - term->term_offset &&
+            index->strings[term->term_offset + term->term_length] == '\0' &&
+            term->first_posting <= index->header->num_postings &&
+            term->num_postings <=
+                index->header->num_postings - term->first_posting);
+}
+
+/* assegna ai file invariati il loro numero nel vecchio indice (`old_to_new`
+ * inizializzato a `WORD_INDEX_NONE`); restituisce quanti file del vecchio
+ * indice sono ancora presenti, invariati o no */
+static size_t __match_old(const word_index_t *old, word_index_source_t *sources,
+                          size_t num_sources, uint32_t *old_to_new) {
+    size_t capacity = 1, mask, found = 0;
+    uint32_t *table, num_old = old->header->num_files;
+
+    while (capacity < 2 * (size_t)num_old)
+        capacity *= 2;
+    mask = capacity - 1;
+    if ((table = malloc(capacity * sizeof(uint32_t))) == NULL)
+        exit_with_sys_err("malloc");
+    memset(table, 0xff, capacity * sizeof(uint32_t));
+
+    for (uint32_t f = 0; f < num_old; f++) {
+        const char *path = word_index_path(old, f);
+        if (path == NULL)
+            continue;
+        size_t i = __hash_string(path, strlen(path)) & mask;
+        while (table[i] != WORD_INDEX_NONE)
+            i = (i + 1) & mask;
+        table[i] = f;
+    }
+
+    for (size_t s = 0; s < num_sources; s++) {
+        const char *path = sources[s].path;
+        size_t i = __hash_string(path, strlen(path)) & mask;
+        for (; table[i] != WORD_INDEX_NONE; i = (i + 1) & mask) {
+            uint32_t f = table[i];
+            if (strcmp(word_index_path(old, f), path) != 0)
+                continue;
+            found++;
+            if (__meta_equal(&old->files[f], &sources[s].meta)) {
+                sources[s].old = f;
+                old_to_new[f] = s;
+            } else
+                old_to_new[f] = WORD_INDEX_SEEN;
+            break;
+        }
+    }
+
+    free(table);
+    return found;
+}
+
+static int __compare_entries(const void *a, const void *b) {
+    const word_index_entry_t *x = *(word_index_entry_t *const *)a;
+    const word_index_entry_t *y = *(word_index_entry_t *const *)b;
+
+    return __compare_terms(x->term, x->length, y->term, y->length);
+}
+
+static int __compare_postings(const void *a, const void *b) {
+    const word_index_posting_t *x = a, *y = b;
+
+    return (x->file > y->file) - (x->file < y->file);
+}
+
+/* scrive l'indice in `path`.tmp e lo rinomina in `path` */
+static int __write_index(const char *path, const word_index_source_t *sources,
+                         size_t num_sources, word_index_entry_t **entries,
+                         size_t num_entries, uint64_t num_postings) {
+    word_index_header_t header;
+    word_index_file_t file;
+    word_index_term_t term;
+    uint64_t strings_size = 0, offset, first;
+    size_t length = strlen(path) + sizeof(".tmp");
+    char *tmp_path;
+    FILE *out;
+    int saved_errno;
+
+    for (size_t s = 0; s < num_sources; s++)
+        strings_size += strlen(sources[s].path) + 1;
+    for (size_t t = 0; t < num_entries; t++)
+        strings_size += entries[t]->length + 1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WORD_INDEX_MAGIC, sizeof(header.magic));
+    header.num_files = num_sources;
+    header.num_terms = num_entries;
+    header.num_postings = num_postings;
+    header.files_offset = sizeof(header);
+    header.terms_offset =
+        header.files_offset + num_sources * sizeof(word_index_file_t);
+    header.postings_offset =
+        header.terms_offset + num_entries * sizeof(word_index_term_t);
+    header.strings_offset =
+        header.postings_offset + num_postings * sizeof(word_index_posting_t);
+    header.size = header.strings_offset + strings_size;
+
+    if ((tmp_path = malloc(length)) == NULL)
+        exit_with_sys_err("malloc");
+    snprintf(tmp_path, length, "%s.tmp", path);
+    if ((out = fopen(tmp_path, "w")) == NULL) {
+        free(tmp_path);
+        return -1;
+    }
+    setvbuf(out, NULL, _IOFBF, WORD_INDEX_WRITE_BUFFER);
+
+    fwrite(&header, sizeof(header), 1, out);
+    offset = 0;
+    for (size_t s = 0; s < num_sources; s++) {
+        file = sources[s].meta;
+        file.path_offset = offset;
+        fwrite(&file, sizeof(file), 1, out);
+        offset += strlen(sources[s].path) + 1;
+    }
+    first = 0;
+    for (size_t t = 0; t < num_entries; t++) {
+        term.term_offset = offset;
+        term.first_posting = first;
+        term.term_length = entries[t]->length;
+        term.num_postings = entries[t]->num_postings;
+        fwrite(&term, sizeof(term), 1, out);
+        offset += entries[t]->length + 1;
+        first += entries[t]->num_postings;
+    }
+    for (size_t t = 0; t < num_entries; t++)
+        fwrite(entries[t]->postings, sizeof(word_index_posting_t),
+               entries[t]->num_postings, out);
+    for (size_t s = 0; s < num_sources; s++)
+        fwrite(sources[s].path, strlen(sources[s].path) + 1, 1, out);
+    for (size_t t = 0; t < num_entries; t++)
+        fwrite(entries[t]->term, entries[t]->length + 1, 1, out);
+
+    if (ferror(out)) {
+        saved_errno = errno;
+        fclose(out);
+        goto error;
+    }
+    if (fclose(out) == EOF || rename(tmp_path, path) == -1) {
+        saved_errno = errno;
+        goto error;
+    }
+    free(tmp_path);
+    return 0;
+
+error:
+    unlink(tmp_path);
+    free(tmp_path);
+    errno = saved_errno;
+    return -1;
+}
+
+int word_index_update(const char *path, const char *const *dirs,
+                      unsigned int num_dirs, unsigned int threads,
+                      word_index_stats_t *stats) {
+    word_index_t old;
+    bool have_old = false, have_self;
+    struct stat self;
+    word_index_source_t *sources = NULL;
+    size_t num_sources = 0, max_sources = 0, found = 0;
+    uint32_t *old_to_new = NULL;
+    word_index_build_data_t build;
+    word_index_map_t all;
+    word_index_entry_t **entries;
+    size_t num_entries = 0;
+    uint64_t num_postings = 0;
+    word_index_stats_t local_stats;
+    int ret;
+
+    assert(path && dirs);
+    if (stats == NULL)
+        stats = &local_stats;
+    memset(stats, 0, sizeof(word_index_stats_t));
+
+    if (word_index_open(&old, path) == 0)
+        have_old = true;
+    else if (errno == EINVAL)
+        fprintf(stderr, "%s: indice non valido, viene ricostruito\n", path);
+    else if (errno != ENOENT)
+        return -1;
+
+    // 1. elenco dei file e confronto con il vecchio indice
+    have_self = (stat(path, &self) == 0);
+    for (unsigned int d = 0; d < num_dirs; d++) {
+        // una directory passata due volte darebbe percorsi ripetuti
+        unsigned int e = 0;
+        while (e < d && strcmp(dirs[e], dirs[d]) != 0)
+            e++;
+        if (e < d)
+            continue;
+        __list_dir(dirs[d], (have_self ? &self : NULL), &sources, &num_sources,
+                   &max_sources);
+    }
+    if (num_sources >= WORD_INDEX_SEEN)
+        exit_with_err_msg("%s: troppi file per l'indice\n", path);
+
+    if (have_old) {
+        if ((old_to_new = malloc(old.header->num_files * sizeof(uint32_t) +
+                                 1)) == NULL)
+            exit_with_sys_err("malloc");
+        memset(old_to_new, 0xff, old.header->num_files * sizeof(uint32_t));
+        found = __match_old(&old, sources, num_sources, old_to_new);
+    }
+
+    memset(&build, 0, sizeof(build));
+    build.sources = sources;
+    if ((build.todo = malloc(num_sources * sizeof(uint32_t) + 1)) == NULL)
+        exit_with_sys_err("malloc");
+    for (size_t s = 0; s < num_sources; s++) {
+        if (sources[s].old == WORD_INDEX_NONE)
+            build.todo[build.num_todo++] = s;
+    }
+
+    stats->files = num_sources;
+    stats->scanned = build.num_todo;
+    stats->reused = num_sources - build.num_todo;
+    stats->removed = (have_old ? old.header->num_files - found : 0);
+
+    if (have_old && build.num_todo == 0 && stats->removed == 0) {
+        // niente da rileggere: l'indice resta quello che è
+        stats->terms = old.header->num_terms;
+        stats->postings = old.header->num_postings;
+        ret = 0;
+        goto done;
+    }
+
+    // 2. lettura in parallelo dei file nuovi o modificati
+    if (threads < 1)
+        threads = 1;
+    build.num_chunks = threads * WORD_INDEX_CHUNKS_PER_WORKER;
+    if (build.num_chunks > build.num_todo)
+        build.num_chunks = build.num_todo;
+    if (build.num_chunks > 0) {
+        ws_pool_t pool;
+
+        if ((build.maps = calloc(build.num_chunks, sizeof(word_index_map_t))) ==
+                NULL ||
+            (build.bytes = calloc(build.num_chunks,
+                                  sizeof(unsigned long long))) == NULL)
+            exit_with_sys_err("calloc");
+        ws_pool_init(&pool, threads);
+        ws_parallel_for(&pool, 0, build.num_chunks, 1, __build_chunks, &build);
+        ws_pool_destroy(&pool);
+    }
+
+    // 3. unione: prima i file invariati, poi i pezzi nell'ordine
+    __map_init(&all);
+    if (have_old) {
+        for (uint64_t t = 0; t < old.header->num_terms; t++) {
+            const word_index_term_t *term = &old.terms[t];
+            const char *word = old.strings + term->term_offset;
+            word_index_entry_t *entry = NULL;
+
+            if (!__term_valid(&old, term))
+                continue;
+            for (uint32_t p = 0; p < term->num_postings; p++) {
+                const word_index_posting_t *posting =
+                    &old.postings[term->first_posting + p];
+                uint32_t file = (posting->file < old.header->num_files
+                                     ? old_to_new[posting->file]
+                                     : WORD_INDEX_NONE);
+                if (file >= num_sources)
+                    continue; // file sparito o da rileggere
+                if (entry == NULL)
+                    entry = __map_get(&all, word, term->term_length,
+                                      __hash_string(word, term->term_length));
+                __entry_reserve(entry, 1);
+                entry->postings[entry->num_postings].file = file;
+                entry->postings[entry->num_postings].count = posting->count;
+                entry->num_postings++;
+            }
+        }
+    }
+    for (size_t c = 0; c < build.num_chunks; c++) {
+        word_index_map_t *map = &build.maps[c];
+
+        for (size_t i = 0; i < map->capacity; i++) {
+            word_index_entry_t *from = &map->slots[i], *entry;
+            if (from->term == NULL)
+                continue;
+            entry = __map_get(&all, from->term, from->length, from->hash);
+            __entry_reserve(entry, from->num_postings);
+            memcpy(entry->postings + entry->num_postings, from->postings,
+                   from->num_postings * sizeof(word_index_posting_t));
+            entry->num_postings += from->num_postings;
+        }
+        stats->bytes += build.bytes[c];
+        __map_destroy(map);
+    }
+
+    // 4. dizionario ordinato, postings ordinati per file
+    if ((entries = malloc(all.used * sizeof(word_index_entry_t *) + 1)) ==
+        NULL)
+        exit_with_sys_err("malloc");
+    for (size_t i = 0; i < all.capacity; i++) {
+        word_index_entry_t *entry = &all.slots[i];
+        if (entry->term == NULL || entry->num_postings == 0)
+            continue;
+        for (uint32_t p = 1; p < entry->num_postings; p++) {
+            if (entry->postings[p - 1].file > entry->postings[p].file) {
+                qsort(entry->postings, entry->num_postings,
+                      sizeof(word_index_posting_t), __compare_postings);
+                break;
+            }
+        }
+        entries[num_entries++] = entry;
+        num_postings += entry->num_postings;
+    }
+    qsort(entries, num_entries, sizeof(word_index_entry_t *),
+          __compare_entries);
+
+    if (have_old) {
+        // la mappa va chiusa prima di sostituire il file
+        word_index_close(&old);
+        have_old = false;
+    }
+    ret = __write_index(path, sources, num_sources, entries, num_entries,
+                        num_postings);
+    stats->terms = num_entries;
+    stats->postings = num_postings;
+    stats->written = (ret == 0);
+
+    free(entries);
+    __map_destroy(&all);
+    free(build.maps);
+    free(build.bytes);
+
+done:
+    if (have_old)
+        word_index_close(&old);
+    for (size_t s = 0; s < num_sources; s++)
+        free(sources[s].path);
+    free(sources);
+    free(build.todo);
+    free(old_to_new);
+
+    return ret;
+}
+
+int word_index_open(word_index_t *index, const char *path) {
+    struct stat st;
+    const word_index_header_t *header;
+    const char *base;
+    uint64_t size;
+    int fd;
+
+    assert(index && path);
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return -1;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)st.st_size < sizeof(word_index_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    index->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index->map == MAP_FAILED)
+        return -1;
+    index->size = st.st_size;
+
+    // solo l'intestazione: le singole voci sono controllate quando servono
+    header = index->header = index->map;
+    size = index->size;
+    if (memcmp(header->magic, WORD_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->size != size || header->files_offset % 8 != 0 ||
+        header->terms_offset % 8 != 0 || header->postings_offset % 8 != 0 ||
+        header->files_offset > size || header->terms_offset > size ||
+        header->postings_offset > size || header->strings_offset > size ||
+        header->num_files >= WORD_INDEX_NONE ||
+        header->num_files > (size - header->files_offset) /
+                                sizeof(word_index_file_t) ||
+        header->num_terms > (size - header->terms_offset) /
+                                sizeof(word_index_term_t) ||
+        header->num_postings > (size - header->postings_offset) /
+                                   sizeof(word_index_posting_t) ||
+        (header->strings_offset < size &&
+         ((const char *)index->map)[size - 1] != '\0')) {
+        munmap(index->map, index->size);
+        errno = EINVAL;
+        return -1;
+    }
+    base = index->map;
+    index->files = (const void *)(base + header->files_offset);
+    index->terms = (const void *)(base + header->terms_offset);
+    index->postings = (const void *)(base + header->postings_offset);
+    index->strings = base + header->strings_offset;
+
+    return 0;
+}
+
+unsigned int word_index_lookup(const word_index_t *index, const char *word,
+                               const word_index_posting_t **postings) {
+    size_t length = strlen(word), low = 0, high = index->header->num_terms;
+
+    assert(index && word && postings);
+
+    *postings = NULL;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const word_index_term_t *term = &index->terms[middle];
+        const char *s;
+        size_t common;
+        int cmp = 0;
+
+        if (!__term_valid(index, term))
+            return 0;
+        s = index->strings + term->term_offset;
+        common = (length < term->term_length ? length : term->term_length);
+        for (size_t i = 0; i < common && cmp == 0; i++)
+            cmp = (int)__lower(word[i]) - (int)(unsigned char)s[i];
+        if (cmp == 0)
+            cmp = (length > term->term_length) - (length < term->term_length);
+
+        if (cmp == 0) {
+            *postings = index->postings + term->first_posting;
+            return term->num_postings;
+        }
+        if (cmp < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+
+    return 0;
+}
+
+const char *word_index_path(const word_index_t *index, uint32_t file) {
+    assert(index);
+
+    if (file >= index->header->num_files ||
+        index->files[file].path_offset >=
+            index->size - index->header->strings_offset)
+        return NULL;
+    return index->strings + index->files[file].path_offset;
+}
+
+void word_index_close(word_index_t *index) {
+    assert(index);
+
+    munmap(index->map, index->size);
+    index->map = NULL;
+}
@@ -0,0 +1,120 @@
+/*
+ * libreria di servizio ufficiosa per un indice invertito persistente delle
+ * parole contenute nei file regolari di un insieme di directory, pensato per
+ * ripetere molte ricerche sugli stessi file senza rileggerli ogni volta:
+ * - l'indice è un unico file che viene mappato in memoria così com'è: una
+ *   tabella dei file (percorso, dimensione, data di modifica, dispositivo e
+ *   inode), un dizionario ordinato delle parole e, per ogni parola, l'elenco
+ *   (postings) delle coppie (file, occorrenze)
+ * - le parole sono quelle di `word_count` di `lib-misc`: sequenze delimitate
+ *   dagli spazi bianchi, senza distinguere maiuscole e minuscole ASCII (nel
+ *   dizionario sono memorizzate in minuscolo)
+ * - `word_index_update` confronta i metadati dei file presenti con quelli
+ *   registrati e rilegge solo i file nuovi o modificati, in parallelo con il
+ *   pool di `lib-work-stealing`; i postings dei file invariati vengono
+ *   ricopiati dal vecchio indice e, se nulla è cambiato, l'indice non viene
+ *   neanche riscritto
+ * - l'indice nuovo viene scritto in un file temporaneo e poi rinominato: chi
+ *   ha già mappato il vecchio continua a vederlo intatto
+ *
+ * il formato usa l'ordine dei byte e l'allineamento della macchina: l'indice
+ * non è pensato per essere spostato tra architetture diverse.
+ */
+
+#ifndef LIB_OSLAB_WORD_INDEX_H
+#define LIB_OSLAB_WORD_INDEX_H
+
+#include "lib-misc.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORD_INDEX_MAGIC "FWINDEX1" // 8 byte all'inizio del file
+
+/* intestazione: gli offset sono in byte dall'inizio del file */
+typedef struct {
+    char magic[8];
+    uint64_t num_files;
+    uint64_t num_terms;
+    uint64_t num_postings;
+    uint64_t files_offset;    // `word_index_file_t[num_files]`
+    uint64_t terms_offset;    // `word_index_term_t[num_terms]`, in ordine
+    uint64_t postings_offset; // `word_index_posting_t[num_postings]`
+    uint64_t strings_offset;  // percorsi e parole terminati da zero
+    uint64_t size;            // dimensione totale del file
+} word_index_header_t;
+
+/* un file indicizzato con i metadati che ne rivelano le modifiche */
+typedef struct {
+    uint64_t size;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t path_offset; // relativo a `strings_offset`
+} word_index_file_t;
+
+/* una parola del dizionario con i suoi postings (ordinati per file) */
+typedef struct {
+    uint64_t term_offset;   // relativo a `strings_offset`
+    uint64_t first_posting; // indice nell'array dei postings
+    uint32_t term_length;
+    uint32_t num_postings;
+} word_index_term_t;
+
+typedef struct {
+    uint32_t file;  // indice nella tabella dei file
+    uint32_t count; // occorrenze della parola nel file
+} word_index_posting_t;
+
+/* un indice aperto in sola lettura */
+typedef struct {
+    void *map;
+    size_t size;
+    const word_index_header_t *header;
+    const word_index_file_t *files;
+    const word_index_term_t *terms;
+    const word_index_posting_t *postings;
+    const char *strings;
+} word_index_t;
+
+typedef struct {
+    unsigned int files;            // file nell'indice aggiornato
+    unsigned int scanned;          // file letti perché nuovi o modificati
+    unsigned int reused;           // file invariati, non riletti
+    unsigned int removed;          // file spariti dall'indice precedente
+    unsigned long long bytes;      // byte letti dai file `scanned`
+    unsigned long long terms;      // parole distinte nell'indice
+    unsigned long long postings;   // coppie (parola, file) nell'indice
+    bool written;                  // false se l'indice era già aggiornato
+} word_index_stats_t;
+
+/* porta l'indice `path` allo stato attuale dei file regolari (anche
+ * attraverso collegamenti simbolici) contenuti direttamente nelle
+ * `num_dirs` directory di `dirs`, registrati come "directory/nome": lo crea
+ * se non esiste (o non è un indice valido) e rilegge con `threads`
+ * lavoratori solo i file la cui dimensione, data di modifica o inode sono
+ * cambiati; le directory o i file che non si possono leggere vengono
+ * segnalati sullo standard error e lasciati fuori dall'indice; restituisce 0
+ * o -1 con `errno` impostato se l'indice non si può scrivere; `stats` è
+ * opzionale */
+int word_index_update(const char *path, const char *const *dirs,
+                      unsigned int num_dirs, unsigned int threads,
+                      word_index_stats_t *stats);
+
+/* mappa l'indice `path` in `index`: restituisce 0 o -1 con `errno` impostato
+ * (`EINVAL` se il file non è un indice valido) */
+int word_index_open(word_index_t *index, const char *path);
+
+/* cerca `word` (senza distinguere maiuscole e minuscole ASCII) e restituisce
+ * il numero dei suoi postings, con in `*postings` il puntatore al primo
+ * dentro la mappa (0 se la parola non compare in nessun file) */
+unsigned int word_index_lookup(const word_index_t *index, const char *word,
+                               const word_index_posting_t **postings);
+
+/* il percorso del file `file` dell'indice */
+const char *word_index_path(const word_index_t *index, uint32_t file);
+
+void word_index_close(word_index_t *index);
+
+#endif /* LIB_OSLAB_WORD_INDEX_H */
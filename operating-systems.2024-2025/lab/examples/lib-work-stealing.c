@@ -0,0 +1,368 @@
+/*
+ * libreria di servizio ufficiosa per distribuire il lavoro tra più thread con
+ * la tecnica del "work stealing" (vedi `lib-work-stealing.h`)
+ *
+ * le code dei lavoratori seguono l'algoritmo di Chase e Lev nella versione
+ * per modelli di memoria deboli di Lê et al. ("Correct and Efficient
+ * Work-Stealing for Weak Memory Models", 2013) con capacità fissa: se la coda
+ * è piena il compito viene semplicemente eseguito subito da chi lo crea.
+ */
+
+#include "lib-work-stealing.h"
+#include <sched.h>
+
+#define WS_DEQUE_MASK (WS_DEQUE_CAPACITY - 1)
+#define WS_SPIN_LIMIT 64       // tentativi a vuoto prima di addormentarsi
+#define WS_TASKS_PER_WORKER 8 // pezzi per lavoratore con `grain` automatico
+
+/* lavoratore associato al thread corrente (NULL se non appartiene a un pool) */
+static __thread ws_worker_t *__ws_current_worker = NULL;
+
+/* i campi di un compito sono letti e scritti singolarmente in modo atomico:
+ * un ladro può leggere uno slot mentre (dopo un suo furto fallito) viene
+ * riscritto dal proprietario e in quel caso il valore letto viene scartato */
+static void __ws_task_store(ws_task_t *slot, const ws_task_t *task) {
+    __atomic_store_n(&slot->task_function, task->task_function,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->range_function, task->range_function,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->arg, task->arg, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->begin, task->begin, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->end, task->end, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->grain, task->grain, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->group, task->group, __ATOMIC_RELAXED);
+}
+
+static void __ws_task_load(ws_task_t *task, ws_task_t *slot) {
+    task->task_function = __atomic_load_n(&slot->task_function,
+                                          __ATOMIC_RELAXED);
+    task->range_function = __atomic_load_n(&slot->range_function,
+                                           __ATOMIC_RELAXED);
+    task->arg = __atomic_load_n(&slot->arg, __ATOMIC_RELAXED);
+    task->begin = __atomic_load_n(&slot->begin, __ATOMIC_RELAXED);
+    task->end = __atomic_load_n(&slot->end, __ATOMIC_RELAXED);
+    task->grain = __atomic_load_n(&slot->grain, __ATOMIC_RELAXED);
+    task->group = __atomic_load_n(&slot->group, __ATOMIC_RELAXED);
+}
+
+/* inserimento sul fondo (solo il proprietario) */
+static bool __ws_deque_push(ws_deque_t *deque, const ws_task_t *task) {
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+    long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+    if (bottom - top >= WS_DEQUE_CAPACITY)
+        return false;
+
+    __ws_task_store(&deque->tasks[bottom & WS_DEQUE_MASK], task);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+/* estrazione dal fondo (solo il proprietario): l'ultimo compito rimasto è
+ * conteso con i ladri e si assegna con un CAS su `top` */
+static bool __ws_deque_take(ws_deque_t *deque, ws_task_t *task) {
+    long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+    long top;
+    bool found = true;
+
+    __atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+    if (top > bottom) {
+        // coda vuota
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    __ws_task_load(task, &deque->tasks[bottom & WS_DEQUE_MASK]);
+    if (top == bottom) {
+        found = __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+    }
+
+    return found;
+}
+
+/* furto dalla cima (qualsiasi altro lavoratore): fallisce anche se un altro
+ * ladro (o il proprietario) vince la gara per lo stesso compito */
+static bool __ws_deque_steal(ws_deque_t *deque, ws_task_t *task) {
+    long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+    long bottom;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+    if (top >= bottom)
+        return false;
+
+    __ws_task_load(task, &deque->tasks[top & WS_DEQUE_MASK]);
+
+    return __atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static long __ws_deque_size(ws_deque_t *deque) {
+    return __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) -
+           __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+}
+
+static ws_worker_t *__ws_self(ws_pool_t *pool) {
+    if (__ws_current_worker == NULL || __ws_current_worker->pool_ptr != pool)
+        exit_with_err_msg("ws: il thread corrente non appartiene al pool!\n");
+
+    return __ws_current_worker;
+}
+
+/* accoda un compito e sveglia un eventuale lavoratore addormentato: il
+ * contatore dei compiti e quello dei dormienti sono entrambi aggiornati in modo
+ * sequenzialmente consistente, quindi almeno uno tra chi accoda e chi si
+ * addormenta si accorge dell'altro */
+static bool __ws_push(ws_worker_t *worker, const ws_task_t *task) {
+    ws_pool_t *pool = worker->pool_ptr;
+
+    if (!__ws_deque_push(&worker->deque, task))
+        return false;
+
+    __atomic_add_fetch(&pool->queued_tasks, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->sleeping_workers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_signal(&pool->work_available);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return true;
+}
+
+/* prima la propria coda, poi gli altri a partire da una vittima a caso */
+static bool __ws_find_task(ws_worker_t *worker, ws_task_t *task) {
+    ws_pool_t *pool = worker->pool_ptr;
+    unsigned int victim;
+
+    if (__ws_deque_take(&worker->deque, task)) {
+        __atomic_sub_fetch(&pool->queued_tasks, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    victim = rand_r(&worker->seed) % pool->num_workers;
+    for (unsigned int i = 0; i < pool->num_workers; i++) {
+        if (victim != worker->id &&
+            __ws_deque_steal(&pool->workers[victim].deque, task)) {
+            __atomic_sub_fetch(&pool->queued_tasks, 1, __ATOMIC_RELAXED);
+            worker->stolen++;
+            return true;
+        }
+        victim = (victim + 1) % pool->num_workers;
+    }
+
+    return false;
+}
+
+/* elabora `[begin, end)` a pezzi di `grain` elementi offrendo la metà destra
+ * del lavoro rimanente solo quando la propria coda è vuota (lazy binary
+ * splitting): senza ladri non si paga il costo della suddivisione, con molti
+ * ladri il lavoro si frammenta fino a `grain` */
+static void __ws_run_range(ws_worker_t *worker, long begin, long end,
+                           long grain, ws_range_function_t function, void *arg,
+                           ws_group_t *group) {
+    long chunk_end;
+    ws_task_t task;
+
+    while (begin < end) {
+        if (end - begin > grain && __ws_deque_size(&worker->deque) == 0) {
+            task.task_function = NULL;
+            task.range_function = function;
+            task.arg = arg;
+            task.begin = begin + (end - begin) / 2;
+            task.end = end;
+            task.grain = grain;
+            task.group = group;
+            __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+            if (__ws_push(worker, &task)) {
+                end = task.begin;
+                continue;
+            }
+            __atomic_sub_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+        }
+
+        chunk_end = (end - begin > grain ? begin + grain : end);
+        function(begin, chunk_end, arg);
+        begin = chunk_end;
+    }
+}
+
+static void __ws_execute(ws_worker_t *worker, ws_task_t *task) {
+    worker->executed++;
+
+    if (task->task_function != NULL)
+        task->task_function(task->arg);
+    else
+        __ws_run_range(worker, task->begin, task->end, task->grain,
+                       task->range_function, task->arg, task->group);
+
+    // `release`: chi vede il gruppo completato vede anche i risultati
+    __atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void *__ws_worker_function(void *arg) {
+    assert(arg);
+    ws_worker_t *worker = (ws_worker_t *)arg;
+    ws_pool_t *pool = worker->pool_ptr;
+    unsigned int idle = 0;
+    ws_task_t task;
+
+    __ws_current_worker = worker;
+
+    while (!__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
+        if (__ws_find_task(worker, &task)) {
+            __ws_execute(worker, &task);
+            idle = 0;
+            continue;
+        }
+
+        if (++idle < WS_SPIN_LIMIT) {
+            sched_yield();
+            continue;
+        }
+
+        // niente da fare per un po': ci si addormenta finché non arriva
+        // qualche compito
+        pthread_mutex_lock(&pool->lock);
+        __atomic_add_fetch(&pool->sleeping_workers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool->queued_tasks, __ATOMIC_SEQ_CST) == 0 &&
+               !__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        __atomic_sub_fetch(&pool->sleeping_workers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool->lock);
+        idle = 0;
+    }
+
+    return (NULL);
+}
+
+void ws_pool_init(ws_pool_t *pool, unsigned int num_workers) {
+    assert(pool);
+    assert(num_workers > 0);
+    int err;
+
+    pool->num_workers = num_workers;
+    pool->queued_tasks = 0;
+    pool->sleeping_workers = 0;
+    pool->shutdown = false;
+    if ((err = pthread_mutex_init(&pool->lock, NULL)))
+        exit_with_err("pthread_mutex_init", err);
+    if ((err = pthread_cond_init(&pool->work_available, NULL)))
+        exit_with_err("pthread_cond_init", err);
+
+    // allineamento alla linea di cache per separare `top` e `bottom`
+    if ((err = posix_memalign((void **)&pool->workers, WS_CACHE_LINE,
+                              num_workers * sizeof(ws_worker_t))))
+        exit_with_err("posix_memalign", err);
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        ws_worker_t *worker = &pool->workers[i];
+
+        worker->deque.top = 0;
+        worker->deque.bottom = 0;
+        if ((worker->deque.tasks =
+                 malloc(WS_DEQUE_CAPACITY * sizeof(ws_task_t))) == NULL)
+            exit_with_sys_err("malloc");
+        worker->id = i;
+        worker->seed = i + 1;
+        worker->executed = 0;
+        worker->stolen = 0;
+        worker->pool_ptr = pool;
+    }
+
+    // il thread chiamante è il lavoratore 0
+    pool->workers[0].tid = pthread_self();
+    __ws_current_worker = &pool->workers[0];
+    for (unsigned int i = 1; i < num_workers; i++)
+        if ((err = pthread_create(&pool->workers[i].tid, NULL,
+                                  __ws_worker_function, &pool->workers[i])))
+            exit_with_err("pthread_create", err);
+}
+
+void ws_pool_destroy(ws_pool_t *pool) {
+    assert(pool);
+    int err;
+
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->shutdown, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned int i = 1; i < pool->num_workers; i++)
+        if ((err = pthread_join(pool->workers[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+
+    for (unsigned int i = 0; i < pool->num_workers; i++)
+        free(pool->workers[i].deque.tasks);
+    if (__ws_current_worker == &pool->workers[0])
+        __ws_current_worker = NULL;
+    free(pool->workers);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_available);
+}
+
+void ws_pool_print_stats(ws_pool_t *pool) {
+    assert(pool);
+
+    for (unsigned int i = 0; i < pool->num_workers; i++)
+        printf("[ws] lavoratore %u: %lu compiti eseguiti (di cui %lu "
+               "rubati)\n",
+               i, pool->workers[i].executed, pool->workers[i].stolen);
+}
+
+void ws_parallel_for(ws_pool_t *pool, long begin, long end, long grain,
+                     ws_range_function_t function, void *arg) {
+    assert(pool);
+    assert(function);
+    ws_worker_t *worker = __ws_self(pool);
+    ws_group_t group;
+
+    if (grain <= 0)
+        grain = (end - begin) / (WS_TASKS_PER_WORKER * pool->num_workers);
+    if (grain < 1)
+        grain = 1;
+
+    ws_group_init(&group);
+    __ws_run_range(worker, begin, end, grain, function, arg, &group);
+    ws_sync(pool, &group);
+}
+
+void ws_group_init(ws_group_t *group) {
+    assert(group);
+
+    group->pending = 0;
+}
+
+void ws_spawn(ws_pool_t *pool, ws_group_t *group, ws_task_function_t function,
+              void *arg) {
+    assert(group);
+    assert(function);
+    ws_worker_t *worker = __ws_self(pool);
+    ws_task_t task = {function, NULL, arg, 0, 0, 0, group};
+
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+    if (!__ws_push(worker, &task))
+        // coda piena: il compito viene eseguito subito
+        __ws_execute(worker, &task);
+}
+
+/* attende i compiti del gruppo eseguendo nel frattempo quelli disponibili
+ * (propri o rubati) */
+void ws_sync(ws_pool_t *pool, ws_group_t *group) {
+    assert(group);
+    ws_worker_t *worker = __ws_self(pool);
+    ws_task_t task;
+
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+        if (__ws_find_task(worker, &task))
+            __ws_execute(worker, &task);
+        else
+            sched_yield();
+    }
+}
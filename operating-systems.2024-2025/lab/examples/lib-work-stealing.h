@@ -0,0 +1,91 @@
+/*
+ * libreria di servizio ufficiosa per distribuire il lavoro tra più thread con
+ * la tecnica del "work stealing":
+ * - ogni lavoratore ha una propria coda doppia (deque di Chase-Lev) in cui
+ *   inserisce ed estrae i propri compiti dal fondo senza lock, mentre i
+ *   lavoratori rimasti senza lavoro "rubano" dalla cima delle code altrui
+ * - `ws_parallel_for` spezza un intervallo di indici in modo adattivo: la
+ *   metà destra viene offerta agli altri solo se la propria coda è vuota (cioè
+ *   se qualcuno ha già rubato il pezzo precedente), così un core lento o
+ *   disturbato rallenta solo i pezzi che sta elaborando e non l'intero lavoro
+ * - `ws_spawn`/`ws_sync` permettono di lanciare compiti ricorsivi e attenderne
+ *   la fine: nell'attesa il thread continua a eseguire altri compiti
+ *
+ * il thread che inizializza il pool ne fa parte come lavoratore 0 (partecipa
+ * al lavoro solo dentro `ws_parallel_for` e `ws_sync`), gli altri
+ * `num_workers - 1` sono creati dalla libreria.
+ */
+
+#ifndef LIB_OSLAB_WORK_STEALING_H
+#define LIB_OSLAB_WORK_STEALING_H
+
+#include "lib-misc.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+#define WS_DEQUE_CAPACITY 4096 // compiti per lavoratore (potenza di 2)
+#define WS_CACHE_LINE 64
+
+typedef void (*ws_task_function_t)(void *arg);
+typedef void (*ws_range_function_t)(long begin, long end, void *arg);
+
+typedef struct ws_pool ws_pool_t;
+
+/* gruppo di compiti da attendere con `ws_sync` */
+typedef struct {
+    long pending;
+} ws_group_t;
+
+/* un compito: una funzione semplice (`ws_spawn`) oppure un pezzo di
+ * intervallo di un `ws_parallel_for` */
+typedef struct {
+    ws_task_function_t task_function;
+    ws_range_function_t range_function;
+    void *arg;
+    long begin, end, grain;
+    ws_group_t *group;
+} ws_task_t;
+
+typedef struct {
+    // `top` è conteso dai ladri, `bottom` è scritto solo dal proprietario
+    long top __attribute__((aligned(WS_CACHE_LINE)));
+    long bottom __attribute__((aligned(WS_CACHE_LINE)));
+    ws_task_t *tasks;
+} ws_deque_t;
+
+typedef struct {
+    ws_deque_t deque;
+    pthread_t tid;
+    unsigned int id;
+    unsigned int seed; // per la scelta casuale delle vittime
+    unsigned long executed, stolen;
+    ws_pool_t *pool_ptr;
+} ws_worker_t;
+
+struct ws_pool {
+    unsigned int num_workers;
+    ws_worker_t *workers;
+
+    long queued_tasks;     // compiti in coda (per decidere se dormire)
+    long sleeping_workers; // lavoratori bloccati su `work_available`
+    bool shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t work_available;
+};
+
+void ws_pool_init(ws_pool_t *pool, unsigned int num_workers);
+void ws_pool_destroy(ws_pool_t *pool);
+void ws_pool_print_stats(ws_pool_t *pool);
+
+/* esegue `function(b, e, arg)` su pezzi disgiunti che coprono `[begin, end)`,
+ * ognuno lungo al più `grain` (se `grain <= 0` viene scelto in base al numero
+ * di lavoratori); ritorna quando tutti i pezzi sono stati eseguiti */
+void ws_parallel_for(ws_pool_t *pool, long begin, long end, long grain,
+                     ws_range_function_t function, void *arg);
+
+void ws_group_init(ws_group_t *group);
+void ws_spawn(ws_pool_t *pool, ws_group_t *group, ws_task_function_t function,
+              void *arg);
+void ws_sync(ws_pool_t *pool, ws_group_t *group);
+
+#endif /* LIB_OSLAB_WORK_STEALING_H */
@@ -1,15 +1,50 @@
 /**
  * lista ricorsivamente il contenuto di una directory
+ *
+ * la scansione usa `lib-dir`: le voci sono lette a lotti con `getdents64`, il
+ * tipo viene dal campo `d_type` (senza una `lstat` per voce) e le
+ * sottodirectory sono aperte con `openat` relativamente alla directory madre,
+ * senza `chdir`; con `--readdir` si usa la versione originale con
+ * `opendir`/`readdir`, `chdir` e una `lstat` per ogni voce
+ *
+ * con `--quiet` le voci vengono solo contate (per misurare la scansione e non
+ * la stampa); il numero di voci al secondo viene riportato sullo standard
+ * error, ad esempio su un albero da un milione di file:
+ * > mkdir albero && cd albero && for i in $(seq 1000); do mkdir $i;
+ * >   (cd $i && seq 1000 | xargs touch); done && cd ..
+ * > ./list-dir --quiet albero; ./list-dir --readdir --quiet albero
+ * (per confrontare la scansione "a freddo" svuotare prima la cache degli
+ * inode: `sync; echo 2 | sudo tee /proc/sys/vm/drop_caches`)
+ *
+ * con `--threads N` l'albero è visitato in parallelo da N thread con
+ * `dir_walk` (work stealing sulle directory): l'elenco resta identico a quello
+ * sequenziale perché viene ricomposto in ordine alla fine; con `--unordered`
+ * ogni directory viene stampata appena finita, con i percorsi completi al
+ * posto dell'indentazione (il modo più veloce); per la cache "a freddo":
+ * > sync; echo 2 | sudo tee /proc/sys/vm/drop_caches; ./list-dir --quiet \
+ * >   --threads 8 albero
+ *
+ * uso: list-dir [--readdir | --threads N [--unordered]] [--quiet] [directory]
  */
 
+#include "lib-dir.h"
 #include "lib-misc.h"
+#include "lib-work-stealing.h"
 #include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+bool quiet = false;                // non stampa le voci
+bool unordered = false;            // `dir_walk` senza riordinare l'output
+unsigned long long entries = 0;    // voci incontrate
+unsigned long long batches = 0;    // lotti di `getdents64` letti
+unsigned long long stats = 0;      // voci interrogate sull'inode
+
 // funzione per listare ricorsivamente una directory 'dir' a profondità 'depth'
 void print_dir(const char *dir, int depth) {
     DIR *dp;
@@ -29,21 +64,28 @@ void print_dir(const char *dir, int depth) {
         // prende le informazioni sull'oggetto
         if (lstat(entry->d_name, &statbuf) == -1)
             exit_with_sys_err("lstat");
+        stats++;
 
         if (S_ISDIR(statbuf.st_mode)) { // controlla se e' una sottocartella
             // scarto le directory virtuali '.' e '..' altrimenti vado in loop
             if (strcmp(entry->d_name, ".") == 0 ||
                 strcmp(entry->d_name, "..") == 0)
                 continue;
-            printf("%*s", depth * 4, " "); // indenta
-            printf("%s/\n",
-                   entry->d_name); // stampa il nome della sottocartella
+            entries++;
+            if (!quiet) {
+                printf("%*s", depth * 4, " "); // indenta
+                printf("%s/\n",
+                       entry->d_name); // stampa il nome della sottocartella
+            }
 
             // chiama ricorsivamente la funzione sulla sottocartella
             print_dir(entry->d_name, depth + 1);
         } else {                           // e' un file
-            printf("%*s", depth * 4, " "); // indenta
-            printf("%s\n", entry->d_name); // stampa il nome della sottocartella
+            entries++;
+            if (!quiet) {
+                printf("%*s", depth * 4, " "); // indenta
+                printf("%s\n", entry->d_name); // stampa il nome del file
+            }
         }
     }
     chdir("..");
@@ -51,16 +93,99 @@ void print_dir(const char *dir, int depth) {
     closedir(dp);
 }
 
+// come 'print_dir' ma con 'lib-dir': 'dir' è relativa al descrittore 'dirfd'
+void print_dir_scan(int dirfd, const char *dir, int depth) {
+    dir_scan_t scan;
+    dir_entry_t entry;
+    int ret;
+
+    if (dir_scan_open(&scan, dirfd, dir) == -1)
+        exit_with_sys_err(dir);
+
+    while ((ret = dir_scan_next(&scan, &entry)) == 1) {
+        entries++;
+        if (!quiet) {
+            printf("%*s", depth * 4, " "); // indenta
+            printf("%s%s\n", entry.name,
+                   (entry.type == DIR_ENTRY_DIR ? "/" : ""));
+        }
+
+        // i collegamenti simbolici non vengono seguiti (come con `lstat`)
+        if (entry.type == DIR_ENTRY_DIR)
+            print_dir_scan(scan.fd, entry.name, depth + 1);
+    }
+    if (ret == -1)
+        exit_with_sys_err(dir);
+
+    batches += scan.batches;
+    stats += scan.stats;
+    dir_scan_close(&scan);
+}
+
+// visitatore di 'dir_walk': stampa la voce come 'print_dir_scan'
+bool print_visit(const dir_visit_t *visit, dir_output_t *out, void *arg) {
+    const char *suffix = (visit->entry->type == DIR_ENTRY_DIR ? "/" : "");
+    (void)arg;
+
+    if (!quiet && unordered)
+        dir_output_printf(out, "%s/%s%s\n", visit->path, visit->entry->name,
+                          suffix);
+    else if (!quiet)
+        dir_output_printf(out, "%*s%s%s\n", visit->depth * 4, " ",
+                          visit->entry->name, suffix);
+
+    return true; // scende in tutte le sottodirectory
+}
+
 int main(int argc, const char *argv[]) {
-    const char *topdir;
+    const char *topdir = ".";
+    bool use_readdir = false;
+    int arg = 1, threads = 0;
+    dir_walk_stats_t walk_stats;
+    double timestamp, elapsed;
 
-    if (argc >= 2) // e' stato specificato almeno un parametro
-        topdir = argv[1];
-    else // parte dalla cartella corrente
-        topdir = ".";
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--readdir") == 0)
+            use_readdir = true;
+        else if (strcmp(argv[arg], "--quiet") == 0)
+            quiet = true;
+        else if (strcmp(argv[arg], "--unordered") == 0)
+            unordered = true;
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+            if ((threads = atoi(argv[++arg])) < 1)
+                exit_with_err_msg("numero di thread non valido!\n");
+        }
+        else
+            exit_with_err_msg("opzione '%s' non valida!\n", argv[arg]);
+    }
+    if (arg < argc) // e' stato specificato almeno un parametro
+        topdir = argv[arg];
 
     printf("Scansione della directory '%s' ...\n", topdir);
-    print_dir(topdir, 0);
+    timestamp = seconds_now();
+    if (use_readdir)
+        print_dir(topdir, 0);
+    else if (threads > 0 || unordered) {
+        if (dir_walk(topdir, (threads > 0 ? threads : 1), !unordered, stdout,
+                     print_visit, NULL, &walk_stats) == -1)
+            exit(EXIT_FAILURE); // gli errori sono già stati segnalati
+        entries = walk_stats.entries;
+        batches = walk_stats.batches;
+        stats = walk_stats.stats;
+    } else
+        print_dir_scan(AT_FDCWD, topdir, 0);
+    fflush(stdout);
+    elapsed = seconds_now() - timestamp;
+
+    if (use_readdir)
+        fprintf(stderr, "%llu voci in %.3f s (%.0f voci/s, %llu lstat)\n",
+                entries, elapsed, entries / elapsed, stats);
+    else
+        fprintf(stderr,
+                "%llu voci in %.3f s (%.0f voci/s, %llu lotti getdents64, "
+                "%llu statx, %d thread)\n",
+                entries, elapsed, entries / elapsed, batches, stats,
+                (threads > 0 ? threads : 1));
 
     exit(EXIT_SUCCESS);
 }
@@ -1,9 +1,44 @@
 /**
  * duplica un file utilizzando 'mmap' per operare sui file
+ *
+ * la copia è "sparsa": si copiano solo le estensioni di dati della sorgente
+ * trovate con `lseek(SEEK_DATA/SEEK_HOLE)`, le pagine della destinazione mai
+ * toccate restano buchi (il file è stato esteso con `ftruncate`); con
+ * `--punch-zeros` anche le pagine tutte a zero di una sorgente densa non
+ * vengono copiate e diventano buchi
+ *
+ * i file non vengono mappati per intero ma una "finestra" alla volta
+ * (`--window`, in MiB; 0 per mappare tutto il file come nella versione
+ * originale): lo spazio di indirizzamento usato resta limitato (al più due
+ * finestre della sorgente e una della destinazione) anche con file enormi o su
+ * sistemi a 32 bit; mentre si copia una finestra si chiede al kernel di
+ * anticipare la lettura della successiva (`MADV_WILLNEED`) e, finita la
+ * copia, si rilasciano le pagine di quella corrente (`MADV_DONTNEED`)
+ *
+ * con `--threads` ogni finestra viene divisa in fette uguali copiate in
+ * parallelo; con `--populate` le finestre della sorgente vengono mappate con
+ * `MAP_POPULATE` (solo Linux) in modo che i fault avvengano tutti subito nel
+ * `mmap` e non uno per pagina durante la copia (quelle della destinazione no:
+ * la pre-scrittura riempirebbe i buchi)
+ *
+ * per confrontarla con le altre strategie, ad esempio:
+ *   head -c 4G /dev/urandom > big
+ *   ./mmap-copy --window 0 big big.copy      # tutto il file in un colpo
+ *   ./mmap-copy --window 256 --threads 4 big big.copy
+ *   time ./copy big big.copy                 # `lib-copy` (zero-copy)
+ *
+ * uso: mmap-copy [--punch-zeros] [--window MiB] [--threads n] [--populate]
+ *          <file-sorgente> <file-destinazione>
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE // per `SEEK_DATA`, `SEEK_HOLE`, `madvise` e `MAP_POPULATE`
+#endif
+
 #include "lib-misc.h"
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,28 +46,144 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#define ZERO_BLOCK 4096          // granularità del rilevamento dei blocchi nulli
+#define DEFAULT_WINDOW_MIB 256   // dimensione predefinita della finestra
+#define DEFAULT_NUM_THREADS 1
+#define MIB (1024L * 1024L)
+
+typedef struct {
+    pthread_t tid;
+    int fdin;
+    char *dst;         // finestra mappata della destinazione
+    const char *src;   // finestra mappata della sorgente
+    off_t base;        // posizione nel file dell'inizio della finestra
+    off_t begin, end;  // porzione da copiare (posizioni nel file)
+    bool punch_zeros;
+    off_t copied;      // risultato: byte effettivamente copiati
+} copy_data_t;
+
+/* copia `length` byte da `src` su `dst`, saltando (se richiesto) i blocchi
+ * nulli: restituisce i byte effettivamente copiati */
+off_t copy_extent(char *dst, const char *src, off_t length, bool punch_zeros) {
+    off_t block, copied = 0;
+
+    if (!punch_zeros) {
+        memcpy(dst, src, length);
+        return length;
+    }
+
+    for (off_t begin = 0; begin < length; begin += block) {
+        block = (length - begin < ZERO_BLOCK ? length - begin : ZERO_BLOCK);
+        for (off_t i = 0; i < block; i++)
+            if (src[begin + i] != 0) {
+                memcpy(dst + begin, src + begin, block);
+                copied += block;
+                break;
+            }
+    }
+
+    return copied;
+}
+
+/* copia le estensioni di dati della sorgente comprese nella porzione
+ * `[begin, end)` assegnata: `lseek` viene usata solo per il valore restituito,
+ * quindi più thread possono usarla sullo stesso descrittore */
+void *copy_range(void *arg) {
+    assert(arg);
+    copy_data_t *data_ptr = (copy_data_t *)arg;
+    off_t data, hole;
+
+    data_ptr->copied = 0;
+    for (data = data_ptr->begin; data < data_ptr->end; data = hole) {
+#ifdef SEEK_DATA
+        off_t next;
+        if ((next = lseek(data_ptr->fdin, data, SEEK_DATA)) == -1) {
+            if (errno == ENXIO)
+                break; // solo un buco fino alla fine
+            if (errno != EINVAL)
+                exit_with_sys_err("lseek");
+            // file system senza supporto: tutta la porzione è un'estensione
+            hole = data_ptr->end;
+        } else {
+            if ((data = next) >= data_ptr->end)
+                break;
+            if ((hole = lseek(data_ptr->fdin, data, SEEK_HOLE)) == -1)
+                exit_with_sys_err("lseek");
+        }
+#else
+        hole = data_ptr->end;
+#endif
+        if (hole > data_ptr->end)
+            hole = data_ptr->end;
+        data_ptr->copied += copy_extent(
+            data_ptr->dst + (data - data_ptr->base),
+            data_ptr->src + (data - data_ptr->base), hole - data,
+            data_ptr->punch_zeros);
+    }
+
+    return (NULL);
+}
+
+/* mappa `length` byte di `fd` a partire da `offset` (multiplo della pagina) */
+char *map_window(int fd, off_t offset, off_t length, int prot, int flags,
+                 bool populate) {
+    char *p;
+
+#ifdef MAP_POPULATE
+    if (populate)
+        flags |= MAP_POPULATE;
+#endif
+    if ((p = (char *)mmap(NULL, length, prot, flags, fd, offset)) == MAP_FAILED)
+        exit_with_sys_err("mmap");
+
+    return p;
+}
+
 int main(int argc, char *argv[]) {
-    int fdin, fdout;
-    char *src, *dst;
+    int err, fdin, fdout, arg = 1;
+    char *src, *dst, *next_src;
     struct stat sb;
+    bool punch_zeros = false, populate = false;
+    long window_mib = DEFAULT_WINDOW_MIB;
+    int num_threads = DEFAULT_NUM_THREADS;
+    off_t window, length, next_length, copied = 0;
+    double timestamp, elapsed;
 
-    if (argc < 3)
-        exit_with_err_msg("uso: %s <file-sorgente> <file-destinazione>\n",
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--punch-zeros") == 0)
+            punch_zeros = true;
+        else if (strcmp(argv[arg], "--populate") == 0)
+            populate = true;
+        else if (strcmp(argv[arg], "--window") == 0 && arg + 1 < argc) {
+            if ((window_mib = atol(argv[++arg])) < 0)
+                exit_with_err_msg("finestra (%ld MiB) non valida!\n",
+                                  window_mib);
+        } else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+            if ((num_threads = atoi(argv[++arg])) < 1)
+                exit_with_err_msg("numero di thread (%d) non valido!\n",
+                                  num_threads);
+        } else
+            break;
+    }
+    if (argc - arg < 2)
+        exit_with_err_msg("uso: %s [--punch-zeros] [--window MiB] [--threads "
+                          "n] [--populate] <file-sorgente> "
+                          "<file-destinazione>\n",
                           argv[0]);
 
     // apre il file sorgente in lettura
-    if ((fdin = open(argv[1], O_RDONLY)) == -1)
-        exit_with_sys_err(argv[1]);
+    if ((fdin = open(argv[arg], O_RDONLY)) == -1)
+        exit_with_sys_err(argv[arg]);
 
     // recupera le informazioni sul file sorgente
     if (fstat(fdin, &sb) < 0)
-        exit_with_sys_err(argv[1]);
+        exit_with_sys_err(argv[arg]);
 
     // apre il file destinazione troncandolo o creandolo
     umask(0);
-    if ((fdout = open(argv[2], O_RDWR | O_CREAT | O_TRUNC,
+    if ((fdout = open(argv[arg + 1], O_RDWR | O_CREAT | O_TRUNC,
                       (sb.st_mode & 0777))) == -1)
-        exit_with_sys_err(argv[2]);
+        exit_with_sys_err(argv[arg + 1]);
 
     // controlla se il file sorgente è vuoto: creerebbe problemi sia con
     // `lseek` che con mmap
@@ -44,27 +195,78 @@ int main(int argc, char *argv[]) {
     if (ftruncate(fdout, sb.st_size) == -1)
         exit_with_sys_err("ftruncate");
 
-    // mappa il file sorgente
-    if ((src = (char *)mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fdin,
-                            0)) == MAP_FAILED)
-        exit_with_sys_err("mmap");
+    // NB: i MiB sono multipli della dimensione della pagina, come richiesto
+    // per la posizione di partenza di `mmap`
+    window = (window_mib == 0 || window_mib * MIB > sb.st_size
+                  ? sb.st_size
+                  : window_mib * MIB);
+    copy_data_t thread_data[num_threads];
 
-    // mappa il file destinazione
-    if ((dst = (char *)mmap(NULL, sb.st_size, PROT_WRITE, MAP_SHARED, fdout,
-                            0)) == MAP_FAILED)
-        exit_with_sys_err("mmap");
+    timestamp = seconds_now();
+
+    // la prima finestra della sorgente viene mappata subito, le successive
+    // un giro prima di usarle (per poter chiedere la lettura anticipata)
+    next_length = window;
+    next_src =
+        map_window(fdin, 0, next_length, PROT_READ, MAP_PRIVATE, populate);
+    for (off_t offset = 0; offset < sb.st_size; offset += window) {
+        src = next_src;
+        length = next_length;
+        madvise(src, length, MADV_SEQUENTIAL);
+
+        dst = map_window(fdout, offset, length, PROT_WRITE, MAP_SHARED, false);
+
+        if (offset + window < sb.st_size) {
+            next_length = (sb.st_size - offset - window < window
+                               ? sb.st_size - offset - window
+                               : window);
+            next_src = map_window(fdin, offset + window, next_length,
+                                  PROT_READ, MAP_PRIVATE, populate);
+            madvise(next_src, next_length, MADV_WILLNEED);
+        }
+
+        // copia la finestra, divisa in `num_threads` fette uguali: usa
+        // 'memcpy' per maggiore efficienza
+        for (int i = 0; i < num_threads; i++) {
+            thread_data[i].fdin = fdin;
+            thread_data[i].dst = dst;
+            thread_data[i].src = src;
+            thread_data[i].base = offset;
+            thread_data[i].begin = offset + length * i / num_threads;
+            thread_data[i].end = offset + length * (i + 1) / num_threads;
+            thread_data[i].punch_zeros = punch_zeros;
+            if (num_threads == 1)
+                copy_range(&thread_data[i]); // niente thread per uno solo
+            else if ((err = pthread_create(&thread_data[i].tid, NULL,
+                                           copy_range, &thread_data[i])))
+                exit_with_err("pthread_create", err);
+        }
+        for (int i = 0; i < num_threads; i++) {
+            if (num_threads > 1 &&
+                (err = pthread_join(thread_data[i].tid, NULL)))
+                exit_with_err("pthread_join", err);
+            copied += thread_data[i].copied;
+        }
+
+        // la finestra è finita: le sue pagine non servono più (quelle sporche
+        // della destinazione restano comunque nella page cache e verranno
+        // scritte dal kernel)
+        madvise(src, length, MADV_DONTNEED);
+        madvise(dst, length, MADV_DONTNEED);
+        munmap(src, length);
+        munmap(dst, length);
+    }
+
+    elapsed = seconds_now() - timestamp;
+    printf("copiati %lld byte su %lld (il resto è rimasto un buco)\n",
+           (long long)copied, (long long)sb.st_size);
+    printf("finestra di %lld MiB, %d thread: %.3f s (%.2f GB/s)\n",
+           (long long)(window / MIB), num_threads, elapsed,
+           sb.st_size / elapsed / 1e9);
 
     // chiudo i descrittori: non servono più!
     close(fdin);
     close(fdout);
 
-    // copia il contenuto della sorgente sulla destinazione: usa 'memcpy' per
-    // maggiore efficienza
-    memcpy(dst, src, sb.st_size);
-
-    // operazione di de-mappatura (non indispensabile)
-    munmap(src, sb.st_size);
-    munmap(dst, sb.st_size);
-
     exit(EXIT_SUCCESS);
 }
@@ -1,53 +1,126 @@
 /**
  * prende un file (arbitrariamente grande) e ne inverte il contenuto
  * byte-per-byte usando la mappatura in memoria come metodo d'accesso
+ *
+ * lo scambio usa `reverse_swap` di `lib-misc`, che inverte 16/32 byte alla
+ * volta nei registri vettoriali (SSE2/AVX2); con `--scalar` si usa lo scambio
+ * di un byte alla volta, per confronto
+ *
+ * con `--out` il file non viene modificato ma la versione invertita viene
+ * scritta in un nuovo file: la sorgente è letta a blocchi dalla fine con
+ * `pread`, ogni blocco è invertito in memoria e accodato alla destinazione,
+ * quindi funziona anche con file più grandi della RAM
+ *
+ * uso: mmap-reverse [--scalar] <file> [--out <file-invertito>]
  */
 
 #include "lib-misc.h"
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#define STREAM_BLOCK_SIZE (1 << 20) // blocco della modalità `--out`
+
+/* copia `fd` invertito su `destination` un blocco alla volta, dall'ultimo */
+void stream_reverse(int fd, off_t size, const char *destination, bool scalar) {
+    int dd;
+    char *buffer;
+    off_t offset;
+    ssize_t n, length;
+
+    if ((dd = open(destination, O_WRONLY | O_CREAT | O_TRUNC,
+                   S_IRUSR | S_IWUSR)) == -1)
+        exit_with_sys_err(destination);
+    if ((buffer = malloc(STREAM_BLOCK_SIZE)) == NULL)
+        exit_with_sys_err("malloc");
+
+    for (offset = size; offset > 0; offset -= length) {
+        length = (offset < STREAM_BLOCK_SIZE ? offset : STREAM_BLOCK_SIZE);
+        for (ssize_t done = 0; done < length; done += n)
+            if ((n = pread(fd, buffer + done, length - done,
+                           offset - length + done)) <= 0)
+                exit_with_sys_err("pread");
+        if (scalar)
+            reverse_swap_scalar(buffer, buffer + length - length / 2,
+                                length / 2);
+        else
+            reverse_bytes(buffer, length);
+        for (ssize_t done = 0; done < length; done += n)
+            if ((n = write(dd, buffer + done, length - done)) == -1)
+                exit_with_sys_err(destination);
+    }
+
+    free(buffer);
+    close(dd);
+}
+
 int main(int argc, char *argv[]) {
     struct stat sb;
-    int i;
-    char *p;
+    char *p, *source, *destination = NULL;
     long fd;
-    char temp;
+    off_t half;
+    bool scalar = false;
+    int arg = 1;
+    double timestamp, elapsed;
 
-    if (argc < 2)
-        exit_with_err_msg("uso: %s <file>\n", argv[0]);
+    if (arg < argc && strcmp(argv[arg], "--scalar") == 0) {
+        scalar = true;
+        arg++;
+    }
+    // dopo il file sono ammessi solo nessun argomento o `--out <file>`:
+    // altrimenti un errore di battitura invertirebbe il file sul posto
+    if (arg >= argc ||
+        (arg + 1 < argc &&
+         (arg + 3 != argc || strcmp(argv[arg + 1], "--out") != 0)))
+        exit_with_err_msg("uso: %s [--scalar] <file> [--out <file-invertito>]\n",
+                          argv[0]);
+    source = argv[arg++];
+    if (arg < argc)
+        destination = argv[arg + 1];
 
-    if ((fd = open(argv[1], O_RDWR)) == -1)
-        exit_with_sys_err(argv[1]);
+    if ((fd = open(source, (destination ? O_RDONLY : O_RDWR))) == -1)
+        exit_with_sys_err(source);
 
     if (fstat(fd, &sb) == -1)
         exit_with_sys_err("fstat");
 
     if (!S_ISREG(sb.st_mode))
-        exit_with_err_msg("%s non è un file\n", argv[1]);
-
-    if ((p = (char *)mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
-                          fd, 0)) == MAP_FAILED)
-        exit_with_sys_err("mmap");
-    if (close(fd) == -1)
-        exit_with_sys_err("close");
-
-    for (i = 0; i < (sb.st_size / 2); i++) {
-        /* scambia p[i] con p[size-i-1] */
-        temp = p[sb.st_size - i - 1];
-        p[sb.st_size - i - 1] = p[i];
-        p[i] = temp;
-    }
+        exit_with_err_msg("%s non è un file\n", source);
 
-    printf("File '%s' invertito!\n", argv[1]);
+    timestamp = seconds_now();
+    if (destination) {
+        stream_reverse(fd, sb.st_size, destination, scalar);
+        close(fd);
+    } else if (sb.st_size > 1) {
+        if ((p = (char *)mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd, 0)) == MAP_FAILED)
+            exit_with_sys_err("mmap");
+        if (close(fd) == -1)
+            exit_with_sys_err("close");
+
+        /* scambia la prima metà con la seconda letta dalla fine: p[i] con
+         * p[size-i-1] */
+        half = sb.st_size / 2;
+        if (scalar)
+            reverse_swap_scalar(p, p + sb.st_size - half, half);
+        else
+            reverse_swap(p, p + sb.st_size - half, half);
+
+        if (munmap(p, sb.st_size) == -1)
+            exit_with_sys_err("munmap");
+    }
+    elapsed = seconds_now() - timestamp;
 
-    if (munmap(p, sb.st_size) == -1)
-        exit_with_sys_err("munmap");
+    printf("File '%s' invertito%s%s! (%s, %.3f s, %.2f GB/s)\n", source,
+           (destination ? " su " : ""), (destination ? destination : ""),
+           (scalar ? "scalare" : "vettoriale"), elapsed,
+           sb.st_size / elapsed / 1e9);
 
     exit(EXIT_SUCCESS);
 }
@@ -1,29 +1,127 @@
 /**
- * reimplementa il comando `cat`: legge un file di testo specificato
- * (o, altrimenti, lo standard input) e lo manda sullo standard output
+ * reimplementa il comando `cat`: legge i file di testo specificati
+ * (o, altrimenti, lo standard input) e li manda sullo standard output
+ *
+ * i dati non passano da un buffer utente: ogni sorgente è copiata con
+ * `copy_fd` di `lib-copy`, che sceglie da sé il metodo in base agli estremi:
+ * `splice` se lo standard output (o l'ingresso) è una pipe, `sendfile` o
+ * `copy_file_range` verso un file regolare e, come ultima risorsa,
+ * `read`/`write` con un buffer grande allineato alla pagina (l'unico metodo
+ * possibile se lo standard output è aperto in coda, es. `my-cat a >> b`);
+ * `-` indica lo standard input; con `--verbose` il metodo usato per ogni
+ * sorgente viene riportato sullo standard error
+ *
+ * con `--lines` si usa la versione originale riga per riga con `fgets` (per
+ * confronto), ad esempio:
+ * > time ./my-cat grande.txt | wc -c
+ * > time ./my-cat --lines grande.txt | wc -c
+ * > time cat grande.txt | wc -c
+ *
+ * con `--io_uring` i file regolari vengono copiati a blocchi con `lib-uring`;
+ * se non è possibile (sistema senza io_uring, sorgente non regolare) si
+ * ripiega sulla copia normale
+ *
+ * uso: my-cat [--lines|--io_uring] [--verbose] [file|-]...
  */
 
+#include "lib-copy.h"
 #include "lib-misc.h"
+#include "lib-uring.h"
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-int main(int argc, char *argv[]) {
-    FILE *in;
+/* la versione originale: una riga alla volta attraverso gli stream */
+void cat_lines(FILE *in) {
     char buffer[BUFSIZ];
 
-    if (argc >= 2) { // viene specificato almeno un parametro
-        if ((in = fopen(argv[1], "r")) == NULL)
-            exit_with_sys_err(argv[1]);
-    } else { // legge dallo standard input
-        in = stdin;
-    }
-
     // copia i dati dalla sorgente alla destinazione una riga alla volta
     while ((fgets(buffer, sizeof(buffer), in)) != NULL)
         printf("%s", buffer); // fputs(buffer, stdout);
+}
+
+/* copia `fd` con `lib-uring`: restituisce false se bisogna ripiegare */
+bool cat_io_uring(int fd) {
+    struct stat sb;
+    off_t dst_offset = -1;
+    uring_stats_t stats;
+
+    // su un file regolare si scrive a posizioni esplicite (più blocchi in
+    // volo), altrimenti in ordine sulla posizione corrente
+    if (fstat(STDOUT_FILENO, &sb) == 0 && S_ISREG(sb.st_mode))
+        dst_offset = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+    if (uring_copy_range(fd, lseek(fd, 0, SEEK_CUR), STDOUT_FILENO,
+                         dst_offset, -1, URING_DEFAULT_DEPTH,
+                         URING_DEFAULT_BLOCK_SIZE, &stats) == -1) {
+        if (errno != ENOSYS && errno != EINVAL)
+            exit_with_sys_err("io_uring");
+        return false;
+    }
+    // la posizione va avanzata a mano (es. `{ my-cat a; my-cat b; }`)
+    if (dst_offset != -1)
+        lseek(STDOUT_FILENO, dst_offset + stats.bytes, SEEK_SET);
+
+    return true;
+}
 
-    // chiude lo stream
-    fclose(in);
+int main(int argc, char *argv[]) {
+    FILE *in;
+    int fd, arg = 1;
+    bool lines = false, use_uring = false, verbose = false;
+    copy_stats_t stats;
+    const char *name;
+
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--lines") == 0)
+            lines = true;
+        else if (strcmp(argv[arg], "--io_uring") == 0)
+            use_uring = true;
+        else if (strcmp(argv[arg], "--verbose") == 0)
+            verbose = true;
+        else
+            exit_with_err_msg("opzione '%s' non valida!\n", argv[arg]);
+    }
+
+    // senza file si legge dallo standard input (come con un solo `-`)
+    for (int i = arg; i < argc || i == arg; i++) {
+        name = (i < argc ? argv[i] : "-");
+
+        if (lines) {
+            if (strcmp(name, "-") == 0)
+                in = stdin;
+            else if ((in = fopen(name, "r")) == NULL)
+                exit_with_sys_err(name);
+            cat_lines(in);
+            // chiude lo stream
+            if (in != stdin)
+                fclose(in);
+            continue;
+        }
+
+        if (strcmp(name, "-") == 0)
+            fd = STDIN_FILENO;
+        else if ((fd = open(name, O_RDONLY)) == -1)
+            exit_with_sys_err(name);
+
+        if (use_uring && cat_io_uring(fd)) {
+            if (verbose)
+                fprintf(stderr, "%s: io_uring\n", name);
+        } else {
+            if (copy_fd(fd, STDOUT_FILENO, COPY_METHOD_AUTO, &stats) == -1)
+                exit_with_sys_err(name);
+            if (verbose)
+                fprintf(stderr, "%s: %llu byte con %s (%lu chiamate)\n", name,
+                        stats.bytes, copy_method_names[stats.method],
+                        stats.syscalls);
+        }
+
+        if (fd != STDIN_FILENO)
+            close(fd);
+    }
 
     exit(EXIT_SUCCESS);
 }
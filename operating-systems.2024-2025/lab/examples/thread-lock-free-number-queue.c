@@ -0,0 +1,170 @@
+/**
+ * variante del modello produttori-consumatori di
+ * `thread-safe-number-queue-as-monitor.c` in cui la coda di numeri è
+ * realizzata senza lock (lock-free): ogni cella dell'anello ha un proprio
+ * numero di sequenza che indica se è libera o occupata e gli indici di
+ * inserimento/estrazione vengono avanzati con operazioni atomiche
+ * (compare-and-swap); i thread si bloccano (con una futex sotto Linux) solo
+ * quando la coda è effettivamente vuota o piena
+ */
+
+#include "lib-misc.h"
+#include "lib-number-queue.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define QUEUE_CAPACITY 16 // NB: viene comunque arrotondata a una potenza di 2
+#define NUM_PRODUCERS 3
+#define NUM_CONSUMERS 2
+#define NUM_OF_ITEMS_TO_PRODUCE 300
+
+/* la coda lock-free (`lock-free-number-queue`), con la stessa interfaccia di
+ * `safe-number-queue`, è in `lib-number-queue.c` (condivisa con
+ * `thread-number-queue-benchmark.c`) */
+
+typedef struct {
+    pthread_t tid;
+    unsigned int id;
+    unsigned long items_to_produce;
+    long total;
+
+    lock_free_number_queue_t *queue_ptr;
+} producer_data_t;
+
+typedef struct {
+    pthread_t tid;
+    unsigned int id;
+    long total;
+
+    lock_free_number_queue_t *queue_ptr;
+} consumer_data_t;
+
+void *producer_function(void *arg) {
+    assert(arg);
+
+    long number;
+    producer_data_t *data_ptr = (producer_data_t *)arg;
+
+    printf("[P%u] produttore attivato...\n", data_ptr->id);
+
+    while (data_ptr->items_to_produce > 0) {
+        // "produzione dell'elemento": un numero a caso
+        number = rand();
+        data_ptr->total += number;
+        printf("[P%u] numero '%lu' prodotto\n", data_ptr->id, number);
+        data_ptr->items_to_produce--;
+
+        // inserimento elemento (bloccante solo a coda piena) con eventuale
+        // indicazione dell'ultimo inserimento
+        lock_free_number_queue_push(data_ptr->queue_ptr, number,
+                                    (data_ptr->items_to_produce == 0));
+
+        printf("[P%u] numero '%lu' inserito nella coda\n", data_ptr->id,
+               number);
+
+        flockfile(stdout);
+        printf("[P%u] coda attuale: ", data_ptr->id);
+        lock_free_number_queue_print(data_ptr->queue_ptr);
+        funlockfile(stdout);
+    }
+
+    printf("[P%u] produttore terminato con un valore totale di inserimenti "
+           "pari a %lu\n",
+           data_ptr->id, data_ptr->total);
+
+    return (NULL);
+}
+
+void *consumer_function(void *arg) {
+    assert(arg);
+
+    long number;
+    consumer_data_t *data_ptr = (consumer_data_t *)arg;
+
+    printf("[C%u] consumatore attivato...\n", data_ptr->id);
+
+    while (true) {
+        // estrazione elemento con fallimento su esaurimento senza produttori
+        if (!lock_free_number_queue_pop(&number, data_ptr->queue_ptr))
+            break;
+        data_ptr->total += number;
+
+        printf("[C%u] numero '%lu' estratto dalla coda\n", data_ptr->id,
+               number);
+
+        flockfile(stdout);
+        printf("[C%u] coda attuale:", data_ptr->id);
+        lock_free_number_queue_print(data_ptr->queue_ptr);
+        funlockfile(stdout);
+    }
+
+    printf("[C%u] consumatore terminato con un valore totale di inserimenti "
+           "pari a %lu\n",
+           data_ptr->id, data_ptr->total);
+
+    return (NULL);
+}
+
+int main(int argc, char *argv[]) {
+    int err;
+
+    srand(time(NULL));
+
+    // creazione della coda condivisa
+    lock_free_number_queue_t queue;
+    lock_free_number_queue_init(&queue, QUEUE_CAPACITY, NUM_PRODUCERS);
+
+    // creazione dei produttori
+    producer_data_t prod_data[NUM_PRODUCERS];
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        prod_data[i].queue_ptr = &queue;
+        prod_data[i].id = i + 1;
+        prod_data[i].items_to_produce = NUM_OF_ITEMS_TO_PRODUCE / NUM_PRODUCERS;
+        prod_data[i].total = 0;
+        if ((err = pthread_create(&prod_data[i].tid, NULL, producer_function,
+                                  (void *)(&prod_data[i]))))
+            exit_with_err("pthread_create", err);
+    }
+
+    // creazione dei consumatori
+    consumer_data_t cons_data[NUM_CONSUMERS];
+    for (int i = 0; i < NUM_CONSUMERS; i++) {
+        cons_data[i].queue_ptr = &queue;
+        cons_data[i].id = i + 1;
+        cons_data[i].total = 0;
+        if ((err = pthread_create(&cons_data[i].tid, NULL, consumer_function,
+                                  (void *)(&cons_data[i]))))
+            exit_with_err("pthread_create", err);
+    }
+
+    // attesa della terminazione dei produttori e dei consumatori
+    unsigned long total_insertions = 0, total_extractions = 0;
+    for (int i = 0; i < NUM_CONSUMERS; i++) {
+        if ((err = pthread_join(cons_data[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+        total_extractions += cons_data[i].total;
+    }
+    for (int i = 0; i < NUM_PRODUCERS; i++) {
+        if ((err = pthread_join(prod_data[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+        total_insertions += prod_data[i].total;
+    }
+    // non indispensabile ma è una buona abitudine...
+    lock_free_number_queue_destroy(&queue);
+
+    // controllo dei totali degli inserimenti ed estrazioni
+    printf("[main] controllo dei totali: inserimenti=%lu estrazioni=%lu\n",
+           total_insertions, total_extractions);
+    if (total_insertions == total_extractions) {
+        printf("[main] risultato corretto!\n");
+        exit(EXIT_SUCCESS);
+    } else {
+        printf("[main] risultato ERRATO!\n");
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,206 @@
+/**
+ * confronto delle prestazioni (elementi al secondo) tra le tre varianti della
+ * coda di numeri condivisa di `lib-number-queue`, al crescere del numero di
+ * produttori e consumatori (da 1 a 64 per tipo):
+ * - `monitor`: mutex e variabili condizione come in
+ *   `thread-safe-number-queue-as-monitor.c`
+ * - `semafori`: semafori numerici come in `thread-prod-cons-with-sem.c`
+ * - `lock-free`: anello con numeri di sequenza come in
+ *   `thread-lock-free-number-queue.c`
+ *
+ * ogni produttore deve inserire almeno un elemento (l'ultimo segnala la sua
+ * uscita), quindi le prove si fermano a tanti produttori quanti elementi
+ *
+ * uso: thread-number-queue-benchmark [max-thread-per-tipo] [numero-elementi]
+ */
+
+#include "lib-misc.h"
+#include "lib-number-queue.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define QUEUE_CAPACITY 1024
+#define DEFAULT_MAX_THREADS_PER_KIND 64
+#define DEFAULT_NUM_OF_ITEMS (1000 * 1000L)
+
+/* interfaccia comune alle tre varianti di `lib-number-queue` per poterle
+ * provare con lo stesso codice dei produttori e dei consumatori */
+typedef struct {
+    const char *name;
+    void (*init)(void *queue_ptr, unsigned long capacity,
+                 unsigned int producers, unsigned int consumers);
+    void (*destroy)(void *queue_ptr);
+    void (*push)(void *queue_ptr, long num, bool last);
+    bool (*pop)(long *extr_num_ptr, void *queue_ptr);
+} queue_ops_t;
+
+typedef union {
+    safe_number_queue_t monitor;
+    sem_number_queue_t sem;
+    lock_free_number_queue_t lock_free;
+} any_queue_t;
+
+/* adattatori dalle funzioni tipizzate della libreria all'interfaccia comune */
+void monitor_init(void *queue_ptr, unsigned long capacity,
+                  unsigned int producers, unsigned int consumers) {
+    (void)consumers;
+    safe_number_queue_init(queue_ptr, capacity, producers);
+}
+void monitor_destroy(void *queue_ptr) { safe_number_queue_destroy(queue_ptr); }
+void monitor_push(void *queue_ptr, long num, bool last) {
+    safe_number_queue_push(queue_ptr, num, last);
+}
+bool monitor_pop(long *extr_num_ptr, void *queue_ptr) {
+    return safe_number_queue_pop(extr_num_ptr, queue_ptr);
+}
+
+void sem_init_any(void *queue_ptr, unsigned long capacity,
+                  unsigned int producers, unsigned int consumers) {
+    sem_number_queue_init(queue_ptr, capacity, producers, consumers);
+}
+void sem_destroy_any(void *queue_ptr) { sem_number_queue_destroy(queue_ptr); }
+void sem_push_any(void *queue_ptr, long num, bool last) {
+    sem_number_queue_push(queue_ptr, num, last);
+}
+bool sem_pop_any(long *extr_num_ptr, void *queue_ptr) {
+    return sem_number_queue_pop(extr_num_ptr, queue_ptr);
+}
+
+void lock_free_init(void *queue_ptr, unsigned long capacity,
+                    unsigned int producers, unsigned int consumers) {
+    (void)consumers;
+    lock_free_number_queue_init(queue_ptr, capacity, producers);
+}
+void lock_free_destroy(void *queue_ptr) {
+    lock_free_number_queue_destroy(queue_ptr);
+}
+void lock_free_push(void *queue_ptr, long num, bool last) {
+    lock_free_number_queue_push(queue_ptr, num, last);
+}
+bool lock_free_pop(long *extr_num_ptr, void *queue_ptr) {
+    return lock_free_number_queue_pop(extr_num_ptr, queue_ptr);
+}
+
+const queue_ops_t queue_variants[] = {
+    {"monitor", monitor_init, monitor_destroy, monitor_push, monitor_pop},
+    {"semafori", sem_init_any, sem_destroy_any, sem_push_any, sem_pop_any},
+    {"lock-free", lock_free_init, lock_free_destroy, lock_free_push,
+     lock_free_pop},
+};
+#define NUM_QUEUE_VARIANTS (sizeof(queue_variants) / sizeof(queue_variants[0]))
+
+typedef struct {
+    pthread_t tid;
+    unsigned long items_to_produce;
+    long total;
+
+    const queue_ops_t *ops;
+    void *queue_ptr;
+} agent_data_t;
+
+void *producer_function(void *arg) {
+    assert(arg);
+    agent_data_t *data_ptr = (agent_data_t *)arg;
+
+    // nessuna stampa né `rand` (che ha un lock interno): misuriamo la coda
+    for (unsigned long i = 1; i <= data_ptr->items_to_produce; i++) {
+        data_ptr->total += (long)i;
+        data_ptr->ops->push(data_ptr->queue_ptr, (long)i,
+                            (i == data_ptr->items_to_produce));
+    }
+
+    return (NULL);
+}
+
+void *consumer_function(void *arg) {
+    assert(arg);
+    agent_data_t *data_ptr = (agent_data_t *)arg;
+    long number;
+
+    while (data_ptr->ops->pop(&number, data_ptr->queue_ptr))
+        data_ptr->total += number;
+
+    return (NULL);
+}
+
+/* esegue una prova con `num_threads` produttori e altrettanti consumatori e
+ * restituisce il numero di elementi trasferiti al secondo */
+double run_benchmark(const queue_ops_t *ops, unsigned int num_threads,
+                     unsigned long num_items) {
+    int err;
+    any_queue_t queue;
+    agent_data_t producers[num_threads], consumers[num_threads];
+    long total_insertions = 0, total_extractions = 0;
+    double start, elapsed;
+
+    // un produttore senza elementi non segnalerebbe mai la propria uscita
+    assert(num_items >= num_threads);
+    ops->init(&queue, QUEUE_CAPACITY, num_threads, num_threads);
+
+    start = seconds_now();
+    for (unsigned int i = 0; i < num_threads; i++) {
+        // il resto della divisione va ai primi produttori
+        producers[i] =
+            (agent_data_t){0, num_items / num_threads, 0, ops, &queue};
+        if (i < num_items % num_threads)
+            producers[i].items_to_produce++;
+        consumers[i] = (agent_data_t){0, 0, 0, ops, &queue};
+        if ((err = pthread_create(&producers[i].tid, NULL, producer_function,
+                                  &producers[i])))
+            exit_with_err("pthread_create", err);
+        if ((err = pthread_create(&consumers[i].tid, NULL, consumer_function,
+                                  &consumers[i])))
+            exit_with_err("pthread_create", err);
+    }
+    for (unsigned int i = 0; i < num_threads; i++) {
+        if ((err = pthread_join(producers[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+        if ((err = pthread_join(consumers[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+        total_insertions += producers[i].total;
+        total_extractions += consumers[i].total;
+    }
+    elapsed = seconds_now() - start;
+
+    ops->destroy(&queue);
+
+    if (total_insertions != total_extractions)
+        exit_with_err_msg("[%s] risultato ERRATO: inserimenti=%ld "
+                          "estrazioni=%ld\n",
+                          ops->name, total_insertions, total_extractions);
+
+    return num_items / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int max_threads = DEFAULT_MAX_THREADS_PER_KIND;
+    unsigned long num_items = DEFAULT_NUM_OF_ITEMS;
+
+    if (argc > 1 && (max_threads = atoi(argv[1])) < 1)
+        exit_with_err_msg("numero di thread (%s) non valido!\n", argv[1]);
+    if (argc > 2 && (num_items = atol(argv[2])) < 1)
+        exit_with_err_msg("numero di elementi (%s) non valido!\n", argv[2]);
+
+    printf("[main] %lu elementi su una coda di capacità %d\n", num_items,
+           QUEUE_CAPACITY);
+    printf("%-10s", "thread");
+    for (unsigned int v = 0; v < NUM_QUEUE_VARIANTS; v++)
+        printf(" %16s", queue_variants[v].name);
+    printf("   (elementi/secondo)\n");
+
+    for (unsigned int t = 1; t <= max_threads && t <= num_items; t *= 2) {
+        printf("%3ux%-6u", t, t);
+        fflush(stdout);
+        for (unsigned int v = 0; v < NUM_QUEUE_VARIANTS; v++) {
+            printf(" %16.0f", run_benchmark(&queue_variants[v], t, num_items));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    exit(EXIT_SUCCESS);
+}
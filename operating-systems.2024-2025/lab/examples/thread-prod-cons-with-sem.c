@@ -1,6 +1,12 @@
 /**
  * esempio sul modello produttore-consumatore con una coda di numeri di
  * dimensione fissata usando dei semafori numerici
+ *
+ * con `--batch N` gli elementi viaggiano a blocchi: i semafori POSIX non
+ * prevedono `up`/`down` di più unità alla volta (a differenza di `semop` dei
+ * semafori System V), quindi `full` ed `empty` sono semafori numerici
+ * costruiti con un mutex, una variabile condizione e un contatore, in cui un
+ * blocco di `N` unità viene pubblicato con un solo risveglio
  */
 
 #include "lib-misc.h"
@@ -10,6 +16,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -85,6 +92,55 @@ bool number_queue_pop(long *extr_num_ptr, number_queue_t *queue_ptr) {
     return true;
 }
 
+/* variante a blocchi di `number_queue_push`: inserisce fino a `n` elementi
+ * di `nums` (quanti ne entrano) e ne restituisce il numero effettivo */
+unsigned long number_queue_push_n(number_queue_t *queue_ptr, const long *nums,
+                                  unsigned long n) {
+    assert(queue_ptr);
+    assert(nums);
+    unsigned long count, first_part;
+
+    count = queue_ptr->capacity - queue_ptr->size;
+    if (count > n)
+        count = n;
+
+    // copia contigua in (al più) due parti: fino alla fine del vettore e poi,
+    // superato il punto di "giro", dall'inizio
+    first_part = queue_ptr->capacity - queue_ptr->in;
+    if (first_part > count)
+        first_part = count;
+    memcpy(queue_ptr->data + queue_ptr->in, nums, first_part * sizeof(long));
+    memcpy(queue_ptr->data, nums + first_part,
+           (count - first_part) * sizeof(long));
+    queue_ptr->in = (queue_ptr->in + count) % queue_ptr->capacity;
+    queue_ptr->size += count;
+
+    return count;
+}
+
+/* variante a blocchi di `number_queue_pop`: estrae fino a `n` elementi (quanti
+ * ce ne sono) in `extr_nums` e ne restituisce il numero effettivo */
+unsigned long number_queue_pop_n(long *extr_nums, unsigned long n,
+                                 number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(extr_nums);
+    unsigned long count, first_part;
+
+    count = (queue_ptr->size < n ? queue_ptr->size : n);
+
+    first_part = queue_ptr->capacity - queue_ptr->out;
+    if (first_part > count)
+        first_part = count;
+    memcpy(extr_nums, queue_ptr->data + queue_ptr->out,
+           first_part * sizeof(long));
+    memcpy(extr_nums + first_part, queue_ptr->data,
+           (count - first_part) * sizeof(long));
+    queue_ptr->out = (queue_ptr->out + count) % queue_ptr->capacity;
+    queue_ptr->size -= count;
+
+    return count;
+}
+
 void number_queue_print(const char* prefix, number_queue_t *const queue_ptr) {
     assert(queue_ptr);
 
@@ -97,21 +153,88 @@ void number_queue_print(const char* prefix, number_queue_t *const queue_ptr) {
 }
 /* < number-queue > */
 
+/* semaforo numerico con operazioni su più unità alla volta */
+typedef struct {
+    unsigned long value;
+    pthread_mutex_t lock;
+    pthread_cond_t positive; // segnalata quando `value` diventa positivo
+} multi_sem_t;
+
+void multi_sem_init(multi_sem_t *sem, unsigned long value) {
+    int err;
+
+    sem->value = value;
+    if ((err = pthread_mutex_init(&sem->lock, NULL)))
+        exit_with_err("pthread_mutex_init", err);
+    if ((err = pthread_cond_init(&sem->positive, NULL)))
+        exit_with_err("pthread_cond_init", err);
+}
+
+void multi_sem_destroy(multi_sem_t *sem) {
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->positive);
+}
+
+/* `down` di al più `max` unità: si blocca finché il valore è nullo, poi prende
+ * tutte quelle disponibili fino a `max` e ne restituisce il numero (almeno
+ * una); se ne restano, passa il testimone a un altro thread in attesa */
+unsigned long multi_sem_wait_up_to(multi_sem_t *sem, unsigned long max) {
+    unsigned long count;
+    int err;
+
+    if ((err = pthread_mutex_lock(&sem->lock)))
+        exit_with_err("pthread_mutex_lock", err);
+    while (sem->value == 0)
+        if ((err = pthread_cond_wait(&sem->positive, &sem->lock)))
+            exit_with_err("pthread_cond_wait", err);
+    count = (sem->value < max ? sem->value : max);
+    sem->value -= count;
+    if (sem->value > 0)
+        if ((err = pthread_cond_signal(&sem->positive)))
+            exit_with_err("pthread_cond_signal", err);
+    if ((err = pthread_mutex_unlock(&sem->lock)))
+        exit_with_err("pthread_mutex_unlock", err);
+
+    return count;
+}
+
+/* `up` di `count` unità con un solo risveglio (e nessuno se il valore era già
+ * positivo: chi è in attesa è già stato svegliato) */
+void multi_sem_post_n(multi_sem_t *sem, unsigned long count) {
+    bool was_zero;
+    int err;
+
+    if ((err = pthread_mutex_lock(&sem->lock)))
+        exit_with_err("pthread_mutex_lock", err);
+    was_zero = (sem->value == 0);
+    sem->value += count;
+    if ((err = pthread_mutex_unlock(&sem->lock)))
+        exit_with_err("pthread_mutex_unlock", err);
+    if (was_zero)
+        if ((err = pthread_cond_signal(&sem->positive)))
+            exit_with_err("pthread_cond_signal", err);
+}
+
 typedef struct {
     number_queue_t queue;
-    sem_t full, empty, mutex;
+    multi_sem_t full, empty;
+    sem_t mutex;
     bool end_of_work;
 } shared_data_t;
 
 typedef struct {
     pthread_t tid;
     unsigned long items_to_produce;
+    unsigned long batch_size;
+    bool verbose;
 
     shared_data_t *shared_data_ptr;
 } producer_data_t;
 
 typedef struct {
     pthread_t tid;
+    unsigned long batch_size;
+    bool verbose;
 
     shared_data_t *shared_data_ptr;
 } consumer_data_t;
@@ -120,52 +243,74 @@ void *producer_function(void *arg) {
     assert(arg);
 
     long total_to_return = 0;
-    long number;
+    long *numbers;
+    unsigned long count, pushed;
     int err;
     producer_data_t *data_ptr = (producer_data_t *)arg;
 
+    if ((numbers = malloc(data_ptr->batch_size * sizeof(long))) == NULL)
+        exit_with_sys_err("malloc");
+
     printf("[P] produttore attivato...\n");
 
     while (data_ptr->items_to_produce > 0) {
-        // "produzione dell'elemento": un numero a caso
-        number = rand();
-        total_to_return += number;
-        printf("[P] numero '%lu' prodotto\n", number);
-
-        // down(empty)
-        if ((err = sem_wait(&data_ptr->shared_data_ptr->empty)))
-            exit_with_err("sem_wait", err);
+        // down(empty) per un blocco di (al più) `batch_size` posti liberi
+        count = multi_sem_wait_up_to(
+            &data_ptr->shared_data_ptr->empty,
+            (data_ptr->items_to_produce < data_ptr->batch_size
+                 ? data_ptr->items_to_produce
+                 : data_ptr->batch_size));
+
+        // "produzione degli elementi": numeri a caso
+        for (unsigned long i = 0; i < count; i++) {
+            numbers[i] = rand();
+            total_to_return += numbers[i];
+            if (data_ptr->verbose)
+                printf("[P] numero '%lu' prodotto\n", numbers[i]);
+        }
 
         // down(mutex)
         if ((err = sem_wait(&data_ptr->shared_data_ptr->mutex)))
             exit_with_err("sem_wait", err);
 
-        // inserimento elemento
-        if (!number_queue_push(&data_ptr->shared_data_ptr->queue, number))
+        // inserimento elementi
+        if (count == 1)
+            pushed = (number_queue_push(&data_ptr->shared_data_ptr->queue,
+                                        numbers[0])
+                          ? 1
+                          : 0);
+        else
+            pushed = number_queue_push_n(&data_ptr->shared_data_ptr->queue,
+                                         numbers, count);
+        if (pushed != count)
             exit_with_err_msg("anomalia: fallimento nell'inserimento!\n");
 
-        flockfile(stdout); // trucco per evitare l'interlacciamento delle linee
-        printf("[P] numero '%lu' inserito nella coda\n", number);
-        number_queue_print("[P] coda attuale: ", &data_ptr->shared_data_ptr->queue);
-        funlockfile(stdout); // rilascia il lock su `stdout` acquisito prima
+        if (data_ptr->verbose) {
+            flockfile(stdout); // trucco per evitare l'interlacciamento delle linee
+            printf("[P] %lu numeri inseriti nella coda\n", count);
+            number_queue_print("[P] coda attuale: ",
+                               &data_ptr->shared_data_ptr->queue);
+            funlockfile(stdout); // rilascia il lock su `stdout` acquisito prima
+        }
 
         // controllo sulla necessità di terminare per il produttore
-        if ((--data_ptr->items_to_produce) == 0)
+        if ((data_ptr->items_to_produce -= count) == 0)
             data_ptr->shared_data_ptr->end_of_work = true;
 
         // up(mutex)
         if ((err = sem_post(&data_ptr->shared_data_ptr->mutex)))
             exit_with_err("sem_post", err);
 
-        // up(full)
-        if ((err = sem_post(&data_ptr->shared_data_ptr->full)))
-            exit_with_err("sem_post", err);
+        // up(full) di tutti gli elementi inseriti con un solo risveglio
+        multi_sem_post_n(&data_ptr->shared_data_ptr->full, count);
     }
 
     printf("[P] produttore terminato con un valore totale di inserimenti "
            "pari a %lu\n",
            total_to_return);
 
+    free(numbers);
+
     return ((void *)total_to_return);
 }
 
@@ -173,31 +318,48 @@ void *consumer_function(void *arg) {
     assert(arg);
 
     long total_to_return = 0;
-    long number;
+    long *numbers;
+    unsigned long count, popped;
     int err;
     bool run = true;
     consumer_data_t *data_ptr = (consumer_data_t *)arg;
 
+    if ((numbers = malloc(data_ptr->batch_size * sizeof(long))) == NULL)
+        exit_with_sys_err("malloc");
+
     printf("[C] consumatore attivato...\n");
 
     do {
-        // down(full)
-        if ((err = sem_wait(&data_ptr->shared_data_ptr->full)))
-            exit_with_err("sem_wait", err);
+        // down(full) per un blocco di (al più) `batch_size` elementi
+        count = multi_sem_wait_up_to(&data_ptr->shared_data_ptr->full,
+                                     data_ptr->batch_size);
 
         // down(mutex)
         if ((err = sem_wait(&data_ptr->shared_data_ptr->mutex)))
             exit_with_err("sem_wait", err);
 
-        // estrazione elemento
-        if (!number_queue_pop(&number, &data_ptr->shared_data_ptr->queue))
+        // estrazione elementi
+        if (count == 1)
+            popped = (number_queue_pop(&numbers[0],
+                                       &data_ptr->shared_data_ptr->queue)
+                          ? 1
+                          : 0);
+        else
+            popped = number_queue_pop_n(numbers, count,
+                                        &data_ptr->shared_data_ptr->queue);
+        if (popped != count)
             exit_with_err_msg("anomalia: fallimento sull'estrazione!\n");
-        total_to_return += number;
-
-        flockfile(stdout);
-        printf("[C] numero '%lu' estratto dalla coda\n", number);
-        number_queue_print("[C] coda attuale: ", &data_ptr->shared_data_ptr->queue);
-        funlockfile(stdout);
+        for (unsigned long i = 0; i < count; i++)
+            total_to_return += numbers[i];
+
+        if (data_ptr->verbose) {
+            flockfile(stdout);
+            for (unsigned long i = 0; i < count; i++)
+                printf("[C] numero '%lu' estratto dalla coda\n", numbers[i]);
+            number_queue_print("[C] coda attuale: ",
+                               &data_ptr->shared_data_ptr->queue);
+            funlockfile(stdout);
+        }
 
         // controllo sulla necessità di terminare per il consumatore
         if (data_ptr->shared_data_ptr->end_of_work &&
@@ -208,20 +370,42 @@ void *consumer_function(void *arg) {
         if ((err = sem_post(&data_ptr->shared_data_ptr->mutex)))
             exit_with_err("sem_post", err);
 
-        // up(empty)
-        if ((err = sem_post(&data_ptr->shared_data_ptr->empty)))
-            exit_with_err("sem_post", err);
+        // up(empty) di tutti gli elementi estratti con un solo risveglio
+        multi_sem_post_n(&data_ptr->shared_data_ptr->empty, count);
     } while (run);
 
     printf("[C] consumatore terminato con un valore totale di inserimenti "
            "pari a %lu\n",
            total_to_return);
 
+    free(numbers);
+
     return ((void *)total_to_return);
 }
 
 int main(int argc, char *argv[]) {
     int err;
+    unsigned long num_items = NUM_OF_ITEMS_TO_PRODUCE, batch_size = 1;
+    bool verbose = true;
+    struct timespec start, end;
+    double elapsed;
+
+    // opzioni: `--batch N` (elementi per operazione), `--items N` (elementi
+    // totali da produrre) e `--quiet` (niente stampe per ogni elemento, utile
+    // per misurare il throughput)
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            if ((batch_size = strtoul(argv[++i], NULL, 10)) < 1)
+                exit_with_err_msg("dimensione del blocco non valida!\n");
+        } else if (strcmp(argv[i], "--items") == 0 && i + 1 < argc) {
+            if ((num_items = strtoul(argv[++i], NULL, 10)) < 1)
+                exit_with_err_msg("numero di elementi non valido!\n");
+        } else if (strcmp(argv[i], "--quiet") == 0)
+            verbose = false;
+        else
+            exit_with_err_msg(
+                "uso: %s [--batch <N>] [--items <N>] [--quiet]\n", argv[0]);
+    }
 
     // inizializzazione di numeri pseudo-causali con un seed legato al tempo
     // NB: il seed è condiviso tra i thread!
@@ -231,23 +415,27 @@ int main(int argc, char *argv[]) {
     shared_data_t shared;
     shared.end_of_work = false;
     number_queue_init(&shared.queue, QUEUE_CAPACITY);
-    if ((err = sem_init(&shared.full, PTHREAD_PROCESS_PRIVATE, 0)))
-        exit_with_err("sem_init", err);
-    if ((err =
-             sem_init(&shared.empty, PTHREAD_PROCESS_PRIVATE, QUEUE_CAPACITY)))
-        exit_with_err("sem_init", err);
+    multi_sem_init(&shared.full, 0);
+    multi_sem_init(&shared.empty, QUEUE_CAPACITY);
     if ((err = sem_init(&shared.mutex, PTHREAD_PROCESS_PRIVATE, 1)))
         exit_with_err("sem_init", err);
 
+    if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+        exit_with_sys_err("clock_gettime");
+
     // creazione del thread
     producer_data_t prod_data;
     prod_data.shared_data_ptr = &shared;
-    prod_data.items_to_produce = NUM_OF_ITEMS_TO_PRODUCE;
+    prod_data.items_to_produce = num_items;
+    prod_data.batch_size = batch_size;
+    prod_data.verbose = verbose;
     if ((err = pthread_create(&prod_data.tid, NULL, producer_function,
                               (void *)(&prod_data))))
         exit_with_err("pthread_create", err);
     consumer_data_t cons_data;
     cons_data.shared_data_ptr = &shared;
+    cons_data.batch_size = batch_size;
+    cons_data.verbose = verbose;
     if ((err = pthread_create(&cons_data.tid, NULL, consumer_function,
                               (void *)(&cons_data))))
         exit_with_err("pthread_create", err);
@@ -259,10 +447,17 @@ int main(int argc, char *argv[]) {
     if ((err = pthread_join(cons_data.tid, (void **)&total_extractions)))
         exit_with_err("pthread_join", err);
 
+    if (clock_gettime(CLOCK_MONOTONIC, &end) == -1)
+        exit_with_sys_err("clock_gettime");
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("[main] %lu elementi trasferiti in blocchi da %lu in %.3f secondi "
+           "(%.0f elementi/secondo)\n",
+           num_items, batch_size, elapsed, num_items / elapsed);
+
     // non indispensabile ma è una buona abitudine...
     number_queue_destroy(&shared.queue);
-    sem_destroy(&shared.full);
-    sem_destroy(&shared.empty);
+    multi_sem_destroy(&shared.full);
+    multi_sem_destroy(&shared.empty);
     sem_destroy(&shared.mutex);
 
     // controllo dei totali degli inserimenti ed estrazioni
@@ -10,6 +10,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -176,6 +177,98 @@ bool number_queue_pop(long *extr_num_ptr, number_queue_t *queue_ptr) {
     return return_value;
 }
 
+/* variante a blocchi di `number_queue_push`: inserisce fino a `n` elementi
+ * di `nums` con una sola acquisizione del lock (bloccandosi solo se la coda è
+ * piena) e ne restituisce il numero effettivo; `last` ha effetto solo se sono
+ * stati inseriti tutti gli `n` elementi */
+unsigned long number_queue_push_n(number_queue_t *queue_ptr, const long *nums,
+                                  unsigned long n, bool last) {
+    assert(queue_ptr);
+    assert(nums);
+    assert(n > 0);
+    int err;
+    unsigned long count, first_part;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    while (queue_ptr->size == queue_ptr->capacity)
+        if ((err = pthread_cond_wait(&queue_ptr->full, &queue_ptr->mutex)))
+            exit_with_err("pthread_cond_wait", err);
+
+    count = queue_ptr->capacity - queue_ptr->size;
+    if (count > n)
+        count = n;
+
+    // copia contigua in (al più) due parti: fino alla fine del vettore e poi,
+    // superato il punto di "giro", dall'inizio
+    first_part = queue_ptr->capacity - queue_ptr->in;
+    if (first_part > count)
+        first_part = count;
+    memcpy(queue_ptr->data + queue_ptr->in, nums, first_part * sizeof(long));
+    memcpy(queue_ptr->data, nums + first_part,
+           (count - first_part) * sizeof(long));
+    queue_ptr->in = (queue_ptr->in + count) % queue_ptr->capacity;
+    queue_ptr->size += count;
+
+    if (last && count == n) {
+        assert(queue_ptr->active_producers > 0);
+        queue_ptr->active_producers--;
+    }
+
+    // un solo risveglio per tutto il blocco (se la coda era vuota)
+    if (queue_ptr->size == count)
+        if ((err = pthread_cond_broadcast(&queue_ptr->empty)))
+            exit_with_err("pthread_cond_broadcast", err);
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return count;
+}
+
+/* variante a blocchi di `number_queue_pop`: estrae fino a `n` elementi in
+ * `extr_nums` con una sola acquisizione del lock e ne restituisce il numero
+ * effettivo (0 se la coda è vuota e non ci sono più produttori) */
+unsigned long number_queue_pop_n(long *extr_nums, unsigned long n,
+                                 number_queue_t *queue_ptr) {
+    assert(queue_ptr);
+    assert(extr_nums);
+    assert(n > 0);
+    int err;
+    unsigned long count, first_part;
+
+    if ((err = pthread_mutex_lock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    while (queue_ptr->size == 0 && queue_ptr->active_producers > 0)
+        if ((err = pthread_cond_wait(&queue_ptr->empty, &queue_ptr->mutex)))
+            exit_with_err("pthread_cond_wait", err);
+
+    count = (queue_ptr->size < n ? queue_ptr->size : n);
+    if (count > 0) {
+        first_part = queue_ptr->capacity - queue_ptr->out;
+        if (first_part > count)
+            first_part = count;
+        memcpy(extr_nums, queue_ptr->data + queue_ptr->out,
+               first_part * sizeof(long));
+        memcpy(extr_nums + first_part, queue_ptr->data,
+               (count - first_part) * sizeof(long));
+        queue_ptr->out = (queue_ptr->out + count) % queue_ptr->capacity;
+        queue_ptr->size -= count;
+
+        // un solo risveglio per tutto il blocco (se la coda era piena)
+        if (queue_ptr->size + count == queue_ptr->capacity)
+            if ((err = pthread_cond_broadcast(&queue_ptr->full)))
+                exit_with_err("pthread_cond_broadcast", err);
+    }
+
+    if ((err = pthread_mutex_unlock(&queue_ptr->mutex)))
+        exit_with_err("pthread_mutex_wait", err);
+
+    return count;
+}
+
 void number_queue_print(number_queue_t *const queue_ptr) {
     assert(queue_ptr);
     int err;
@@ -199,6 +292,8 @@ typedef struct {
     pthread_t tid;
     unsigned int id;
     unsigned long items_to_produce;
+    unsigned long batch_size;
+    bool verbose;
     long total;
 
     number_queue_t
@@ -208,6 +303,8 @@ typedef struct {
 typedef struct {
     pthread_t tid;
     unsigned int id;
+    unsigned long batch_size;
+    bool verbose;
     long total;
 
     number_queue_t *queue_ptr;
@@ -216,71 +313,131 @@ typedef struct {
 void *producer_function(void *arg) {
     assert(arg);
 
-    long number;
+    unsigned long count;
+    long *numbers;
     producer_data_t *data_ptr = (producer_data_t *)arg;
 
+    if ((numbers = malloc(data_ptr->batch_size * sizeof(long))) == NULL)
+        exit_with_sys_err("malloc");
+
     printf("[P%u] produttore attivato...\n", data_ptr->id);
 
     while (data_ptr->items_to_produce > 0) {
-        // "produzione dell'elemento": un numero a caso
-        number = rand();
-        data_ptr->total += number;
-        printf("[P%u] numero '%lu' prodotto\n", data_ptr->id, number);
-        data_ptr->items_to_produce--;
+        // "produzione" di un blocco di (al più) `batch_size` numeri a caso
+        count = (data_ptr->items_to_produce < data_ptr->batch_size
+                     ? data_ptr->items_to_produce
+                     : data_ptr->batch_size);
+        for (unsigned long i = 0; i < count; i++) {
+            numbers[i] = rand();
+            data_ptr->total += numbers[i];
+            if (data_ptr->verbose)
+                printf("[P%u] numero '%lu' prodotto\n", data_ptr->id,
+                       numbers[i]);
+        }
+        data_ptr->items_to_produce -= count;
 
         // inserimento elemento con bloccaggio automatico con eventuale
         // indicazione dell'ultimo inserimento
-        number_queue_push(data_ptr->queue_ptr, number,
-                          (data_ptr->items_to_produce == 0));
-
-        printf("[P%u] numero '%lu' inserito nella coda\n", data_ptr->id,
-               number);
-
-        flockfile(stdout);
-        printf("[P%u] coda attuale: ", data_ptr->id);
-        number_queue_print(data_ptr->queue_ptr);
-        funlockfile(stdout);
+        if (data_ptr->batch_size == 1)
+            number_queue_push(data_ptr->queue_ptr, numbers[0],
+                              (data_ptr->items_to_produce == 0));
+        else
+            // inserimento a blocchi: un blocco può entrare solo in parte se
+            // la coda ha poco spazio, quindi si ripete per il resto
+            for (unsigned long done = 0; done < count;)
+                done += number_queue_push_n(data_ptr->queue_ptr, numbers + done,
+                                            count - done,
+                                            (data_ptr->items_to_produce == 0));
+
+        if (data_ptr->verbose) {
+            printf("[P%u] %lu numeri inseriti nella coda\n", data_ptr->id,
+                   count);
+
+            flockfile(stdout);
+            printf("[P%u] coda attuale: ", data_ptr->id);
+            number_queue_print(data_ptr->queue_ptr);
+            funlockfile(stdout);
+        }
     }
 
     printf("[P%u] produttore terminato con un valore totale di inserimenti "
            "pari a %lu\n",
            data_ptr->id, data_ptr->total);
 
+    free(numbers);
+
     return (NULL); // il totale lo ritorniamo usando la struttura privata
 }
 
 void *consumer_function(void *arg) {
     assert(arg);
 
-    long number;
+    unsigned long count;
+    long *numbers;
     consumer_data_t *data_ptr = (consumer_data_t *)arg;
 
+    if ((numbers = malloc(data_ptr->batch_size * sizeof(long))) == NULL)
+        exit_with_sys_err("malloc");
+
     printf("[C%u] consumatore attivato...\n", data_ptr->id);
 
     while (true) {
-        // estrazione elemento con fallimento su esaurimento senza produttori
-        if (!number_queue_pop(&number, data_ptr->queue_ptr))
+        // estrazione elementi con fallimento su esaurimento senza produttori
+        if (data_ptr->batch_size == 1)
+            count = (number_queue_pop(&numbers[0], data_ptr->queue_ptr) ? 1 : 0);
+        else
+            count = number_queue_pop_n(numbers, data_ptr->batch_size,
+                                       data_ptr->queue_ptr);
+        if (count == 0)
             break;
-        data_ptr->total += number;
 
-        printf("[C%u] numero '%lu' estratto dalla coda\n", data_ptr->id,
-               number);
-
-        flockfile(stdout);
-        printf("[C%u] coda attuale:", data_ptr->id);
-        number_queue_print(data_ptr->queue_ptr);
-        funlockfile(stdout);
+        for (unsigned long i = 0; i < count; i++) {
+            data_ptr->total += numbers[i];
+            if (data_ptr->verbose)
+                printf("[C%u] numero '%lu' estratto dalla coda\n", data_ptr->id,
+                       numbers[i]);
+        }
+
+        if (data_ptr->verbose) {
+            flockfile(stdout);
+            printf("[C%u] coda attuale:", data_ptr->id);
+            number_queue_print(data_ptr->queue_ptr);
+            funlockfile(stdout);
+        }
     }
 
     printf("[C%u] consumatore terminato con un valore totale di inserimenti "
            "pari a %lu\n",
            data_ptr->id, data_ptr->total);
 
+    free(numbers);
+
     return (NULL);
 }
 
 int main(int argc, char *argv[]) {
     int err;
+    unsigned long num_items = NUM_OF_ITEMS_TO_PRODUCE, batch_size = 1;
+    bool verbose = true;
+    struct timespec start, end;
+    double elapsed;
+
+    // opzioni: `--batch N` (elementi per operazione), `--items N` (elementi
+    // totali da produrre) e `--quiet` (niente stampe per ogni elemento, utile
+    // per misurare il throughput)
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            if ((batch_size = strtoul(argv[++i], NULL, 10)) < 1)
+                exit_with_err_msg("dimensione del blocco non valida!\n");
+        } else if (strcmp(argv[i], "--items") == 0 && i + 1 < argc) {
+            if ((num_items = strtoul(argv[++i], NULL, 10)) < NUM_PRODUCERS)
+                exit_with_err_msg("numero di elementi non valido!\n");
+        } else if (strcmp(argv[i], "--quiet") == 0)
+            verbose = false;
+        else
+            exit_with_err_msg(
+                "uso: %s [--batch <N>] [--items <N>] [--quiet]\n", argv[0]);
+    }
 
     srand(time(NULL));
 
@@ -288,12 +445,17 @@ int main(int argc, char *argv[]) {
     number_queue_t queue;
     number_queue_init(&queue, QUEUE_CAPACITY, NUM_PRODUCERS);
 
+    if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+        exit_with_sys_err("clock_gettime");
+
     // creazione dei produttori
     producer_data_t prod_data[NUM_PRODUCERS];
     for (int i = 0; i < NUM_PRODUCERS; i++) {
         prod_data[i].queue_ptr = &queue;
         prod_data[i].id = i + 1;
-        prod_data[i].items_to_produce = NUM_OF_ITEMS_TO_PRODUCE / NUM_PRODUCERS;
+        prod_data[i].items_to_produce = num_items / NUM_PRODUCERS;
+        prod_data[i].batch_size = batch_size;
+        prod_data[i].verbose = verbose;
         prod_data[i].total = 0;
         if ((err = pthread_create(&prod_data[i].tid, NULL, producer_function,
                                   (void *)(&prod_data[i]))))
@@ -305,6 +467,8 @@ int main(int argc, char *argv[]) {
     for (int i = 0; i < NUM_CONSUMERS; i++) {
         cons_data[i].queue_ptr = &queue;
         cons_data[i].id = i + 1;
+        cons_data[i].batch_size = batch_size;
+        cons_data[i].verbose = verbose;
         cons_data[i].total = 0;
         if ((err = pthread_create(&cons_data[i].tid, NULL, consumer_function,
                                   (void *)(&cons_data[i]))))
@@ -323,6 +487,15 @@ int main(int argc, char *argv[]) {
             exit_with_err("pthread_join", err);
         total_insertions += prod_data[i].total;
     }
+
+    if (clock_gettime(CLOCK_MONOTONIC, &end) == -1)
+        exit_with_sys_err("clock_gettime");
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    num_items -= num_items % NUM_PRODUCERS; // elementi effettivamente prodotti
+    printf("[main] %lu elementi trasferiti in blocchi da %lu in %.3f secondi "
+           "(%.0f elementi/secondo)\n",
+           num_items, batch_size, elapsed, num_items / elapsed);
+
     // non indispensabile ma è una buona abitudine...
     number_queue_destroy(&queue);
 
@@ -2,15 +2,23 @@
  * come l'esempio `thread-number-set-with-rwlock.c` ma integrando i meccanismi
  * di sincronizzazione (lettore-scrittore) all'interno delle funzioni di
  * gestione della struttura dati; resta necessario prevedere un semplice mutex
- * lock per proteggere il contatore degli inserimenti residui
+ * lock per proteggere il contatore degli inserimenti residui; gli agenti che
+ * interrogano totale e massimo non usano il lock ma leggono una copia degli
+ * aggregati protetta da un "seqlock".
+ *
+ * lanciato come `thread-safe-number-set-with-rwlock benchmark [lettori]
+ * [secondi]` confronta invece, con un solo scrittore e molti lettori, le
+ * letture degli aggregati col lock in lettura e quelle col seqlock
  */
 
 #include "lib-misc.h"
 #include <assert.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -22,18 +30,192 @@
     (NUM_INSERTER_AGENTS + NUM_EXTRACTOR_AGENTS + NUM_GETTER_TOTAL_AGENTS +    \
      NUM_GETTER_MAX_AGENTS)
 #define NUM_INSERTIONS 500
+#define DEFAULT_BENCHMARK_READERS 8
+#define DEFAULT_BENCHMARK_SECONDS 2
+#define BENCHMARK_SET_SIZE 1000
 
 /* < safe-number-set >
- * variante thread-safe di `number-set` */
+ * variante thread-safe di `number-set`; rispetto all'originale gli elementi,
+ * sempre tenuti in un vettore denso `data` (comodo per le estrazioni casuali e
+ * per la stampa), sono indicizzati da una tabella hash a indirizzamento aperto
+ * (Robin Hood hashing) che rende la ricerca di costo costante; il totale e il
+ * massimo sono mantenuti ad ogni modifica così che i lettori non debbano mai
+ * scorrere l'insieme */
 #define NUMBER_SET_BASE_CAPACITY 8
+#define NUMBER_SET_NO_SLOT ((unsigned long)-1)
 
 typedef struct {
     unsigned long capacity;
     unsigned long size;
     long *data;
+
+    // tabella hash: ogni cella contiene la posizione in `data` aumentata di 1
+    // (0 indica una cella vuota); la capacità è una potenza di 2 pari ad
+    // almeno il doppio di `capacity` (fattore di carico <= 0.5)
+    unsigned long table_capacity;
+    unsigned long *table;
+
+    long total; // somma degli elementi presenti
+    long max;   // massimo degli elementi presenti (valido se `size > 0`)
+
+    // copia di dimensione/totale/massimo per i lettori senza lock (seqlock):
+    // uno scrittore (che ha già il lock in scrittura) rende dispari `sequence`
+    // prima di aggiornarla e di nuovo pari dopo; un lettore ripete la lettura
+    // se ha visto un valore dispari o se `sequence` è cambiato nel frattempo,
+    // quindi non scrive mai in memoria condivisa (niente contesa sulla linea
+    // di cache del contatore interno del rwlock)
+    unsigned long sequence;
+    unsigned long published_size;
+    long published_total;
+    long published_max;
+
     pthread_rwlock_t lock;
 } number_set_t;
 
+/* posizione "ideale" di `num` nella tabella (hashing moltiplicativo di
+ * Fibonacci: i bit alti del prodotto sono ben distribuiti) */
+static unsigned long __number_set_home(number_set_t *const set_ptr, long num) {
+    return (unsigned long)(((uint64_t)num * 0x9E3779B97F4A7C15ULL) >> 32) &
+           (set_ptr->table_capacity - 1);
+}
+
+/* distanza della cella `pos` (occupata) dalla posizione ideale del suo
+ * elemento */
+static unsigned long __number_set_probe_distance(number_set_t *const set_ptr,
+                                                 unsigned long pos) {
+    long num = set_ptr->data[set_ptr->table[pos] - 1];
+
+    return (pos - __number_set_home(set_ptr, num)) &
+           (set_ptr->table_capacity - 1);
+}
+
+/* inserisce nella tabella il riferimento all'elemento `data[index]`: con il
+ * Robin Hood hashing chi è più lontano dalla propria posizione ideale "ruba"
+ * la cella a chi è più vicino, così le sequenze di scansione restano corte */
+static void __number_set_table_insert(number_set_t *set_ptr,
+                                      unsigned long index) {
+    unsigned long entry = index + 1, distance = 0, tmp, entry_distance;
+    unsigned long pos = __number_set_home(set_ptr, set_ptr->data[index]);
+
+    while (set_ptr->table[pos] != 0) {
+        entry_distance = __number_set_probe_distance(set_ptr, pos);
+        if (entry_distance < distance) {
+            tmp = set_ptr->table[pos];
+            set_ptr->table[pos] = entry;
+            entry = tmp;
+            distance = entry_distance;
+        }
+        pos = (pos + 1) & (set_ptr->table_capacity - 1);
+        distance++;
+    }
+    set_ptr->table[pos] = entry;
+}
+
+/* (ri)costruisce la tabella hash a partire dal vettore denso */
+static void __number_set_table_rebuild(number_set_t *set_ptr) {
+    unsigned long table_capacity = 1;
+
+    while (table_capacity < 2 * set_ptr->capacity)
+        table_capacity <<= 1;
+
+    free(set_ptr->table);
+    set_ptr->table_capacity = table_capacity;
+    set_ptr->table = calloc(table_capacity, sizeof(unsigned long));
+    assert(set_ptr->table);
+
+    for (unsigned long i = 0; i < set_ptr->size; i++)
+        __number_set_table_insert(set_ptr, i);
+}
+
+/* restituisce la cella della tabella che riferisce `num` o
+ * `NUMBER_SET_NO_SLOT` se assente */
+static unsigned long __number_set_find_slot(number_set_t *const set_ptr,
+                                            long num) {
+    unsigned long pos = __number_set_home(set_ptr, num), distance = 0;
+
+    while (set_ptr->table[pos] != 0) {
+        if (set_ptr->data[set_ptr->table[pos] - 1] == num)
+            return pos;
+        // per l'invariante Robin Hood, `num` non può trovarsi oltre una cella
+        // più vicina di noi alla propria posizione ideale
+        if (__number_set_probe_distance(set_ptr, pos) < distance)
+            break;
+        pos = (pos + 1) & (set_ptr->table_capacity - 1);
+        distance++;
+    }
+
+    return NUMBER_SET_NO_SLOT;
+}
+
+/* pubblica gli aggregati per i lettori del seqlock: va chiamata da chi detiene
+ * il lock in scrittura, al termine di ogni modifica */
+static void __number_set_publish(number_set_t *set_ptr) {
+    unsigned long sequence = set_ptr->sequence;
+
+    __atomic_store_n(&set_ptr->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&set_ptr->published_size, set_ptr->size, __ATOMIC_RELAXED);
+    __atomic_store_n(&set_ptr->published_total, set_ptr->total,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&set_ptr->published_max, set_ptr->max, __ATOMIC_RELAXED);
+    __atomic_store_n(&set_ptr->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/* legge una copia coerente degli aggregati senza alcun lock */
+static void __number_set_read_published(number_set_t *const set_ptr,
+                                        unsigned long *size_ptr,
+                                        long *total_ptr, long *max_ptr) {
+    unsigned long before, after;
+
+    do {
+        before = __atomic_load_n(&set_ptr->sequence, __ATOMIC_ACQUIRE);
+        *size_ptr = __atomic_load_n(&set_ptr->published_size, __ATOMIC_RELAXED);
+        *total_ptr =
+            __atomic_load_n(&set_ptr->published_total, __ATOMIC_RELAXED);
+        *max_ptr = __atomic_load_n(&set_ptr->published_max, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&set_ptr->sequence, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+/* rimuove l'elemento riferito dalla cella `pos` della tabella */
+static long __number_set_remove_slot(number_set_t *set_ptr, unsigned long pos) {
+    unsigned long mask = set_ptr->table_capacity - 1, next;
+    unsigned long index = set_ptr->table[pos] - 1;
+    long num = set_ptr->data[index];
+
+    // cancellazione con "spostamento all'indietro": le celle successive della
+    // stessa sequenza avanzano di una posizione (niente lapidi)
+    next = (pos + 1) & mask;
+    while (set_ptr->table[next] != 0 &&
+           __number_set_probe_distance(set_ptr, next) > 0) {
+        set_ptr->table[pos] = set_ptr->table[next];
+        pos = next;
+        next = (next + 1) & mask;
+    }
+    set_ptr->table[pos] = 0;
+
+    // l'ultimo elemento del vettore denso prende il posto di quello rimosso
+    set_ptr->size--;
+    if (index != set_ptr->size) {
+        set_ptr->data[index] = set_ptr->data[set_ptr->size];
+        set_ptr->table[__number_set_find_slot(set_ptr, set_ptr->data[index])] =
+            index + 1;
+    }
+
+    // aggiornamento degli aggregati: il massimo va ricalcolato solo se è stato
+    // rimosso proprio lui (per estrazioni casuali capita con probabilità 1/n)
+    set_ptr->total -= num;
+    if (num == set_ptr->max && set_ptr->size > 0) {
+        set_ptr->max = set_ptr->data[0];
+        for (unsigned long i = 1; i < set_ptr->size; i++)
+            if (set_ptr->data[i] > set_ptr->max)
+                set_ptr->max = set_ptr->data[i];
+    }
+
+    return num;
+}
+
 void number_set_init(number_set_t *set_ptr, unsigned long initial_capacity) {
     assert(set_ptr);
     int err;
@@ -44,6 +226,11 @@ void number_set_init(number_set_t *set_ptr, unsigned long initial_capacity) {
     set_ptr->size = 0;
     set_ptr->data = malloc(set_ptr->capacity * sizeof(long));
     assert(set_ptr->data);
+    set_ptr->table = NULL;
+    __number_set_table_rebuild(set_ptr);
+    set_ptr->total = set_ptr->max = 0;
+    set_ptr->sequence = 0;
+    __number_set_publish(set_ptr);
     if ((err = pthread_rwlock_init(&set_ptr->lock, NULL)))
         exit_with_err("pthread_rwlock_init", err);
 }
@@ -55,8 +242,10 @@ void number_set_destroy(number_set_t *set_ptr) {
     int err;
 
     free(set_ptr->data);
+    free(set_ptr->table);
     set_ptr->data = NULL;
-    set_ptr->capacity = set_ptr->size = 0;
+    set_ptr->table = NULL;
+    set_ptr->capacity = set_ptr->size = set_ptr->table_capacity = 0;
     if ((err = pthread_rwlock_destroy(&set_ptr->lock)))
         exit_with_err("pthread_rwlock_destroy", err);
 }
@@ -87,12 +276,8 @@ bool number_set_is_empty(number_set_t *const set_ptr) {
 static bool __number_set_is_present(number_set_t *const set_ptr, long num) {
     assert(set_ptr);
 
-    // una semplice ricerca lineare
-    for (unsigned long i = 0; i < set_ptr->size; i++)
-        if (set_ptr->data[i] == num)
-            return true;
-
-    return false;
+    // ricerca tramite la tabella hash (costo medio costante)
+    return (__number_set_find_slot(set_ptr, num) != NUMBER_SET_NO_SLOT);
 }
 
 bool number_set_is_present(number_set_t *const set_ptr, long num) {
@@ -124,14 +309,25 @@ bool number_set_insert(number_set_t *set_ptr, long num) {
     if (__number_set_is_present(set_ptr, num)) // funzione interna (senza lock)
         return_value = false;
     else {
+        bool grown = false;
         if (set_ptr->capacity == set_ptr->size) {
             set_ptr->capacity *= 2;
             set_ptr->data =
                 realloc(set_ptr->data, set_ptr->capacity * sizeof(long));
-            assert(set_ptr);
+            assert(set_ptr->data);
+            grown = true;
         }
 
         set_ptr->data[set_ptr->size++] = num;
+        if (grown)
+            __number_set_table_rebuild(set_ptr); // include il nuovo elemento
+        else
+            __number_set_table_insert(set_ptr, set_ptr->size - 1);
+
+        set_ptr->total += num;
+        if (set_ptr->size == 1 || num > set_ptr->max)
+            set_ptr->max = num;
+        __number_set_publish(set_ptr);
 
         return_value = true;
     }
@@ -154,10 +350,11 @@ bool number_set_pop_random(long *extr_num_ptr, number_set_t *set_ptr) {
     if (set_ptr->size == 0)
         return_value = false;
     else {
+        // scelta casuale sul vettore denso e rimozione tramite la tabella
         unsigned long i = rand() % set_ptr->size;
-        *extr_num_ptr = set_ptr->data[i];
-
-        set_ptr->data[i] = set_ptr->data[--set_ptr->size];
+        *extr_num_ptr = __number_set_remove_slot(
+            set_ptr, __number_set_find_slot(set_ptr, set_ptr->data[i]));
+        __number_set_publish(set_ptr);
         return_value = true;
     }
 
@@ -183,16 +380,43 @@ void number_set_print(const char *prefix, number_set_t *const set_ptr) {
         exit_with_err("pthread_rwlock_unlock", err);
 }
 
+/* le due interrogazioni aggregate usano il seqlock: nessun lock e nessuna
+ * scrittura in memoria condivisa da parte del lettore */
 long number_set_get_total(number_set_t *const set_ptr) {
     assert(set_ptr);
-    long total = 0;
+    unsigned long size;
+    long total, max;
+
+    __number_set_read_published(set_ptr, &size, &total, &max);
+
+    return total;
+}
+
+bool number_set_get_max(long *max_num_ptr, number_set_t *const set_ptr) {
+    assert(set_ptr);
+    assert(max_num_ptr);
+    unsigned long size;
+    long total, max;
+
+    __number_set_read_published(set_ptr, &size, &total, &max);
+    if (size == 0)
+        return false;
+
+    *max_num_ptr = max;
+    return true;
+}
+
+/* versioni delle stesse interrogazioni col lock in lettura (usate solo per il
+ * confronto nel benchmark) */
+long number_set_get_total_with_rdlock(number_set_t *const set_ptr) {
+    assert(set_ptr);
+    long total;
     int err;
 
     if ((err = pthread_rwlock_rdlock(&set_ptr->lock)))
         exit_with_err("pthread_rwlock_rdlock", err);
 
-    for (unsigned long i = 0; i < set_ptr->size; i++)
-        total += set_ptr->data[i];
+    total = set_ptr->total; // mantenuto dagli scrittori: nessuna scansione
 
     if ((err = pthread_rwlock_unlock(&set_ptr->lock)))
         exit_with_err("pthread_rwlock_unlock", err);
@@ -200,7 +424,8 @@ long number_set_get_total(number_set_t *const set_ptr) {
     return total;
 }
 
-bool number_set_get_max(long *max_num_ptr, number_set_t *const set_ptr) {
+bool number_set_get_max_with_rdlock(long *max_num_ptr,
+                                    number_set_t *const set_ptr) {
     assert(set_ptr);
     bool return_value;
     int err;
@@ -211,11 +436,7 @@ bool number_set_get_max(long *max_num_ptr, number_set_t *const set_ptr) {
     if (set_ptr->size == 0)
         return_value = false;
     else {
-
-        *max_num_ptr = set_ptr->data[0];
-        for (unsigned long i = 1; i < set_ptr->size; i++)
-            *max_num_ptr = (*max_num_ptr < set_ptr->data[i] ? set_ptr->data[i]
-                                                            : *max_num_ptr);
+        *max_num_ptr = set_ptr->max; // mantenuto dagli scrittori
         return_value = true;
     }
 
@@ -401,9 +622,123 @@ void *thread_function(void *arg) {
     return ((void *)counter_to_return);
 }
 
+/* agenti del benchmark: un solo scrittore che alterna inserimenti ed
+ * estrazioni mantenendo l'insieme attorno a `BENCHMARK_SET_SIZE` elementi e
+ * molti lettori che interrogano continuamente totale e massimo; ognuno conta
+ * le proprie operazioni in una variabile locale e le salva solo alla fine:
+ * i contatori nell'array `readers` condividono le linee di cache e
+ * aggiornarli a ogni operazione falserebbe la scalabilità misurata */
+typedef struct {
+    pthread_t tid;
+    bool use_seqlock;
+    unsigned long operations;
+
+    number_set_t *set_ptr;
+    bool *stop_ptr;
+} benchmark_data_t;
+
+void *benchmark_writer_function(void *arg) {
+    assert(arg);
+    benchmark_data_t *data_ptr = (benchmark_data_t *)arg;
+    unsigned int seed = time(NULL);
+    unsigned long size = 0, operations = 0;
+    long number;
+
+    while (!__atomic_load_n(data_ptr->stop_ptr, __ATOMIC_RELAXED)) {
+        if (size < BENCHMARK_SET_SIZE) {
+            if (number_set_insert(data_ptr->set_ptr, rand_r(&seed)))
+                size++;
+        } else if (number_set_pop_random(&number, data_ptr->set_ptr))
+            size--;
+        operations++;
+    }
+    data_ptr->operations = operations;
+
+    return (NULL);
+}
+
+void *benchmark_reader_function(void *arg) {
+    assert(arg);
+    benchmark_data_t *data_ptr = (benchmark_data_t *)arg;
+    unsigned long operations = 0;
+    long total = 0, max;
+
+    while (!__atomic_load_n(data_ptr->stop_ptr, __ATOMIC_RELAXED)) {
+        if (data_ptr->use_seqlock) {
+            total += number_set_get_total(data_ptr->set_ptr);
+            if (number_set_get_max(&max, data_ptr->set_ptr))
+                total += max;
+        } else {
+            total += number_set_get_total_with_rdlock(data_ptr->set_ptr);
+            if (number_set_get_max_with_rdlock(&max, data_ptr->set_ptr))
+                total += max;
+        }
+        operations++;
+    }
+    data_ptr->operations = operations;
+
+    return ((void *)total); // evita che il compilatore elimini le letture
+}
+
+void run_benchmark(bool use_seqlock, unsigned int num_readers,
+                   unsigned int seconds) {
+    int err;
+    bool stop = false;
+    number_set_t set;
+    benchmark_data_t writer, readers[num_readers];
+    unsigned long reads = 0;
+
+    number_set_init(&set, BENCHMARK_SET_SIZE);
+
+    writer = (benchmark_data_t){0, use_seqlock, 0, &set, &stop};
+    if ((err = pthread_create(&writer.tid, NULL, benchmark_writer_function,
+                              &writer)))
+        exit_with_err("pthread_create", err);
+    for (unsigned int i = 0; i < num_readers; i++) {
+        readers[i] = (benchmark_data_t){0, use_seqlock, 0, &set, &stop};
+        if ((err = pthread_create(&readers[i].tid, NULL,
+                                  benchmark_reader_function, &readers[i])))
+            exit_with_err("pthread_create", err);
+    }
+
+    sleep(seconds);
+    __atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+
+    if ((err = pthread_join(writer.tid, NULL)))
+        exit_with_err("pthread_join", err);
+    for (unsigned int i = 0; i < num_readers; i++) {
+        if ((err = pthread_join(readers[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+        reads += readers[i].operations;
+    }
+
+    number_set_destroy(&set);
+
+    printf("[main] %-8s: %12.0f letture/secondo, %12.0f scritture/secondo\n",
+           (use_seqlock ? "seqlock" : "rwlock"), (double)reads / seconds,
+           (double)writer.operations / seconds);
+}
+
 int main(int argc, char *argv[]) {
     int err, next_index = 0;
 
+    if (argc > 1 && strcmp(argv[1], "benchmark") == 0) {
+        unsigned int num_readers = DEFAULT_BENCHMARK_READERS;
+        unsigned int seconds = DEFAULT_BENCHMARK_SECONDS;
+
+        if (argc > 2 && (num_readers = atoi(argv[2])) < 1)
+            exit_with_err_msg("numero di lettori (%s) non valido!\n", argv[2]);
+        if (argc > 3 && (seconds = atoi(argv[3])) < 1)
+            exit_with_err_msg("durata (%s) non valida!\n", argv[3]);
+
+        printf("[main] benchmark con 1 scrittore e %u lettori per %u secondi "
+               "per variante...\n",
+               num_readers, seconds);
+        run_benchmark(false, num_readers, seconds);
+        run_benchmark(true, num_readers, seconds);
+        exit(EXIT_SUCCESS);
+    }
+
     srand(time(NULL));
 
     // preparazione dati condivisi
@@ -0,0 +1,589 @@
+/**
+ * variante di `thread-safe-number-set-with-rwlock.c` in cui l'insieme di
+ * numeri è suddiviso in K "fette" (shard) indipendenti, ognuna con il proprio
+ * lock lettore-scrittore: ogni numero appartiene sempre alla stessa fetta
+ * (scelta con una funzione hash) e quindi agenti che lavorano su numeri
+ * diversi raramente si contendono lo stesso lock; le interrogazioni aggregate
+ * (totale, massimo, dimensione) usano dei valori riassuntivi che ogni fetta
+ * pubblica ad ogni modifica, senza alcun lock globale.
+ *
+ * il programma è un driver di stress senza stampe per singola operazione: il
+ * numero di agenti e di fette si sceglie da riga di comando così da poter
+ * osservare la scalabilità (con 1 sola fetta si ottiene il comportamento con
+ * lock unico dell'esempio originale)
+ *
+ * uso: thread-sharded-number-set [inseritori] [estrattori] [fette]
+ *                                [inserimenti]
+ */
+
+#include "lib-misc.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_NUM_INSERTER_AGENTS 2
+#define DEFAULT_NUM_EXTRACTOR_AGENTS 2
+#define NUM_GETTER_TOTAL_AGENTS 1
+#define NUM_GETTER_MAX_AGENTS 1
+#define DEFAULT_NUM_INSERTIONS 1000000
+#define CACHE_LINE_SIZE 64
+
+/* < sharded-number-set >
+ * ogni fetta è un `safe-number-set` (vettore denso indicizzato da una tabella
+ * hash Robin Hood) con il proprio lock; la struttura è allineata alla linea di
+ * cache così che i lock di fette diverse non finiscano sulla stessa linea */
+#define NUMBER_SET_BASE_CAPACITY 8
+#define NUMBER_SET_NO_SLOT ((unsigned long)-1)
+
+typedef struct {
+    unsigned long capacity;
+    unsigned long size;
+    long *data;
+    unsigned long table_capacity;
+    unsigned long *table;
+    long total;
+    long max;
+
+    // copie degli aggregati pubblicate (con scritture atomiche) al termine di
+    // ogni modifica: le leggono gli interrogatori senza prendere il lock
+    unsigned long published_size;
+    long published_total;
+    long published_max;
+
+    pthread_rwlock_t lock;
+} __attribute__((aligned(CACHE_LINE_SIZE))) number_set_shard_t;
+
+typedef struct {
+    unsigned int num_shards;
+    number_set_shard_t *shards;
+} number_set_t;
+
+static unsigned long __shard_home(number_set_shard_t *const shard_ptr,
+                                  long num) {
+    return (unsigned long)(((uint64_t)num * 0x9E3779B97F4A7C15ULL) >> 32) &
+           (shard_ptr->table_capacity - 1);
+}
+
+static unsigned long __shard_probe_distance(number_set_shard_t *const shard_ptr,
+                                            unsigned long pos) {
+    long num = shard_ptr->data[shard_ptr->table[pos] - 1];
+
+    return (pos - __shard_home(shard_ptr, num)) &
+           (shard_ptr->table_capacity - 1);
+}
+
+static void __shard_table_insert(number_set_shard_t *shard_ptr,
+                                 unsigned long index) {
+    unsigned long entry = index + 1, distance = 0, tmp, entry_distance;
+    unsigned long pos = __shard_home(shard_ptr, shard_ptr->data[index]);
+
+    while (shard_ptr->table[pos] != 0) {
+        entry_distance = __shard_probe_distance(shard_ptr, pos);
+        if (entry_distance < distance) {
+            tmp = shard_ptr->table[pos];
+            shard_ptr->table[pos] = entry;
+            entry = tmp;
+            distance = entry_distance;
+        }
+        pos = (pos + 1) & (shard_ptr->table_capacity - 1);
+        distance++;
+    }
+    shard_ptr->table[pos] = entry;
+}
+
+static void __shard_table_rebuild(number_set_shard_t *shard_ptr) {
+    unsigned long table_capacity = 1;
+
+    while (table_capacity < 2 * shard_ptr->capacity)
+        table_capacity <<= 1;
+
+    free(shard_ptr->table);
+    shard_ptr->table_capacity = table_capacity;
+    shard_ptr->table = calloc(table_capacity, sizeof(unsigned long));
+    assert(shard_ptr->table);
+
+    for (unsigned long i = 0; i < shard_ptr->size; i++)
+        __shard_table_insert(shard_ptr, i);
+}
+
+static unsigned long __shard_find_slot(number_set_shard_t *const shard_ptr,
+                                       long num) {
+    unsigned long pos = __shard_home(shard_ptr, num), distance = 0;
+
+    while (shard_ptr->table[pos] != 0) {
+        if (shard_ptr->data[shard_ptr->table[pos] - 1] == num)
+            return pos;
+        if (__shard_probe_distance(shard_ptr, pos) < distance)
+            break;
+        pos = (pos + 1) & (shard_ptr->table_capacity - 1);
+        distance++;
+    }
+
+    return NUMBER_SET_NO_SLOT;
+}
+
+static long __shard_remove_slot(number_set_shard_t *shard_ptr,
+                                unsigned long pos) {
+    unsigned long mask = shard_ptr->table_capacity - 1, next;
+    unsigned long index = shard_ptr->table[pos] - 1;
+    long num = shard_ptr->data[index];
+
+    next = (pos + 1) & mask;
+    while (shard_ptr->table[next] != 0 &&
+           __shard_probe_distance(shard_ptr, next) > 0) {
+        shard_ptr->table[pos] = shard_ptr->table[next];
+        pos = next;
+        next = (next + 1) & mask;
+    }
+    shard_ptr->table[pos] = 0;
+
+    shard_ptr->size--;
+    if (index != shard_ptr->size) {
+        shard_ptr->data[index] = shard_ptr->data[shard_ptr->size];
+        shard_ptr->table[__shard_find_slot(shard_ptr, shard_ptr->data[index])] =
+            index + 1;
+    }
+
+    shard_ptr->total -= num;
+    if (num == shard_ptr->max && shard_ptr->size > 0) {
+        shard_ptr->max = shard_ptr->data[0];
+        for (unsigned long i = 1; i < shard_ptr->size; i++)
+            if (shard_ptr->data[i] > shard_ptr->max)
+                shard_ptr->max = shard_ptr->data[i];
+    }
+
+    return num;
+}
+
+/* da chiamare col lock in scrittura al termine di ogni modifica */
+static void __shard_publish(number_set_shard_t *shard_ptr) {
+    __atomic_store_n(&shard_ptr->published_total, shard_ptr->total,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&shard_ptr->published_max, shard_ptr->max,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&shard_ptr->published_size, shard_ptr->size,
+                     __ATOMIC_RELEASE);
+}
+
+/* la fetta di appartenenza si calcola con un hash diverso da quello usato
+ * nelle tabelle: altrimenti tutti i numeri di una fetta avrebbero gli stessi
+ * bit bassi della posizione ideale (e la tabella si riempirebbe a grappoli) */
+static number_set_shard_t *__number_set_shard_of(number_set_t *const set_ptr,
+                                                 long num) {
+    uint64_t x = (uint64_t)num;
+
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+
+    return &set_ptr->shards[x % set_ptr->num_shards];
+}
+
+#define lock_shard(op, shard_ptr)                                              \
+    do {                                                                       \
+        int __err;                                                             \
+        if ((__err = pthread_rwlock_##op(&(shard_ptr)->lock)))                 \
+            exit_with_err("pthread_rwlock_" #op, __err);                       \
+    } while (0)
+
+void number_set_init(number_set_t *set_ptr, unsigned long initial_capacity,
+                     unsigned int num_shards) {
+    assert(set_ptr);
+    assert(num_shards > 0);
+    int err;
+
+    set_ptr->num_shards = num_shards;
+    if ((err = posix_memalign((void **)&set_ptr->shards, CACHE_LINE_SIZE,
+                              num_shards * sizeof(number_set_shard_t))))
+        exit_with_err("posix_memalign", err);
+
+    // la capacità iniziale è ripartita tra le fette
+    initial_capacity /= num_shards;
+    for (unsigned int i = 0; i < num_shards; i++) {
+        number_set_shard_t *shard_ptr = &set_ptr->shards[i];
+
+        shard_ptr->capacity = (initial_capacity >= NUMBER_SET_BASE_CAPACITY
+                                   ? initial_capacity
+                                   : NUMBER_SET_BASE_CAPACITY);
+        shard_ptr->size = 0;
+        shard_ptr->data = malloc(shard_ptr->capacity * sizeof(long));
+        assert(shard_ptr->data);
+        shard_ptr->table = NULL;
+        __shard_table_rebuild(shard_ptr);
+        shard_ptr->total = shard_ptr->max = 0;
+        __shard_publish(shard_ptr);
+        if ((err = pthread_rwlock_init(&shard_ptr->lock, NULL)))
+            exit_with_err("pthread_rwlock_init", err);
+    }
+}
+
+void number_set_destroy(number_set_t *set_ptr) {
+    assert(set_ptr);
+    assert(set_ptr->shards);
+    int err;
+
+    for (unsigned int i = 0; i < set_ptr->num_shards; i++) {
+        free(set_ptr->shards[i].data);
+        free(set_ptr->shards[i].table);
+        if ((err = pthread_rwlock_destroy(&set_ptr->shards[i].lock)))
+            exit_with_err("pthread_rwlock_destroy", err);
+    }
+    free(set_ptr->shards);
+    set_ptr->shards = NULL;
+    set_ptr->num_shards = 0;
+}
+
+bool number_set_is_present(number_set_t *const set_ptr, long num) {
+    assert(set_ptr);
+    bool return_value;
+    number_set_shard_t *shard_ptr = __number_set_shard_of(set_ptr, num);
+
+    lock_shard(rdlock, shard_ptr);
+    return_value = (__shard_find_slot(shard_ptr, num) != NUMBER_SET_NO_SLOT);
+    lock_shard(unlock, shard_ptr);
+
+    return return_value;
+}
+
+bool number_set_insert(number_set_t *set_ptr, long num) {
+    assert(set_ptr);
+    bool return_value;
+    number_set_shard_t *shard_ptr = __number_set_shard_of(set_ptr, num);
+
+    lock_shard(wrlock, shard_ptr);
+
+    if (__shard_find_slot(shard_ptr, num) != NUMBER_SET_NO_SLOT)
+        return_value = false;
+    else {
+        bool grown = false;
+        if (shard_ptr->capacity == shard_ptr->size) {
+            shard_ptr->capacity *= 2;
+            shard_ptr->data =
+                realloc(shard_ptr->data, shard_ptr->capacity * sizeof(long));
+            assert(shard_ptr->data);
+            grown = true;
+        }
+
+        shard_ptr->data[shard_ptr->size++] = num;
+        if (grown)
+            __shard_table_rebuild(shard_ptr);
+        else
+            __shard_table_insert(shard_ptr, shard_ptr->size - 1);
+
+        shard_ptr->total += num;
+        if (shard_ptr->size == 1 || num > shard_ptr->max)
+            shard_ptr->max = num;
+        __shard_publish(shard_ptr);
+
+        return_value = true;
+    }
+
+    lock_shard(unlock, shard_ptr);
+
+    return return_value;
+}
+
+/* estrae un numero a caso: si parte da una fetta casuale e si passa alle
+ * successive se vuota; `seed_ptr` è il seme privato del chiamante per
+ * `rand_r` (la `rand` condivisa ha un lock interno che annullerebbe i
+ * vantaggi della suddivisione) */
+bool number_set_pop_random(long *extr_num_ptr, number_set_t *set_ptr,
+                           unsigned int *seed_ptr) {
+    assert(set_ptr);
+    assert(extr_num_ptr);
+    assert(seed_ptr);
+    unsigned int start = rand_r(seed_ptr) % set_ptr->num_shards;
+
+    for (unsigned int i = 0; i < set_ptr->num_shards; i++) {
+        number_set_shard_t *shard_ptr =
+            &set_ptr->shards[(start + i) % set_ptr->num_shards];
+
+        // le fette vuote si saltano senza prendere il lock
+        if (__atomic_load_n(&shard_ptr->published_size, __ATOMIC_ACQUIRE) == 0)
+            continue;
+
+        lock_shard(wrlock, shard_ptr);
+        if (shard_ptr->size > 0) {
+            unsigned long index = rand_r(seed_ptr) % shard_ptr->size;
+            *extr_num_ptr = __shard_remove_slot(
+                shard_ptr,
+                __shard_find_slot(shard_ptr, shard_ptr->data[index]));
+            __shard_publish(shard_ptr);
+            lock_shard(unlock, shard_ptr);
+            return true;
+        }
+        lock_shard(unlock, shard_ptr);
+    }
+
+    return false;
+}
+
+/* NB: le interrogazioni aggregate che seguono non fermano le modifiche sulle
+ * altre fette: il risultato somma valori coerenti per ciascuna fetta ma non
+ * necessariamente "scattati" nello stesso istante */
+unsigned long number_set_get_size(number_set_t *const set_ptr) {
+    assert(set_ptr);
+    unsigned long size = 0;
+
+    for (unsigned int i = 0; i < set_ptr->num_shards; i++)
+        size += __atomic_load_n(&set_ptr->shards[i].published_size,
+                                __ATOMIC_ACQUIRE);
+
+    return size;
+}
+
+bool number_set_is_empty(number_set_t *const set_ptr) {
+    assert(set_ptr);
+
+    return (number_set_get_size(set_ptr) == 0);
+}
+
+long number_set_get_total(number_set_t *const set_ptr) {
+    assert(set_ptr);
+    long total = 0;
+
+    for (unsigned int i = 0; i < set_ptr->num_shards; i++)
+        total += __atomic_load_n(&set_ptr->shards[i].published_total,
+                                 __ATOMIC_RELAXED);
+
+    return total;
+}
+
+bool number_set_get_max(long *max_num_ptr, number_set_t *const set_ptr) {
+    assert(set_ptr);
+    assert(max_num_ptr);
+    bool found = false;
+
+    for (unsigned int i = 0; i < set_ptr->num_shards; i++) {
+        number_set_shard_t *shard_ptr = &set_ptr->shards[i];
+
+        if (__atomic_load_n(&shard_ptr->published_size, __ATOMIC_ACQUIRE) == 0)
+            continue;
+        long max = __atomic_load_n(&shard_ptr->published_max, __ATOMIC_RELAXED);
+        if (!found || max > *max_num_ptr)
+            *max_num_ptr = max;
+        found = true;
+    }
+
+    return found;
+}
+
+/* la stampa blocca (in lettura) una fetta per volta */
+void number_set_print(const char *prefix, number_set_t *const set_ptr) {
+    assert(set_ptr);
+    unsigned long size = 0, capacity = 0;
+    bool first = true;
+
+    printf("%s{ ", prefix);
+    for (unsigned int s = 0; s < set_ptr->num_shards; s++) {
+        number_set_shard_t *shard_ptr = &set_ptr->shards[s];
+
+        lock_shard(rdlock, shard_ptr);
+        for (unsigned long i = 0; i < shard_ptr->size; i++) {
+            printf("%s%lu", (first ? "" : ", "), shard_ptr->data[i]);
+            first = false;
+        }
+        size += shard_ptr->size;
+        capacity += shard_ptr->capacity;
+        lock_shard(unlock, shard_ptr);
+    }
+    printf(" } [%lu/%lu su %u fette]\n", size, capacity, set_ptr->num_shards);
+}
+/* < sharded-number-set > */
+
+typedef enum { INSERTER, EXTRACTOR, GETTER_TOTAL, GETTER_MAX } agent_type_t;
+
+typedef struct {
+    number_set_t set;
+    long insertions_to_do; // inserimenti da assegnare (può scendere sotto 0)
+    long insertions_to_publish; // inserimenti non ancora completati
+} shared_data_t;
+
+/* come le fette, i dati di ogni agente occupano linee di cache proprie:
+ * contatori e seme sono scritti a ogni operazione e, affiancati nell'array
+ * `datas`, annullerebbero in parte il vantaggio della suddivisione */
+typedef struct {
+    pthread_t tid;
+    unsigned int id;
+    agent_type_t type;
+    unsigned int seed;
+    unsigned long operations;
+    long total;
+
+    shared_data_t *shared_data_ptr;
+} __attribute__((aligned(CACHE_LINE_SIZE))) thread_data_t;
+
+/* i contatori condivisi sono aggiornati con operazioni atomiche invece che con
+ * un mutex: un lock unico anche solo per questi annullerebbe la suddivisione */
+static bool __shared_work_finished(shared_data_t *shared_ptr) {
+    return (__atomic_load_n(&shared_ptr->insertions_to_publish,
+                            __ATOMIC_ACQUIRE) == 0 &&
+            number_set_is_empty(&shared_ptr->set));
+}
+
+void *thread_function(void *arg) {
+    assert(arg);
+    thread_data_t *data_ptr = (thread_data_t *)arg;
+    shared_data_t *shared_ptr = data_ptr->shared_data_ptr;
+    long number;
+
+    switch (data_ptr->type) {
+    case (INSERTER):
+        // prenotazione di un inserimento alla volta sul contatore condiviso
+        while (__atomic_fetch_sub(&shared_ptr->insertions_to_do, 1,
+                                  __ATOMIC_RELAXED) > 0) {
+            number = rand_r(&data_ptr->seed);
+            if (number_set_insert(&shared_ptr->set, number)) {
+                data_ptr->total += number;
+                data_ptr->operations++;
+            }
+            __atomic_fetch_sub(&shared_ptr->insertions_to_publish, 1,
+                               __ATOMIC_RELEASE);
+        }
+        break;
+    case (EXTRACTOR):
+        while (!__shared_work_finished(shared_ptr))
+            if (number_set_pop_random(&number, &shared_ptr->set,
+                                      &data_ptr->seed)) {
+                data_ptr->total += number;
+                data_ptr->operations++;
+            }
+        break;
+    case (GETTER_TOTAL):
+        while (!__shared_work_finished(shared_ptr)) {
+            data_ptr->total = number_set_get_total(&shared_ptr->set);
+            data_ptr->operations++;
+        }
+        break;
+    case (GETTER_MAX):
+        while (!__shared_work_finished(shared_ptr)) {
+            if (number_set_get_max(&number, &shared_ptr->set))
+                data_ptr->total = number;
+            data_ptr->operations++;
+        }
+        break;
+    default:
+        assert(false);
+    }
+
+    return (NULL);
+}
+
+int main(int argc, char *argv[]) {
+    int err;
+    long num_cores;
+    unsigned int num_inserters = DEFAULT_NUM_INSERTER_AGENTS;
+    unsigned int num_extractors = DEFAULT_NUM_EXTRACTOR_AGENTS;
+    unsigned int num_shards;
+    unsigned long num_insertions = DEFAULT_NUM_INSERTIONS;
+    struct timespec start, end;
+    double elapsed;
+
+    // di default una fetta per ogni core disponibile
+    if ((num_cores = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+        num_cores = 1;
+    num_shards = num_cores;
+
+    if (argc > 1 && (num_inserters = atoi(argv[1])) < 1)
+        exit_with_err_msg("numero di inseritori (%s) non valido!\n", argv[1]);
+    if (argc > 2 && (num_extractors = atoi(argv[2])) < 1)
+        exit_with_err_msg("numero di estrattori (%s) non valido!\n", argv[2]);
+    if (argc > 3 && (num_shards = atoi(argv[3])) < 1)
+        exit_with_err_msg("numero di fette (%s) non valido!\n", argv[3]);
+    if (argc > 4 && (num_insertions = atol(argv[4])) < 1)
+        exit_with_err_msg("numero di inserimenti (%s) non valido!\n", argv[4]);
+
+    unsigned int num_agents = num_inserters + num_extractors +
+                              NUM_GETTER_TOTAL_AGENTS + NUM_GETTER_MAX_AGENTS;
+
+    printf("[main] %u inseritori, %u estrattori, %u totalizzatori, %u "
+           "massimizzatori su %u fette (%lu inserimenti)\n",
+           num_inserters, num_extractors, NUM_GETTER_TOTAL_AGENTS,
+           NUM_GETTER_MAX_AGENTS, num_shards, num_insertions);
+
+    // preparazione dati condivisi
+    shared_data_t shared;
+    number_set_init(&shared.set, 0, num_shards);
+    shared.insertions_to_do = num_insertions;
+    shared.insertions_to_publish = num_insertions;
+
+    // preparazione dati privati degli agenti
+    thread_data_t *datas;
+    if ((err = posix_memalign((void **)&datas, CACHE_LINE_SIZE,
+                              num_agents * sizeof(thread_data_t))))
+        exit_with_err("posix_memalign", err);
+    memset(datas, 0, num_agents * sizeof(thread_data_t));
+    for (unsigned int i = 0; i < num_agents; i++) {
+        datas[i].shared_data_ptr = &shared;
+        datas[i].seed = time(NULL) ^ (i * 7919);
+        if (i < num_inserters) {
+            datas[i].type = INSERTER;
+            datas[i].id = i + 1;
+        } else if (i < num_inserters + num_extractors) {
+            datas[i].type = EXTRACTOR;
+            datas[i].id = i - num_inserters + 1;
+        } else if (i < num_agents - NUM_GETTER_MAX_AGENTS) {
+            datas[i].type = GETTER_TOTAL;
+            datas[i].id = i - num_inserters - num_extractors + 1;
+        } else {
+            datas[i].type = GETTER_MAX;
+            datas[i].id = i - (num_agents - NUM_GETTER_MAX_AGENTS) + 1;
+        }
+    }
+
+    if (clock_gettime(CLOCK_MONOTONIC, &start) == -1)
+        exit_with_sys_err("clock_gettime");
+
+    // creazione dei thread
+    for (unsigned int i = 0; i < num_agents; i++)
+        if ((err = pthread_create(&datas[i].tid, NULL, thread_function,
+                                  (void *)(&datas[i]))))
+            exit_with_err("pthread_create", err);
+
+    // attesa della terminazione dei thread
+    for (unsigned int i = 0; i < num_agents; i++)
+        if ((err = pthread_join(datas[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+
+    if (clock_gettime(CLOCK_MONOTONIC, &end) == -1)
+        exit_with_sys_err("clock_gettime");
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    // controllo dei totali degli inserimenti ed estrazioni
+    unsigned long total_insertions = 0, total_extractions = 0;
+    unsigned long writes = 0, reads = 0;
+    for (unsigned int i = 0; i < num_agents; i++) {
+        if (datas[i].type == INSERTER) {
+            total_insertions += datas[i].total;
+            writes += datas[i].operations;
+        } else if (datas[i].type == EXTRACTOR) {
+            total_extractions += datas[i].total;
+            writes += datas[i].operations;
+        } else
+            reads += datas[i].operations;
+    }
+
+    printf("[main] %lu modifiche in %.3f secondi (%.0f modifiche/secondo), "
+           "%lu interrogazioni aggregate\n",
+           writes, elapsed, writes / elapsed, reads);
+
+    // non indispensabile ma è una buona abitudine...
+    number_set_destroy(&shared.set);
+    free(datas);
+
+    printf("[main] controllo dei totali: inserimenti=%lu estrazioni=%lu\n",
+           total_insertions, total_extractions);
+    if (total_insertions == total_extractions) {
+        printf("[main] risultato corretto!\n");
+        exit(EXIT_SUCCESS);
+    } else {
+        printf("[main] risultato ERRATO!\n");
+        exit(EXIT_FAILURE);
+    }
+}
@@ -1,18 +1,42 @@
 /**
  * esempio che utilizza la routine di libreria `heapsort` per ordinare array di
  * long: in una strategia utilizza `n` thread per ordinare dei sotto-array
- * assegnati per poi utilizzare una procedura di `merge` per fondere tale liste;
- * in una seconda strategia utilizza un singolo thread (il main) per farlo in
- * modo classico con la stessa routine; alla fine viene fatto anche un confronto
- * sommario delle prestazioni.
+ * assegnati per poi fondere tali liste, sempre in parallelo, con una procedura
+ * di `merge` a `n` vie; in una seconda strategia utilizza un singolo thread (il
+ * main) per farlo in modo classico con la stessa routine; alla fine viene
+ * fatto anche un confronto sommario delle prestazioni, fase per fase.
  *
  * la soluzione proposta impiega una barriera per sincronizzare le varie fasi:
  * la usa una prima volta per far si che i thread attendano che il main abbia
- * finito di predisporre i sotto array su cui operare e, infine, per attendere
- * che questi abbiano finito.
+ * finito di predisporre i sotto array su cui operare, poi per attendere che
+ * tutti i sotto-array siano ordinati prima della fusione e, infine, per
+ * attendere che questi abbiano finito.
+ *
+ * la fusione è divisa tra i thread partizionando il vettore risultato: il
+ * thread `i` produce le posizioni da `i*N/n` a `(i+1)*N/n` dopo aver cercato,
+ * in ognuno degli `n` sotto-array ordinati, il punto da cui partire (una
+ * generalizzazione del "merge path" a più vie); ogni thread fonde la propria
+ * porzione con un albero dei perdenti (loser tree) che sceglie il minimo tra
+ * `n` candidati con log(n) confronti invece di `n`.
+ *
+ * al posto di `heapsort` si può scegliere (secondo parametro) un radix sort
+ * LSD (`radix`), usato sia dai thread che dal main, oppure un radix sort MSD
+ * parallelo (`msd-radix`) in cui i thread distribuiscono gli elementi in
+ * "secchi" in base ai bit più significativi e poi ordinano ognuno i propri
+ * secchi: il risultato è già in ordine e la fusione non serve più.
+ *
+ * con `work-stealing` (terzo parametro) le fette statiche e le barriere sono
+ * sostituite da `lib-work-stealing`: il vettore è diviso in un numero di
+ * sotto-array maggiore dei thread e sia l'ordinamento che la fusione sono
+ * `ws_parallel_for` i cui pezzi vengono rubati dai thread rimasti senza
+ * lavoro (un core lento non blocca più tutti gli altri sulla barriera).
+ *
+ * uso: thread-sort-with-barrier [numero-thread] [heapsort|radix|msd-radix]
+ *          [barriere|work-stealing]
  */
 
 #include "lib-misc.h"
+#include "lib-work-stealing.h"
 #include <assert.h>
 #include <limits.h>
 #include <pthread.h>
@@ -23,30 +47,54 @@
 #include <time.h>
 #include <unistd.h>
 
+#ifdef __AVX2__
+#include <immintrin.h> // intrinseci AVX2 (compilando con `-mavx2`)
+#endif
+
 #ifdef __linux
 #include <bsd/stdlib.h> // header necessaria solo sotto Linux per usare `heapsort`
 #endif
 
-#define MAX_NUM_OF_SORTING_THREADS 8
 #define DEFAULT_NUM_OF_SORTING_THREADS 4
 #define QUANTITY_OF_NUMBERS_TO_SORT                                            \
-    (840 * 100000L) // NB: 840=lcm(1,2,3,4,5,6,7,8)
+    (840 * 100000L) // NB: non serve più che sia divisibile per i thread
+#define RADIX_BITS 8      // bit per cifra del radix sort LSD
+#define MSD_RADIX_BITS 11 // bit usati per la suddivisione in secchi dell'MSD
+#define WS_RUNS_PER_THREAD 8 // sotto-array per thread con il work stealing
+#define WS_MERGE_GRAIN (64 * 1024L) // elementi minimi per pezzo di fusione
+
+typedef enum { HEAPSORT, LSD_RADIX_SORT, MSD_RADIX_SORT } sort_algorithm_t;
+
+const char *sort_algorithm_names[] = {"heapsort", "radix", "msd-radix"};
+
+typedef struct thread_data thread_data_t;
 
 typedef struct {
     long *data;
+    long *merged_data; // vettore risultato della fusione parallela
     long full_array_length;
+    unsigned int num_threads;
+    thread_data_t *threads; // per conoscere i sotto-array degli altri thread
+    // NB: con il work stealing `threads` e `num_threads` descrivono i
+    // sotto-array (più numerosi dei thread) e non i thread del pool
+    sort_algorithm_t algorithm;
 
     pthread_barrier_t barrier;
+    pthread_barrier_t workers_barrier; // solo tra i thread (fasi dell'MSD)
 } shared_data_t;
 
-typedef struct {
+struct thread_data {
     pthread_t tid;
     unsigned int id;
     long sub_array_offset;
     long sub_array_length;
 
+    // dati per la suddivisione in secchi dell'MSD
+    unsigned long min_key, max_key;
+    long *histogram;
+
     shared_data_t *shared_data_ptr;
-} thread_data_t;
+};
 
 int long_compare(const void *arg1, const void *arg2) {
     assert(arg1);
@@ -62,37 +110,458 @@ int long_compare(const void *arg1, const void *arg2) {
         return 1;
 }
 
+/* < radix-sort >
+ * radix sort LSD su long: le chiavi sono trattate come interi senza segno dopo
+ * aver invertito il bit del segno (così i negativi precedono i positivi) e
+ * ordinate una cifra di `RADIX_BITS` bit per volta, dalla meno significativa;
+ * gli istogrammi di tutte le cifre si calcolano con una sola lettura iniziale
+ * e le passate su cifre uguali per tutti gli elementi vengono saltate */
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_BUCKETS - 1)
+#define RADIX_DIGITS ((int)(sizeof(long) * CHAR_BIT / RADIX_BITS))
+
+static inline unsigned long radix_key(long value) {
+    return (unsigned long)value ^ (unsigned long)LONG_MIN;
+}
+
+static void __radix_histograms(const long *data, long length,
+                               long histograms[RADIX_DIGITS][RADIX_BUCKETS]) {
+    long i = 0;
+
+    memset(histograms, 0, RADIX_DIGITS * RADIX_BUCKETS * sizeof(long));
+
+#ifdef __AVX2__
+    // estrazione vettoriale delle cifre di 4 chiavi per volta; AVX2 non ha
+    // "scatter" sicuri con indici ripetuti, quindi i conteggi restano scalari
+    // ma ogni corsia del vettore ha il proprio sotto-istogramma: con chiavi
+    // consecutive dalle cifre uguali (frequenti nelle cifre alte) gli
+    // incrementi dello stesso contatore non devono più attendersi a vicenda
+    // (dipendenza scrittura->lettura in memoria); alla fine si sommano
+    const __m256i sign = _mm256_set1_epi64x(LONG_MIN);
+    const __m256i mask = _mm256_set1_epi64x(RADIX_MASK);
+    unsigned long long digits[4] __attribute__((aligned(32)));
+    long lanes[4][RADIX_DIGITS][RADIX_BUCKETS];
+
+    memset(lanes, 0, sizeof(lanes));
+    for (; i + 4 <= length; i += 4) {
+        __m256i keys = _mm256_xor_si256(
+            _mm256_loadu_si256((const __m256i *)(data + i)), sign);
+        for (int d = 0; d < RADIX_DIGITS; d++) {
+            __m256i digit = _mm256_and_si256(
+                _mm256_srl_epi64(keys, _mm_cvtsi32_si128(d * RADIX_BITS)),
+                mask);
+            _mm256_store_si256((__m256i *)digits, digit);
+            lanes[0][d][digits[0]]++;
+            lanes[1][d][digits[1]]++;
+            lanes[2][d][digits[2]]++;
+            lanes[3][d][digits[3]]++;
+        }
+    }
+    for (int d = 0; d < RADIX_DIGITS; d++)
+        for (int b = 0; b < RADIX_BUCKETS; b++)
+            histograms[d][b] =
+                lanes[0][d][b] + lanes[1][d][b] + lanes[2][d][b] + lanes[3][d][b];
+#endif
+
+    // versione scalare (o coda della versione vettoriale)
+    for (; i < length; i++) {
+        unsigned long key = radix_key(data[i]);
+        for (int d = 0; d < RADIX_DIGITS; d++)
+            histograms[d][(key >> (d * RADIX_BITS)) & RADIX_MASK]++;
+    }
+}
+
+/* ordina `data[0..length)` usando `tmp` (della stessa dimensione) come appoggio
+ * per le passate alterne */
+void radix_sort(long *data, long length, long *tmp) {
+    assert(data);
+    assert(tmp);
+    long histograms[RADIX_DIGITS][RADIX_BUCKETS];
+    long *src = data, *dst = tmp, *swap;
+
+    if (length < 2)
+        return;
+
+    __radix_histograms(data, length, histograms);
+
+    for (int d = 0; d < RADIX_DIGITS; d++) {
+        long *histogram = histograms[d], offset = 0, count;
+        int shift = d * RADIX_BITS;
+
+        // passata inutile: tutti gli elementi hanno la stessa cifra
+        if (histogram[(radix_key(src[0]) >> shift) & RADIX_MASK] == length)
+            continue;
+
+        // da conteggi a posizioni di partenza (somme prefisse)
+        for (int b = 0; b < RADIX_BUCKETS; b++) {
+            count = histogram[b];
+            histogram[b] = offset;
+            offset += count;
+        }
+        for (long i = 0; i < length; i++)
+            dst[histogram[(radix_key(src[i]) >> shift) & RADIX_MASK]++] =
+                src[i];
+
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != data)
+        memcpy(data, src, length * sizeof(long));
+}
+/* < radix-sort > */
+
+/* ordina un sotto-array con l'algoritmo scelto */
+void sort_sub_array(long *data, long length, sort_algorithm_t algorithm) {
+    long *tmp;
+
+    if (algorithm == HEAPSORT) {
+        if (heapsort(data, length, sizeof(long), long_compare) != 0)
+            exit_with_sys_err("heapsort");
+    } else if (length > 1) {
+        if ((tmp = malloc(length * sizeof(long))) == NULL)
+            exit_with_sys_err("malloc");
+        radix_sort(data, length, tmp);
+        free(tmp);
+    }
+}
+
+/* < loser-tree >
+ * albero dei perdenti per la fusione a `k` vie: le foglie (implicite) sono le
+ * teste dei `k` sotto-array, ogni nodo interno ricorda il "perdente" del
+ * confronto tra i due sotto-alberi e `nodes[0]` il vincitore assoluto (il
+ * minimo); dopo aver consumato il vincitore basta rigiocare i confronti sul
+ * cammino dalla sua foglia alla radice */
+typedef struct {
+    unsigned int k;
+    unsigned int *nodes;
+    const long **heads;
+    const long **ends;
+} loser_tree_t;
+
+/* vero se la testa del sotto-array `a` precede quella di `b` (un sotto-array
+ * esaurito vale +infinito) */
+static bool __loser_tree_less(const loser_tree_t *tree_ptr, unsigned int a,
+                              unsigned int b) {
+    if (tree_ptr->heads[a] == tree_ptr->ends[a])
+        return false;
+    if (tree_ptr->heads[b] == tree_ptr->ends[b])
+        return true;
+
+    return (*tree_ptr->heads[a] < *tree_ptr->heads[b] ||
+            (*tree_ptr->heads[a] == *tree_ptr->heads[b] && a < b));
+}
+
+void loser_tree_init(loser_tree_t *tree_ptr, unsigned int k, const long **heads,
+                     const long **ends) {
+    assert(tree_ptr);
+    assert(k > 0);
+    unsigned int winners[2 * k];
+
+    tree_ptr->k = k;
+    tree_ptr->heads = heads;
+    tree_ptr->ends = ends;
+    if ((tree_ptr->nodes = malloc(k * sizeof(unsigned int))) == NULL)
+        exit_with_sys_err("malloc");
+
+    // torneo iniziale dal basso: la foglia del sotto-array `i` è il nodo
+    // `k + i` e i figli del nodo `n` sono `2n` e `2n + 1`
+    for (unsigned int i = 0; i < k; i++)
+        winners[k + i] = i;
+    for (unsigned int n = k - 1; n >= 1; n--) {
+        unsigned int left = winners[2 * n], right = winners[2 * n + 1];
+        if (__loser_tree_less(tree_ptr, left, right)) {
+            winners[n] = left;
+            tree_ptr->nodes[n] = right;
+        } else {
+            winners[n] = right;
+            tree_ptr->nodes[n] = left;
+        }
+    }
+    tree_ptr->nodes[0] = (k > 1 ? winners[1] : 0);
+}
+
+void loser_tree_destroy(loser_tree_t *tree_ptr) {
+    assert(tree_ptr);
+
+    free(tree_ptr->nodes);
+    tree_ptr->nodes = NULL;
+}
+
+/* estrae il minimo corrente e rigioca i confronti lungo il suo cammino */
+long loser_tree_pop(loser_tree_t *tree_ptr) {
+    assert(tree_ptr);
+    unsigned int winner = tree_ptr->nodes[0], tmp;
+    long value;
+
+    assert(tree_ptr->heads[winner] < tree_ptr->ends[winner]);
+    value = *(tree_ptr->heads[winner]++);
+
+    for (unsigned int n = (tree_ptr->k + winner) / 2; n >= 1; n /= 2)
+        if (__loser_tree_less(tree_ptr, tree_ptr->nodes[n], winner)) {
+            tmp = tree_ptr->nodes[n];
+            tree_ptr->nodes[n] = winner;
+            winner = tmp;
+        }
+    tree_ptr->nodes[0] = winner;
+
+    return value;
+}
+/* < loser-tree > */
+
+/* numero di elementi di `data[0..length)` (ordinato) minori di `value` (se
+ * `or_equal` è falso) o minori o uguali (se vero) */
+static long __count_before(const long *data, long length, long value,
+                           bool or_equal) {
+    long low = 0, high = length, mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (data[mid] < value || (or_equal && data[mid] == value))
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+/* calcola in `splits[i]` quanti elementi del sotto-array `i` precedono la
+ * posizione `rank` del vettore fuso: si cerca (per bisezione sui valori) il
+ * più piccolo valore `v` per cui gli elementi <= `v` sono almeno `rank`; si
+ * prendono poi tutti gli elementi < `v` e i restanti, uguali a `v`, in ordine
+ * di sotto-array (come farebbe il `loser_tree` che a parità preferisce il
+ * sotto-array di indice minore) */
+void split_sub_arrays(long *splits, long rank,
+                      const thread_data_t *thread_data,
+                      unsigned int num_threads) {
+    const long *data = thread_data->shared_data_ptr->data;
+    long low = LONG_MIN, high = LONG_MAX, mid, count, missing;
+
+    while (low < high) {
+        mid = low + (long)(((unsigned long)high - (unsigned long)low) / 2);
+        count = 0;
+        for (unsigned int i = 0; i < num_threads; i++)
+            count += __count_before(data + thread_data[i].sub_array_offset,
+                                    thread_data[i].sub_array_length, mid, true);
+        if (count >= rank)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    missing = rank;
+    for (unsigned int i = 0; i < num_threads; i++) {
+        splits[i] = __count_before(data + thread_data[i].sub_array_offset,
+                                   thread_data[i].sub_array_length, low, false);
+        missing -= splits[i];
+    }
+    for (unsigned int i = 0; i < num_threads && missing > 0; i++) {
+        long equals =
+            __count_before(data + thread_data[i].sub_array_offset,
+                           thread_data[i].sub_array_length, low, true) -
+            splits[i];
+        if (equals > missing)
+            equals = missing;
+        splits[i] += equals;
+        missing -= equals;
+    }
+}
+
+/* fonde le posizioni `[begin, end)` del vettore risultato a partire dai
+ * sotto-array pre-ordinati */
+void merge_sub_arrays(long *output_merged_data, long begin, long end,
+                      const thread_data_t *thread_data,
+                      unsigned int num_threads) {
+    assert(thread_data);
+    assert(num_threads > 0);
+    const long *data = thread_data->shared_data_ptr->data;
+    const long *heads[num_threads], *ends[num_threads];
+    long begin_splits[num_threads], end_splits[num_threads];
+    loser_tree_t tree;
+
+    split_sub_arrays(begin_splits, begin, thread_data, num_threads);
+    split_sub_arrays(end_splits, end, thread_data, num_threads);
+    for (unsigned int i = 0; i < num_threads; i++) {
+        heads[i] = data + thread_data[i].sub_array_offset + begin_splits[i];
+        ends[i] = data + thread_data[i].sub_array_offset + end_splits[i];
+    }
+
+    loser_tree_init(&tree, num_threads, heads, ends);
+    for (long current_index = begin; current_index < end; current_index++)
+        output_merged_data[current_index] = loser_tree_pop(&tree);
+    loser_tree_destroy(&tree);
+}
+
+/* < msd-radix >
+ * fasi del radix sort MSD parallelo (eseguite da tutti i thread e separate
+ * dalla barriera `workers_barrier`): i secchi sono definiti dagli
+ * `MSD_RADIX_BITS` bit più significativi dell'intervallo effettivo delle
+ * chiavi [min, max] (e non dell'intero long: con dati piccoli finirebbero
+ * tutti nello stesso secchio) */
+#define MSD_BUCKETS (1 << MSD_RADIX_BITS)
+
+static void __workers_barrier_wait(shared_data_t *shared_ptr) {
+    int err;
+
+    if ((err = pthread_barrier_wait(&shared_ptr->workers_barrier)) > 0)
+        exit_with_err("pthread_barrier_wait", err);
+}
+
+/* distribuisce gli elementi del proprio sotto-array nei secchi di
+ * `merged_data`: al ritorno (dopo la barriera principale) tutti i secchi sono
+ * completi */
+void msd_radix_partition(thread_data_t *data_ptr) {
+    shared_data_t *shared_ptr = data_ptr->shared_data_ptr;
+    const long *data = shared_ptr->data + data_ptr->sub_array_offset;
+    unsigned long min_key = ULONG_MAX, max_key = 0, key;
+    long offsets[MSD_BUCKETS], offset = 0;
+    int shift = 0;
+
+    // 1. intervallo delle chiavi del sotto-array
+    for (long i = 0; i < data_ptr->sub_array_length; i++) {
+        key = radix_key(data[i]);
+        min_key = (key < min_key ? key : min_key);
+        max_key = (key > max_key ? key : max_key);
+    }
+    data_ptr->min_key = min_key;
+    data_ptr->max_key = max_key;
+    __workers_barrier_wait(shared_ptr);
+
+    // 2. intervallo globale (ogni thread lo ricalcola da sé) e istogramma
+    for (unsigned int t = 0; t < shared_ptr->num_threads; t++) {
+        min_key = (shared_ptr->threads[t].min_key < min_key
+                       ? shared_ptr->threads[t].min_key
+                       : min_key);
+        max_key = (shared_ptr->threads[t].max_key > max_key
+                       ? shared_ptr->threads[t].max_key
+                       : max_key);
+    }
+    while (((max_key - min_key) >> shift) >= MSD_BUCKETS)
+        shift++;
+    memset(data_ptr->histogram, 0, MSD_BUCKETS * sizeof(long));
+    for (long i = 0; i < data_ptr->sub_array_length; i++)
+        data_ptr->histogram[(radix_key(data[i]) - min_key) >> shift]++;
+    __workers_barrier_wait(shared_ptr);
+
+    // 3. posizione di scrittura nel secchio `b`: tutti gli elementi dei
+    // secchi precedenti più quelli del secchio `b` dei thread precedenti
+    for (int b = 0; b < MSD_BUCKETS; b++)
+        for (unsigned int t = 0; t < shared_ptr->num_threads; t++) {
+            if (t + 1 == data_ptr->id)
+                offsets[b] = offset;
+            offset += shared_ptr->threads[t].histogram[b];
+        }
+    for (long i = 0; i < data_ptr->sub_array_length; i++)
+        shared_ptr->merged_data[offsets[(radix_key(data[i]) - min_key) >>
+                                        shift]++] = data[i];
+}
+
+/* ordina i secchi "di competenza": quelli che iniziano nella porzione
+ * `[id-1, id) * N/n` del vettore risultato (ognuno col radix sort LSD, usando
+ * il vettore originale, ormai inutile, come appoggio) */
+void msd_radix_sort_buckets(thread_data_t *data_ptr) {
+    shared_data_t *shared_ptr = data_ptr->shared_data_ptr;
+    long begin = shared_ptr->full_array_length * (data_ptr->id - 1) /
+                 shared_ptr->num_threads;
+    long end =
+        shared_ptr->full_array_length * data_ptr->id / shared_ptr->num_threads;
+    long bucket_begin = 0, bucket_length;
+
+    for (int b = 0; b < MSD_BUCKETS && bucket_begin < end; b++) {
+        bucket_length = 0;
+        for (unsigned int t = 0; t < shared_ptr->num_threads; t++)
+            bucket_length += shared_ptr->threads[t].histogram[b];
+        if (bucket_begin >= begin)
+            radix_sort(shared_ptr->merged_data + bucket_begin, bucket_length,
+                       shared_ptr->data + bucket_begin);
+        bucket_begin += bucket_length;
+    }
+}
+/* < msd-radix > */
+
 void *thread_function(void *arg) {
     assert(arg);
     int err;
     thread_data_t *data_ptr = (thread_data_t *)arg;
+    shared_data_t *shared_ptr = data_ptr->shared_data_ptr;
 
     printf("[T%u] thread attivato...\n", data_ptr->id);
     printf("[T%u] aspetto che i dati da ordinare siano pronti...\n",
            data_ptr->id);
 
     // bloccaggio sulla barriera per attendere i dati da ordinare
-    if ((err = pthread_barrier_wait(&data_ptr->shared_data_ptr->barrier)) > 0)
+    if ((err = pthread_barrier_wait(&shared_ptr->barrier)) > 0)
         exit_with_err("pthread_barrier_wait", err);
 
-    printf("[T%u] ordinamento del sotto-vettore di %lu elementi (su %lu)...\n",
-           data_ptr->id, data_ptr->sub_array_length,
-           data_ptr->shared_data_ptr->full_array_length);
+    if (shared_ptr->algorithm == MSD_RADIX_SORT) {
+        printf("[T%u] suddivisione in secchi di %lu elementi (su %lu)...\n",
+               data_ptr->id, data_ptr->sub_array_length,
+               shared_ptr->full_array_length);
+        msd_radix_partition(data_ptr);
+    } else {
+        printf("[T%u] ordinamento del sotto-vettore di %lu elementi (su "
+               "%lu)...\n",
+               data_ptr->id, data_ptr->sub_array_length,
+               shared_ptr->full_array_length);
+        sort_sub_array(shared_ptr->data + data_ptr->sub_array_offset,
+                       data_ptr->sub_array_length, shared_ptr->algorithm);
+    }
 
-    if (heapsort(data_ptr->shared_data_ptr->data + data_ptr->sub_array_offset,
-                 data_ptr->sub_array_length, sizeof(long), long_compare) != 0)
-        exit_with_sys_err("heapsort");
+    printf("[T%u] prima fase completata: attendo gli altri thread...\n",
+           data_ptr->id);
+
+    // la seconda fase può partire solo quando tutti hanno finito la prima
+    if ((err = pthread_barrier_wait(&shared_ptr->barrier)) > 0)
+        exit_with_err("pthread_barrier_wait", err);
 
-    printf("[T%u] ordinamento completato: segnalo la terminazione...\n",
+    if (shared_ptr->algorithm == MSD_RADIX_SORT)
+        // ordinamento dei secchi di competenza: non serve alcuna fusione
+        msd_radix_sort_buckets(data_ptr);
+    else {
+        // fusione della porzione di competenza del vettore risultato
+        long begin = shared_ptr->full_array_length * (data_ptr->id - 1) /
+                     shared_ptr->num_threads;
+        long end = shared_ptr->full_array_length * data_ptr->id /
+                   shared_ptr->num_threads;
+        merge_sub_arrays(shared_ptr->merged_data, begin, end,
+                         shared_ptr->threads, shared_ptr->num_threads);
+    }
+
+    printf("[T%u] seconda fase completata: segnalo la terminazione...\n",
            data_ptr->id);
 
     // nuova sincronizzazione sulla barriera che risveglierà il `main`
-    if ((err = pthread_barrier_wait(&data_ptr->shared_data_ptr->barrier)) > 0)
+    if ((err = pthread_barrier_wait(&shared_ptr->barrier)) > 0)
         exit_with_err("pthread_barrier_wait", err);
 
     return (NULL);
 }
 
+/* < work-stealing >
+ * fasi della variante con work stealing: ogni indice del primo
+ * `ws_parallel_for` è un sotto-array da ordinare, ogni indice del secondo una
+ * posizione del vettore risultato */
+void ws_sort_sub_arrays(long begin, long end, void *arg) {
+    assert(arg);
+    shared_data_t *shared_ptr = (shared_data_t *)arg;
+
+    for (long i = begin; i < end; i++)
+        sort_sub_array(shared_ptr->data + shared_ptr->threads[i].sub_array_offset,
+                       shared_ptr->threads[i].sub_array_length,
+                       shared_ptr->algorithm);
+}
+
+void ws_merge_sub_arrays(long begin, long end, void *arg) {
+    assert(arg);
+    shared_data_t *shared_ptr = (shared_data_t *)arg;
+
+    merge_sub_arrays(shared_ptr->merged_data, begin, end, shared_ptr->threads,
+                     shared_ptr->num_threads);
+}
+/* < work-stealing > */
+
 void print_array(const long *data, unsigned long size) {
     printf("{ ");
     for (unsigned long i = 0; i < size; i++)
@@ -100,69 +569,86 @@ void print_array(const long *data, unsigned long size) {
     printf(" } [%lu]\n", size);
 }
 
-void merge_sub_arrays(long *output_merged_data,
-                      const thread_data_t *thread_data,
-                      unsigned int num_threads) {
-    assert(thread_data);
-    assert(num_threads > 0);
-
-    long indexes[num_threads];
-    for (unsigned int i = 0; i < num_threads; i++)
-        indexes[i] = thread_data[i].sub_array_offset;
-    for (unsigned long current_index = 0;
-         current_index < thread_data->shared_data_ptr->full_array_length;
-         current_index++) {
-        long min = LONG_MAX;
-        unsigned int min_index;
-        for (unsigned int i = 0; i < num_threads; i++) {
-            if ((indexes[i] < thread_data[i].sub_array_offset +
-                                  thread_data[i].sub_array_length) &&
-                (thread_data->shared_data_ptr->data[indexes[i]] < min)) {
-                min = thread_data->shared_data_ptr->data[indexes[i]];
-                min_index = i;
-            }
-        }
-        output_merged_data[current_index] =
-            thread_data->shared_data_ptr->data[indexes[min_index]];
-        indexes[min_index]++;
-    }
-}
-
 int main(int argc, char *argv[]) {
     int err;
     unsigned int num_threads = DEFAULT_NUM_OF_SORTING_THREADS;
+    bool work_stealing = false;
 
     shared_data_t shared_data;
-    long *merged_sorted_data, *single_thread_sorted_data;
+    ws_pool_t pool;
+    long *single_thread_sorted_data;
 
-    time_t timestamp;
-    unsigned long multi_thread_timing, merge_sub_arrays_timing,
-        single_thread_timing;
+    double timestamp, multi_thread_timing, sort_sub_arrays_timing,
+        merge_sub_arrays_timing, single_thread_timing;
 
     srand(time(NULL));
 
     if (argc > 1)
-        if ((num_threads = atoi(argv[1])) < 1 ||
-            (num_threads > MAX_NUM_OF_SORTING_THREADS))
+        if ((num_threads = atoi(argv[1])) < 1)
             exit_with_err_msg("numero di thread (%d) non valido!\n",
                               num_threads);
 
-    // preparazione barriera
-    if ((err =
-             pthread_barrier_init(&shared_data.barrier, NULL, num_threads + 1)))
-        exit_with_err("pthread_barrier_init", err);
+    shared_data.algorithm = HEAPSORT;
+    if (argc > 2) {
+        if (strcmp(argv[2], "radix") == 0)
+            shared_data.algorithm = LSD_RADIX_SORT;
+        else if (strcmp(argv[2], "msd-radix") == 0)
+            shared_data.algorithm = MSD_RADIX_SORT;
+        else if (strcmp(argv[2], "heapsort") != 0)
+            exit_with_err_msg("algoritmo '%s' non valido!\n", argv[2]);
+    }
+    printf("[main] algoritmo di ordinamento: %s\n",
+           sort_algorithm_names[shared_data.algorithm]);
+
+    if (argc > 3) {
+        if (strcmp(argv[3], "work-stealing") == 0)
+            work_stealing = true;
+        else if (strcmp(argv[3], "barriere") != 0)
+            exit_with_err_msg("strategia '%s' non valida!\n", argv[3]);
+    }
+    if (work_stealing && shared_data.algorithm == MSD_RADIX_SORT)
+        exit_with_err_msg("l'msd-radix richiede le barriere!\n");
 
-    // creazione e avvio dei thread senza i dati da ordinare
-    printf("[main] avvio dei thread senza dati da ordinare...\n");
-    thread_data_t thread_data[num_threads];
     shared_data.full_array_length = QUANTITY_OF_NUMBERS_TO_SORT;
-    assert(shared_data.full_array_length % num_threads == 0);
-    for (unsigned int i = 0; i < num_threads; i++) {
-        thread_data[i].id = i + 1;
-        thread_data[i].shared_data_ptr = &shared_data;
-        if ((err = pthread_create(&thread_data[i].tid, NULL, thread_function,
-                                  (void *)&thread_data[i])))
-            exit_with_err("pthread_create", err);
+    shared_data.num_threads =
+        (work_stealing ? num_threads * WS_RUNS_PER_THREAD : num_threads);
+    thread_data_t *thread_data =
+        malloc(shared_data.num_threads * sizeof(thread_data_t));
+    if (thread_data == NULL)
+        exit_with_sys_err("malloc");
+    shared_data.threads = thread_data;
+
+    if (work_stealing) {
+        // il main è il lavoratore 0 del pool
+        printf("[main] avvio del pool di %u thread con work stealing...\n",
+               num_threads);
+        ws_pool_init(&pool, num_threads);
+        for (unsigned int i = 0; i < shared_data.num_threads; i++) {
+            thread_data[i].id = i + 1;
+            thread_data[i].shared_data_ptr = &shared_data;
+        }
+    } else {
+        // preparazione barriere
+        if ((err = pthread_barrier_init(&shared_data.barrier, NULL,
+                                        num_threads + 1)))
+            exit_with_err("pthread_barrier_init", err);
+        if ((err = pthread_barrier_init(&shared_data.workers_barrier, NULL,
+                                        num_threads)))
+            exit_with_err("pthread_barrier_init", err);
+
+        // creazione e avvio dei thread senza i dati da ordinare
+        printf("[main] avvio dei thread senza dati da ordinare...\n");
+        for (unsigned int i = 0; i < num_threads; i++) {
+            thread_data[i].id = i + 1;
+            thread_data[i].shared_data_ptr = &shared_data;
+            if ((thread_data[i].histogram =
+                     malloc(MSD_BUCKETS * sizeof(long))) == NULL)
+                exit_with_sys_err("malloc");
+            if ((err = pthread_create(&thread_data[i].tid, NULL,
+                                      thread_function,
+                                      (void *)&thread_data[i])))
+                exit_with_err("pthread_create", err);
+        }
     }
 
     // generazione dei dati da ordinare
@@ -172,12 +658,18 @@ int main(int argc, char *argv[]) {
     if ((shared_data.data =
              malloc(shared_data.full_array_length * sizeof(long))) == NULL)
         exit_with_sys_err("malloc");
-    for (unsigned long i = 0; i < shared_data.full_array_length; i++)
+    if ((shared_data.merged_data =
+             malloc(shared_data.full_array_length * sizeof(long))) == NULL)
+        exit_with_sys_err("malloc");
+    for (long i = 0; i < shared_data.full_array_length; i++)
         shared_data.data[i] = rand() % 256;
-    for (int i = 0; i < num_threads; i++) {
+    // l'eventuale resto della divisione va ai primi thread (uno a testa)
+    for (unsigned int i = 0; i < shared_data.num_threads; i++) {
+        thread_data[i].sub_array_offset =
+            shared_data.full_array_length * i / shared_data.num_threads;
         thread_data[i].sub_array_length =
-            shared_data.full_array_length / num_threads;
-        thread_data[i].sub_array_offset = i * thread_data[i].sub_array_length;
+            shared_data.full_array_length * (i + 1) / shared_data.num_threads -
+            thread_data[i].sub_array_offset;
     }
 
     // preparazione della copia dell'array da ordinare
@@ -188,52 +680,77 @@ int main(int argc, char *argv[]) {
            shared_data.full_array_length * sizeof(long));
 
     // campionatura per il benchmark multi-thread
-    timestamp = time(NULL);
-
-    // prima sincronizzazione sulla barriera che risveglierà tutti i thread
-    if ((err = pthread_barrier_wait(&shared_data.barrier)) > 0)
-        exit_with_err("pthread_barrier_wait", err);
-
-    printf("[main] attesa della terminazione dei thread...\n");
-    // nuovo bloccaggio sulla barriera per attendere la fine dell'ordinamento
-    // dei sotto-array
-    if ((err = pthread_barrier_wait(&shared_data.barrier)) > 0)
-        exit_with_err("pthread_barrier_wait", err);
-
-    // altra campionatura la fase parallela multi-thread
-    multi_thread_timing = time(NULL) - timestamp;
-    timestamp = time(NULL);
-
-    printf("[main] fusione dei sotto-array pre-ordinati...\n");
-    if ((merged_sorted_data =
-             malloc(shared_data.full_array_length * sizeof(long))) == NULL)
-        exit_with_sys_err("malloc");
-    merge_sub_arrays(merged_sorted_data, thread_data, num_threads);
-
-    // campionatura finale il benchmark dell'ordinamento multi-thread
-    merge_sub_arrays_timing = time(NULL) - timestamp;
-    multi_thread_timing += merge_sub_arrays_timing;
-    printf("[main] terminazione dell'ordinamento multi-thread in ~%lu secondi "
-           "(di cui ~%lu per la fusione)\n",
-           multi_thread_timing, merge_sub_arrays_timing);
-
+    timestamp = seconds_now();
+
+    if (work_stealing) {
+        printf("[main] ordinamento di %u sotto-array con work stealing...\n",
+               shared_data.num_threads);
+        ws_parallel_for(&pool, 0, shared_data.num_threads, 1,
+                        ws_sort_sub_arrays, &shared_data);
+        sort_sub_arrays_timing = seconds_now() - timestamp;
+        timestamp = seconds_now();
+
+        printf("[main] fusione con work stealing...\n");
+        ws_parallel_for(&pool, 0, shared_data.full_array_length,
+                        WS_MERGE_GRAIN, ws_merge_sub_arrays, &shared_data);
+        merge_sub_arrays_timing = seconds_now() - timestamp;
+
+        ws_pool_print_stats(&pool);
+        ws_pool_destroy(&pool);
+    } else {
+        // prima sincronizzazione sulla barriera che risveglierà tutti i thread
+        if ((err = pthread_barrier_wait(&shared_data.barrier)) > 0)
+            exit_with_err("pthread_barrier_wait", err);
+
+        printf("[main] attesa della terminazione dei thread...\n");
+        // nuovo bloccaggio sulla barriera per attendere la fine
+        // dell'ordinamento dei sotto-array
+        if ((err = pthread_barrier_wait(&shared_data.barrier)) > 0)
+            exit_with_err("pthread_barrier_wait", err);
+
+        // altra campionatura per la fase di ordinamento dei sotto-array
+        sort_sub_arrays_timing = seconds_now() - timestamp;
+        timestamp = seconds_now();
+
+        // ultimo bloccaggio per attendere la fine della fusione parallela
+        if ((err = pthread_barrier_wait(&shared_data.barrier)) > 0)
+            exit_with_err("pthread_barrier_wait", err);
+
+        // campionatura finale il benchmark dell'ordinamento multi-thread
+        merge_sub_arrays_timing = seconds_now() - timestamp;
+    }
+    multi_thread_timing = sort_sub_arrays_timing + merge_sub_arrays_timing;
+    printf("[main] terminazione dell'ordinamento multi-thread in ~%.3f secondi "
+           "(%s ~%.3f, %s ~%.3f)\n",
+           multi_thread_timing,
+           (shared_data.algorithm == MSD_RADIX_SORT ? "suddivisione"
+                                                    : "ordinamento"),
+           sort_sub_arrays_timing,
+           (shared_data.algorithm == MSD_RADIX_SORT ? "ordinamento dei secchi"
+                                                    : "fusione"),
+           merge_sub_arrays_timing);
+
+    // NB: con l'MSD il main usa comunque il radix sort LSD
     printf("[main] ordinamento classico single-thread...\n");
-    timestamp = time(NULL);
-    if (heapsort(single_thread_sorted_data, shared_data.full_array_length,
-                 sizeof(long), long_compare) != 0)
-        exit_with_sys_err("heapsort");
-    single_thread_timing = time(NULL) - timestamp;
-    printf(
-        "[main] terminazione dell'ordinamento single-thread in ~%lu secondi\n",
-        single_thread_timing);
-
-    printf("[main] confronto del tempo richiesto: multi-thread ~%lu secondi "
-           "vs. single-thread ~%lu secondi\n",
-           multi_thread_timing, single_thread_timing);
+    timestamp = seconds_now();
+    sort_sub_array(single_thread_sorted_data, shared_data.full_array_length,
+                   shared_data.algorithm);
+    single_thread_timing = seconds_now() - timestamp;
+    printf("[main] terminazione dell'ordinamento single-thread in ~%.3f "
+           "secondi\n",
+           single_thread_timing);
+
+    printf("[main] confronto del tempo richiesto: multi-thread ~%.3f secondi "
+           "(%.0f elementi/secondo) vs. single-thread ~%.3f secondi (%.0f "
+           "elementi/secondo)\n",
+           multi_thread_timing,
+           shared_data.full_array_length / multi_thread_timing,
+           single_thread_timing,
+           shared_data.full_array_length / single_thread_timing);
 
     // confronto delle due liste ordinate
     printf("[main] confronto delle due liste ordinate...\n");
-    if (memcmp(merged_sorted_data, single_thread_sorted_data,
+    if (memcmp(shared_data.merged_data, single_thread_sorted_data,
                shared_data.full_array_length * sizeof(long)) == 0) {
         printf("[main] risultato corretto!\n");
         exit(EXIT_SUCCESS);
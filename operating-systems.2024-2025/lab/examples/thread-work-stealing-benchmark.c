@@ -0,0 +1,217 @@
+/**
+ * confronta la suddivisione statica del lavoro (un thread per ognuna delle `n`
+ * fette uguali, come negli esempi con le barriere) con quella dinamica della
+ * libreria `lib-work-stealing` in presenza di "vicini rumorosi": alcuni thread
+ * disturbatori che consumano CPU (su Linux sono vincolati al core 0) per tutta
+ * la durata del test.
+ *
+ * con le fette statiche il tempo totale è quello della fetta più lenta: basta
+ * un core disturbato per allungare la coda della distribuzione dei tempi; con
+ * il work stealing i lavoratori liberi rubano i pezzi rimasti a quelli
+ * rallentati. per ogni strategia vengono riportati minimo, mediana, 90° e 99°
+ * percentile e massimo dei tempi delle ripetizioni.
+ *
+ * uso: thread-work-stealing-benchmark [numero-thread] [disturbatori]
+ *          [ripetizioni] [elementi]
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // per `pthread_setaffinity_np`
+#endif
+
+#include "lib-misc.h"
+#include "lib-work-stealing.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_NUM_THREADS 4
+#define DEFAULT_NUM_NOISY_THREADS 1
+#define DEFAULT_REPETITIONS 20
+#define DEFAULT_NUM_ITEMS 1000000L
+#define ITEM_BASE_COST 32 // iterazioni minime per elemento
+
+typedef struct {
+    const unsigned int *costs;
+    unsigned long *results;
+} workload_t;
+
+typedef struct {
+    pthread_t tid;
+    long begin, end;
+    workload_t *workload_ptr;
+} slice_data_t;
+
+typedef struct {
+    pthread_t tid;
+    volatile bool *stop_ptr;
+} noisy_data_t;
+
+/* lavoro fittizio sugli elementi `[begin, end)`: il costo di ogni elemento è
+ * variabile per rendere irregolare anche il carico "senza rumore" */
+void process_items(long begin, long end, void *arg) {
+    assert(arg);
+    workload_t *workload_ptr = (workload_t *)arg;
+    unsigned long x;
+
+    for (long i = begin; i < end; i++) {
+        x = i;
+        for (unsigned int k = 0; k < workload_ptr->costs[i]; k++)
+            x = x * 6364136223846793005UL + 1442695040888963407UL;
+        workload_ptr->results[i] = x;
+    }
+}
+
+void *slice_function(void *arg) {
+    assert(arg);
+    slice_data_t *data_ptr = (slice_data_t *)arg;
+
+    process_items(data_ptr->begin, data_ptr->end, data_ptr->workload_ptr);
+
+    return (NULL);
+}
+
+void *noisy_function(void *arg) {
+    assert(arg);
+    noisy_data_t *data_ptr = (noisy_data_t *)arg;
+    volatile unsigned long counter = 0;
+
+    while (!*data_ptr->stop_ptr)
+        counter++;
+
+    return (NULL);
+}
+
+/* suddivisione statica: `num_threads` fette uguali, un thread per fetta */
+double run_static(workload_t *workload_ptr, long num_items,
+                  unsigned int num_threads) {
+    int err;
+    slice_data_t slices[num_threads];
+    double timestamp = seconds_now();
+
+    for (unsigned int i = 0; i < num_threads; i++) {
+        slices[i].begin = num_items * i / num_threads;
+        slices[i].end = num_items * (i + 1) / num_threads;
+        slices[i].workload_ptr = workload_ptr;
+        if ((err = pthread_create(&slices[i].tid, NULL, slice_function,
+                                  &slices[i])))
+            exit_with_err("pthread_create", err);
+    }
+    for (unsigned int i = 0; i < num_threads; i++)
+        if ((err = pthread_join(slices[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+
+    return seconds_now() - timestamp;
+}
+
+double run_work_stealing(workload_t *workload_ptr, long num_items,
+                         ws_pool_t *pool) {
+    double timestamp = seconds_now();
+
+    ws_parallel_for(pool, 0, num_items, 0, process_items, workload_ptr);
+
+    return seconds_now() - timestamp;
+}
+
+int double_compare(const void *arg1, const void *arg2) {
+    double d1 = *((double *)arg1);
+    double d2 = *((double *)arg2);
+
+    return (d1 > d2) - (d1 < d2);
+}
+
+void print_latencies(const char *name, double *timings,
+                     unsigned int repetitions) {
+    qsort(timings, repetitions, sizeof(double), double_compare);
+    printf("%-14s min %8.3f ms, mediana %8.3f ms, p90 %8.3f ms, p99 %8.3f ms, "
+           "max %8.3f ms\n",
+           name, timings[0] * 1e3, timings[(repetitions - 1) / 2] * 1e3,
+           timings[(unsigned int)(0.90 * (repetitions - 1) + 0.5)] * 1e3,
+           timings[(unsigned int)(0.99 * (repetitions - 1) + 0.5)] * 1e3,
+           timings[repetitions - 1] * 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    int err;
+    unsigned int num_threads = DEFAULT_NUM_THREADS;
+    int num_noisy_threads = DEFAULT_NUM_NOISY_THREADS;
+    int repetitions = DEFAULT_REPETITIONS;
+    long num_items = DEFAULT_NUM_ITEMS;
+    volatile bool stop = false;
+    unsigned int *costs;
+    unsigned long *results;
+    workload_t workload;
+    ws_pool_t pool;
+
+    if (argc > 1 && (num_threads = atoi(argv[1])) < 1)
+        exit_with_err_msg("numero di thread (%d) non valido!\n", num_threads);
+    if (argc > 2 && (num_noisy_threads = atoi(argv[2])) < 0)
+        exit_with_err_msg("numero di disturbatori (%d) non valido!\n",
+                          num_noisy_threads);
+    if (argc > 3 && (repetitions = atoi(argv[3])) < 1)
+        exit_with_err_msg("numero di ripetizioni (%d) non valido!\n",
+                          repetitions);
+    if (argc > 4 && (num_items = atol(argv[4])) < 1)
+        exit_with_err_msg("numero di elementi (%ld) non valido!\n", num_items);
+
+    noisy_data_t noisy_data[num_noisy_threads > 0 ? num_noisy_threads : 1];
+    double static_timings[repetitions], ws_timings[repetitions];
+
+    // costi irregolari: ogni tanto un elemento molto più pesante
+    if ((costs = malloc(num_items * sizeof(unsigned int))) == NULL)
+        exit_with_sys_err("malloc");
+    if ((results = malloc(num_items * sizeof(unsigned long))) == NULL)
+        exit_with_sys_err("malloc");
+    srand(time(NULL));
+    for (long i = 0; i < num_items; i++)
+        costs[i] = ITEM_BASE_COST + (rand() % 64 == 0 ? 16 * ITEM_BASE_COST
+                                                      : rand() % ITEM_BASE_COST);
+    workload.costs = costs;
+    workload.results = results;
+
+    printf("[main] %u thread, %d disturbatori, %d ripetizioni, %ld elementi\n",
+           num_threads, num_noisy_threads, repetitions, num_items);
+
+    for (int i = 0; i < num_noisy_threads; i++) {
+        noisy_data[i].stop_ptr = &stop;
+        if ((err = pthread_create(&noisy_data[i].tid, NULL, noisy_function,
+                                  &noisy_data[i])))
+            exit_with_err("pthread_create", err);
+#ifdef __linux__
+        // tutti i disturbatori sullo stesso core: solo chi ci gira rallenta
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(0, &cpu_set);
+        if ((err = pthread_setaffinity_np(noisy_data[i].tid, sizeof(cpu_set),
+                                          &cpu_set)))
+            exit_with_err("pthread_setaffinity_np", err);
+#endif
+    }
+
+    ws_pool_init(&pool, num_threads);
+
+    // ripetizioni alternate per esporre le due strategie allo stesso rumore
+    for (int r = 0; r < repetitions; r++) {
+        static_timings[r] = run_static(&workload, num_items, num_threads);
+        ws_timings[r] = run_work_stealing(&workload, num_items, &pool);
+    }
+
+    stop = true;
+    for (int i = 0; i < num_noisy_threads; i++)
+        if ((err = pthread_join(noisy_data[i].tid, NULL)))
+            exit_with_err("pthread_join", err);
+
+    print_latencies("fette statiche", static_timings, repetitions);
+    print_latencies("work stealing", ws_timings, repetitions);
+    ws_pool_print_stats(&pool);
+
+    ws_pool_destroy(&pool);
+    free(costs);
+    free(results);
+
+    exit(EXIT_SUCCESS);
+}